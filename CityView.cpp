@@ -0,0 +1,122 @@
+#include "CityView.h"
+#include "Frustum.h"
+#include "Material.h"
+#include "PolygonMesh.h"
+#include "VertexAttrib.h"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "ObjImporter.h"
+
+// Smallest triangle (square metres) worth rasterizing as an occluder
+static const float kMinOccluderArea = 4.f;
+
+// Shader attribute locations, as for the drones
+static const int kPositionLocation = 0;
+static const int kNormalLocation   = 1;
+
+CityView::CityView()
+    : mMesh("city")
+    , mLoaded(false)
+    , mMaterial(0)
+    , mTriangleCount(0)
+    , mBoundsMin(0.f)
+    , mBoundsMax(0.f)
+{
+}
+
+CityView::~CityView()
+{
+    cleanup();
+}
+
+bool CityView::load(const std::string& path, RenderQueue& queue, int importThreads)
+{
+    // Scanned city blocks run to hundreds of MB: map the file and parse it
+    // in place rather than streaming it
+    util::PolygonMesh<VertexAttrib> mesh;
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        mesh = util::ObjImporter<VertexAttrib>::importFile(path, false, importThreads);
+    }
+    catch (const std::string& message)
+    {
+        std::cerr << path << ": " << message << "\n";
+        return false;
+    }
+    double importMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Large triangles become occluders
+    util::ArrayView<VertexAttrib> vertices = mesh.getVertexAttributes();
+    util::ArrayView<unsigned int> indices  = mesh.getPrimitives();
+    mOccluders.clear();
+    for(size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        if (indices[t] >= vertices.size() || indices[t + 1] >= vertices.size() ||
+            indices[t + 2] >= vertices.size())
+            continue;
+        glm::vec3 p[3];
+        for(int k = 0; k < 3; k++)
+            p[k] = glm::vec3(vertices[indices[t + k]].get<util::Position>());
+        if (0.5f * glm::length(glm::cross(p[1] - p[0], p[2] - p[0])) >= kMinOccluderArea)
+            mOccluders.insert(mOccluders.end(), p, p + 3);
+    }
+    mTriangleCount = (int)indices.size() / 3;
+    std::cout << "Imported " << path << " (" << mTriangleCount << " triangles) in "
+              << importMs << " ms" << std::endl;
+    mBoundsMin = glm::vec3(mesh.getMinimumBounds());
+    mBoundsMax = glm::vec3(mesh.getMaximumBounds());
+
+    util::ShaderLocationsVault locations;
+    locations.add("aPos",    kPositionLocation);
+    locations.add("aNormal", kNormalLocation);
+
+    std::map<std::string,std::string> attributes;
+    attributes["aPos"]    = "position";
+    attributes["aNormal"] = "normal";
+    // Consumed: the imported arrays are freed once they are on the GPU
+    mMesh.initPolygonMesh(locations, attributes, std::move(mesh));
+
+    util::Material concrete;
+    concrete.setAmbient(0.25f, 0.25f, 0.27f);
+    concrete.setDiffuse(0.62f, 0.62f, 0.66f);
+    concrete.setSpecular(0.1f, 0.1f, 0.1f);
+    concrete.setShininess(8.f);
+    mMaterial = queue.registerMaterial(concrete);
+
+    mLoaded = true;
+    return true;
+}
+
+void CityView::submit(const glm::mat4& view, const glm::mat4& projection,
+                      GLuint program, RenderQueue& queue)
+{
+    if (!mLoaded)
+        return;
+
+    glm::vec4 frustum[6];
+    extractFrustum(projection * view, frustum);
+    if (!boxInFrustum(frustum, mBoundsMin, mBoundsMax))
+        return;
+
+    // Drawn first among its program's draws: it is what hides the drones
+    DrawItem item;
+    item.program   = program;
+    item.vao       = mMesh.getVAO();
+    item.primitive = mMesh.getPrimitiveType();
+    item.indexed   = true;
+    item.count     = mMesh.getPrimitiveCount();
+    item.material  = mMaterial;
+    queue.submit(item, 0.f);
+}
+
+void CityView::cleanup()
+{
+    if (mLoaded)
+    {
+        mMesh.cleanup();
+        mLoaded = false;
+    }
+}
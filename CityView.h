@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "ObjectInstance.h"
+#include "RenderQueue.h"
+
+/**
+ * CityView draws static scenery imported from an OBJ file (city blocks the
+ * drones fly between) and hands its large triangles to occlusion culling.
+ *
+ * The mesh is used in world units as stored in the file. Triangles of at
+ * least kMinOccluderArea square metres - walls and roofs rather than
+ * detail - are kept as occluders.
+ */
+class CityView
+{
+public:
+    CityView();
+    ~CityView();
+
+    // Import path, parsed on importThreads threads (0 = one per core);
+    // false (and a message) if it cannot be read
+    bool load(const std::string& path, RenderQueue& queue, int importThreads = 0);
+
+    // Queue the city for one viewport; view and projection must be set on
+    // program. Skipped when the whole city is outside the frustum.
+    void submit(const glm::mat4& view, const glm::mat4& projection,
+                GLuint program, RenderQueue& queue);
+
+    void cleanup();
+
+    bool isLoaded() const           { return mLoaded; }
+    int  getTriangleCount() const   { return mTriangleCount; }
+    const std::vector<glm::vec3>& getOccluders() const { return mOccluders; }
+
+private:
+    util::ObjectInstance   mMesh;
+    bool                   mLoaded;
+    int                    mMaterial;
+    int                    mTriangleCount;
+    glm::vec3              mBoundsMin;
+    glm::vec3              mBoundsMax;
+    std::vector<glm::vec3> mOccluders; // three vertices per triangle
+};
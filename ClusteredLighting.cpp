@@ -0,0 +1,362 @@
+#include "ClusteredLighting.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Texture units used for the three texture buffers
+static const int kFirstTextureUnit = 1;
+
+// Weight of the newest sample in getCullMs()
+static const double kAverageWeight = 0.1;
+
+// cos(cutoff) stored for point lights: below any real cone
+static const float kPointLightCone = -2.f;
+
+static double nowSeconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+ClusteredLighting::ClusteredLighting()
+    : mNear(0.1f)
+    , mFar(100.f)
+    , mClusterProjection(0.f)
+    , mMaxIndices(65536)
+    , mOrigin(0.f)
+    , mTileSize(1.f)
+    , mSunDirection(0.f, -1.f, 0.f)
+    , mSunAmbient(0.f)
+    , mSunDiffuse(0.f)
+    , mSunSpecular(0.f)
+    , mNextSlice(0)
+    , mJob(0)
+    , mBusy(0)
+    , mQuit(false)
+    , mCullMs(-1.0)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        mBuffers[i] = 0;
+        mTextures[i] = 0;
+    }
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+    cleanup();
+}
+
+void ClusteredLighting::init(int workerThreads, float nearPlane, float farPlane)
+{
+    mNear = nearPlane;
+    mFar  = farPlane;
+    mClusterCounts.resize(kClusters);
+    mClusterRanges.resize(kClusters * 2);
+
+    // The index list is the only buffer that can get big; GL only
+    // promises 64K texels per texture buffer
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &mMaxIndices);
+
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    glGenBuffers(3, mBuffers);
+    glGenTextures(3, mTextures);
+    for(int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], mBuffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    mQuit = false;
+    for(int i = 0; i < workerThreads; i++)
+        mWorkers.push_back(std::thread(&ClusteredLighting::workerLoop, this));
+}
+
+void ClusteredLighting::buildClusterBounds(const glm::mat4& projection)
+{
+    // View-space box of every froxel: the tile's corners, pushed out to the
+    // slice's near and far depths (assumes a symmetric perspective)
+    mClusterBounds.resize(kClusters);
+    for(int z = 0; z < kSlices; z++)
+    {
+        float d0 = mNear * std::pow(mFar / mNear, (float)z / kSlices);
+        float d1 = mNear * std::pow(mFar / mNear, (float)(z + 1) / kSlices);
+
+        for(int y = 0; y < kTilesY; y++)
+        {
+            float ny0 = -1.f + 2.f * y / kTilesY;
+            float ny1 = -1.f + 2.f * (y + 1) / kTilesY;
+
+            for(int x = 0; x < kTilesX; x++)
+            {
+                float nx0 = -1.f + 2.f * x / kTilesX;
+                float nx1 = -1.f + 2.f * (x + 1) / kTilesX;
+
+                Aabb& box = mClusterBounds[(z * kTilesY + y) * kTilesX + x];
+                float xs[4] = { nx0 * d0, nx1 * d0, nx0 * d1, nx1 * d1 };
+                float ys[4] = { ny0 * d0, ny1 * d0, ny0 * d1, ny1 * d1 };
+                box.min = glm::vec3(*std::min_element(xs, xs + 4) / projection[0][0],
+                                    *std::min_element(ys, ys + 4) / projection[1][1], -d1);
+                box.max = glm::vec3(*std::max_element(xs, xs + 4) / projection[0][0],
+                                    *std::max_element(ys, ys + 4) / projection[1][1], -d0);
+            }
+        }
+    }
+    mClusterProjection = projection;
+}
+
+void ClusteredLighting::cullSlice(int slice)
+{
+    const int perSlice = kTilesX * kTilesY;
+    std::vector<GLuint>& out = mSliceIndices[slice];
+    out.clear();
+
+    // Lights whose sphere reaches this slice's depth range at all
+    const Aabb& first = mClusterBounds[slice * perSlice];
+    std::vector<int> candidates;
+    for(size_t i = 0; i < mViewLights.size(); i++)
+    {
+        const ViewLight& light = mViewLights[i];
+        if (light.position.z - light.range <= first.max.z &&
+            light.position.z + light.range >= first.min.z)
+            candidates.push_back((int)i);
+    }
+
+    for(int c = 0; c < perSlice; c++)
+    {
+        int cluster = slice * perSlice + c;
+        const Aabb& box = mClusterBounds[cluster];
+        GLuint count = 0;
+
+        for(size_t k = 0; k < candidates.size(); k++)
+        {
+            const ViewLight& light = mViewLights[candidates[k]];
+            glm::vec3 closest = glm::clamp(light.position, box.min, box.max);
+            glm::vec3 d = light.position - closest;
+            if (glm::dot(d, d) <= light.range * light.range)
+            {
+                out.push_back((GLuint)candidates[k]);
+                count++;
+            }
+        }
+        mClusterCounts[cluster] = count;
+    }
+}
+
+void ClusteredLighting::cullSlices()
+{
+    int slice;
+    while ((slice = mNextSlice.fetch_add(1)) < kSlices)
+        cullSlice(slice);
+}
+
+void ClusteredLighting::workerLoop()
+{
+    unsigned int seen = 0;
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(;;)
+    {
+        mWake.wait(lock, [&]{ return mQuit || mJob != seen; });
+        if (mQuit)
+            return;
+        seen = mJob;
+
+        lock.unlock();
+        cullSlices();
+        lock.lock();
+
+        if (--mBusy == 0)
+            mDone.notify_one();
+    }
+}
+
+void ClusteredLighting::update(const std::vector<util::Light>& lights,
+                               const glm::mat4& view, const glm::mat4& projection,
+                               int viewportX, int viewportY, int viewportWidth, int viewportHeight)
+{
+    if (projection != mClusterProjection)
+        buildClusterBounds(projection);
+
+    mOrigin   = glm::vec2((float)viewportX, (float)viewportY);
+    mTileSize = glm::vec2((float)viewportWidth / kTilesX, (float)viewportHeight / kTilesY);
+
+    // Move the lights to view space; the first directional one is the sun
+    bool haveSun = false;
+    mSunAmbient = mSunDiffuse = mSunSpecular = glm::vec3(0.f);
+    mViewLights.clear();
+    mLightTexels.clear();
+    for(size_t i = 0; i < lights.size(); i++)
+    {
+        const util::Light& light = lights[i];
+        glm::vec4 position = light.getPosition();
+        if (position.w == 0.f)
+        {
+            if (!haveSun)
+            {
+                mSunDirection = glm::normalize(glm::vec3(view * position));
+                mSunAmbient   = light.getAmbient();
+                mSunDiffuse   = light.getDiffuse();
+                mSunSpecular  = light.getSpecular();
+                haveSun = true;
+            }
+            continue;
+        }
+        if ((int)mViewLights.size() == kMaxLights)
+            continue;
+
+        ViewLight v;
+        v.position = glm::vec3(view * position);
+        v.range    = light.getRange() > 0.f ? light.getRange() : mFar;
+        mViewLights.push_back(v);
+
+        float cone = kPointLightCone;
+        glm::vec3 spotDir(0.f);
+        if (light.getSpotCutoff() > 0.f && light.getSpotCutoff() < 180.f)
+        {
+            cone = std::cos(glm::radians(light.getSpotCutoff()));
+            spotDir = glm::normalize(glm::vec3(view * light.getSpotDirection()));
+        }
+        mLightTexels.push_back(glm::vec4(v.position, v.range));
+        mLightTexels.push_back(glm::vec4(light.getDiffuse(), cone));
+        mLightTexels.push_back(glm::vec4(spotDir, 0.f));
+        mLightTexels.push_back(glm::vec4(light.getSpecular(), 0.f));
+    }
+
+    // Cull: every worker and this thread take slices until none are left
+    double start = nowSeconds();
+    mNextSlice = 0;
+    if (mWorkers.empty())
+        cullSlices();
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBusy = (int)mWorkers.size();
+            mJob++;
+        }
+        mWake.notify_all();
+        cullSlices();
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [&]{ return mBusy == 0; });
+    }
+
+    // Stitch the slices together: clusters come out in order already
+    mIndices.clear();
+    for(int z = 0, cluster = 0; z < kSlices; z++)
+    {
+        size_t k = 0;
+        for(int c = 0; c < kTilesX * kTilesY; c++, cluster++)
+        {
+            GLuint count = mClusterCounts[cluster];
+            GLuint room  = (GLuint)std::max<long>(0, (long)mMaxIndices - (long)mIndices.size());
+            GLuint kept  = std::min(count, room);
+
+            mClusterRanges[2 * cluster]     = (GLuint)mIndices.size();
+            mClusterRanges[2 * cluster + 1] = kept;
+            mIndices.insert(mIndices.end(), mSliceIndices[z].begin() + k, mSliceIndices[z].begin() + k + kept);
+            k += count;
+        }
+    }
+
+    double ms = (nowSeconds() - start) * 1000.0;
+    mCullMs = mCullMs < 0.0 ? ms : mCullMs + (ms - mCullMs) * kAverageWeight;
+
+    // Upload; glBufferData hands the old storage back to the driver, so
+    // this does not wait for draws still reading the previous viewport's
+    if (mLightTexels.empty())
+        mLightTexels.push_back(glm::vec4(0.f));
+    if (mIndices.empty())
+        mIndices.push_back(0);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[0]);
+    RenderStats::bufferData(GL_TEXTURE_BUFFER, mLightTexels.size() * sizeof(glm::vec4), mLightTexels.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[1]);
+    RenderStats::bufferData(GL_TEXTURE_BUFFER, mClusterRanges.size() * sizeof(GLuint), mClusterRanges.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[2]);
+    RenderStats::bufferData(GL_TEXTURE_BUFFER, mIndices.size() * sizeof(GLuint), mIndices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+const ClusteredLighting::ProgramLocations& ClusteredLighting::locationsFor(GLuint program)
+{
+    std::map<GLuint,ProgramLocations>::iterator it = mLocations.find(program);
+    if (it != mLocations.end())
+        return it->second;
+
+    ProgramLocations& loc = mLocations[program];
+    loc.lightData    = glGetUniformLocation(program, "lightData");
+    loc.clusterGrid  = glGetUniformLocation(program, "clusterGrid");
+    loc.lightIndices = glGetUniformLocation(program, "lightIndices");
+    loc.dims         = glGetUniformLocation(program, "clusterDims");
+    loc.origin       = glGetUniformLocation(program, "clusterOrigin");
+    loc.tileSize     = glGetUniformLocation(program, "clusterTileSize");
+    loc.scale        = glGetUniformLocation(program, "clusterScale");
+    loc.bias         = glGetUniformLocation(program, "clusterBias");
+    loc.sunDirection = glGetUniformLocation(program, "sunDirection");
+    loc.sunAmbient   = glGetUniformLocation(program, "sunAmbient");
+    loc.sunDiffuse   = glGetUniformLocation(program, "sunDiffuse");
+    loc.sunSpecular  = glGetUniformLocation(program, "sunSpecular");
+    return loc;
+}
+
+void ClusteredLighting::bind(GLuint program)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + kFirstTextureUnit + i);
+        RenderStats::bindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    // slice = log(depth) * scale + bias, the inverse of the slice spacing
+    float scale = kSlices / std::log(mFar / mNear);
+    float bias  = -kSlices * std::log(mNear) / std::log(mFar / mNear);
+
+    const ProgramLocations& loc = locationsFor(program);
+    RenderStats::useProgram(program);
+    RenderStats::uniform(loc.lightData, kFirstTextureUnit);
+    RenderStats::uniform(loc.clusterGrid, kFirstTextureUnit + 1);
+    RenderStats::uniform(loc.lightIndices, kFirstTextureUnit + 2);
+    RenderStats::uniform(loc.dims, glm::ivec3(kTilesX, kTilesY, kSlices));
+    RenderStats::uniform(loc.origin, mOrigin);
+    RenderStats::uniform(loc.tileSize, mTileSize);
+    RenderStats::uniform(loc.scale, scale);
+    RenderStats::uniform(loc.bias, bias);
+    RenderStats::uniform(loc.sunDirection, mSunDirection);
+    RenderStats::uniform(loc.sunAmbient, mSunAmbient);
+    RenderStats::uniform(loc.sunDiffuse, mSunDiffuse);
+    RenderStats::uniform(loc.sunSpecular, mSunSpecular);
+}
+
+void ClusteredLighting::cleanup()
+{
+    if (!mWorkers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQuit = true;
+        }
+        mWake.notify_all();
+        for(size_t i = 0; i < mWorkers.size(); i++)
+            mWorkers[i].join();
+        mWorkers.clear();
+    }
+
+    if (mTextures[0] != 0)
+    {
+        glDeleteTextures(3, mTextures);
+        glDeleteBuffers(3, mBuffers);
+        for(int i = 0; i < 3; i++)
+        {
+            mTextures[i] = 0;
+            mBuffers[i] = 0;
+        }
+    }
+    mLocations.clear();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Light.h"
+
+/**
+ * ClusteredLighting bins point and spot lights into view-space froxels
+ * (kTilesX x kTilesY screen tiles, kSlices depth slices spaced
+ * exponentially between the near and far planes) so the fragment shader
+ * only loops over the lights that can reach its cluster.
+ *
+ * Culling a frame's lights is split by depth slice across worker threads.
+ * The result goes to the GPU in three texture buffers:
+ *   lightData    RGBA32F, 4 texels per light:
+ *                view position + range, diffuse + cos(spot cutoff) (or -2
+ *                for a point light), spot direction, specular
+ *   clusterGrid  RG32UI, per cluster: first index, light count
+ *   lightIndices R32UI, light numbers, cluster after cluster
+ *
+ * The first directional light (position.w == 0) is not clustered; it is
+ * passed as the sun* uniforms and lights everything.
+ *
+ * Per viewport: update(...), then bind(program) for each lit program.
+ */
+class ClusteredLighting
+{
+public:
+    static const int kTilesX   = 16;
+    static const int kTilesY   = 9;
+    static const int kSlices   = 24;
+    static const int kClusters = kTilesX * kTilesY * kSlices;
+    static const int kMaxLights = 4096;
+
+    ClusteredLighting();
+    ~ClusteredLighting();
+
+    // Create the texture buffers and start workerThreads threads (0 culls
+    // on the calling thread only). near/far bound the depth slices.
+    void init(int workerThreads, float nearPlane, float farPlane);
+
+    // Cull lights for one viewport (pixels) and upload the result
+    void update(const std::vector<util::Light>& lights,
+                const glm::mat4& view, const glm::mat4& projection,
+                int viewportX, int viewportY, int viewportWidth, int viewportHeight);
+
+    // Bind the texture buffers and set the cluster and sun uniforms
+    void bind(GLuint program);
+
+    // Drop uniform locations looked up per program (after a relink)
+    void forgetPrograms() { mLocations.clear(); }
+
+    void cleanup();
+
+    // Last update: CPU time spent culling (averaged), and what it produced
+    double getCullMs() const      { return mCullMs; }
+    int    getLightCount() const  { return (int)mViewLights.size(); }
+    int    getIndexCount() const  { return (int)mIndices.size(); }
+    int    getThreadCount() const { return (int)mWorkers.size() + 1; }
+
+private:
+    // A light moved to view space, ready for culling and upload
+    struct ViewLight
+    {
+        glm::vec3 position;
+        float     range;
+    };
+
+    struct Aabb
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Uniform locations looked up once per program
+    struct ProgramLocations
+    {
+        GLint lightData, clusterGrid, lightIndices;
+        GLint dims, origin, tileSize, scale, bias;
+        GLint sunDirection, sunAmbient, sunDiffuse, sunSpecular;
+    };
+
+    void buildClusterBounds(const glm::mat4& projection);
+    void cullSlices();
+    void cullSlice(int slice);
+    void workerLoop();
+    const ProgramLocations& locationsFor(GLuint program);
+
+private:
+    float mNear;
+    float mFar;
+
+    // Froxel bounds, rebuilt when the projection changes
+    glm::mat4         mClusterProjection;
+    std::vector<Aabb> mClusterBounds;
+
+    // This update's input and output
+    std::vector<ViewLight>     mViewLights;
+    std::vector<glm::vec4>     mLightTexels;
+    std::vector<GLuint>        mSliceIndices[kSlices];  // per slice, cluster after cluster
+    std::vector<GLuint>        mClusterCounts;          // per cluster
+    std::vector<GLuint>        mClusterRanges;          // per cluster: first, count
+    std::vector<GLuint>        mIndices;
+    GLint                      mMaxIndices;
+    glm::vec2                  mOrigin;
+    glm::vec2                  mTileSize;
+
+    // First directional light, in view space
+    glm::vec3 mSunDirection;
+    glm::vec3 mSunAmbient;
+    glm::vec3 mSunDiffuse;
+    glm::vec3 mSunSpecular;
+
+    // Texture buffers: light data, cluster grid, light indices
+    GLuint mBuffers[3];
+    GLuint mTextures[3];
+    std::map<GLuint,ProgramLocations> mLocations;
+
+    // Workers take slices from mNextSlice until none are left
+    std::vector<std::thread> mWorkers;
+    std::mutex               mMutex;
+    std::condition_variable  mWake;
+    std::condition_variable  mDone;
+    std::atomic<int>         mNextSlice;
+    unsigned int             mJob;
+    int                      mBusy;
+    bool                     mQuit;
+
+    double mCullMs;
+};
@@ -0,0 +1,160 @@
+#include "DeferredRenderer.h"
+#include "RenderStats.h"
+#include <iostream>
+
+// G-buffer textures are bound from this unit up (ClusteredLighting uses 1..3)
+static const int kFirstTextureUnit = 4;
+
+DeferredRenderer::DeferredRenderer()
+    : mWidth(0)
+    , mHeight(0)
+    , mFBO(0)
+    , mAlbedo(0)
+    , mNormal(0)
+    , mAmbient(0)
+    , mDepth(0)
+    , mEmptyVAO(0)
+    , mTargetFBO(0)
+{
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+    cleanup();
+}
+
+bool DeferredRenderer::init(int width, int height)
+{
+    mWidth  = width;
+    mHeight = height;
+    glGenVertexArrays(1, &mEmptyVAO);
+    createTargets();
+    return mFBO != 0;
+}
+
+void DeferredRenderer::resize(int width, int height)
+{
+    if (mFBO == 0 || (width == mWidth && height == mHeight) || width <= 0 || height <= 0)
+        return;
+
+    mWidth  = width;
+    mHeight = height;
+    deleteTargets();
+    createTargets();
+}
+
+static GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+{
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return tex;
+}
+
+void DeferredRenderer::createTargets()
+{
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+    mAlbedo  = createTarget(GL_RGBA8,   GL_RGBA, GL_UNSIGNED_BYTE, mWidth, mHeight);
+    mNormal  = createTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT,         mWidth, mHeight);
+    mAmbient = createTarget(GL_RGBA8,   GL_RGBA, GL_UNSIGNED_BYTE, mWidth, mHeight);
+    mDepth   = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, mWidth, mHeight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &mFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAlbedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mNormal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, mAmbient, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth, 0);
+
+    const GLenum buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, buffers);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "G-buffer incomplete (0x" << std::hex << status << std::dec << ")\n";
+        deleteTargets();
+    }
+}
+
+void DeferredRenderer::deleteTargets()
+{
+    if (mFBO != 0)
+        glDeleteFramebuffers(1, &mFBO);
+    GLuint textures[4] = { mAlbedo, mNormal, mAmbient, mDepth };
+    glDeleteTextures(4, textures);
+    mFBO = mAlbedo = mNormal = mAmbient = mDepth = 0;
+}
+
+void DeferredRenderer::beginFrame()
+{
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &mTargetFBO);
+
+    // Depth 1 marks pixels nothing was drawn to; lighting skips them
+    RenderStats::bindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    glViewport(0, 0, mWidth, mHeight);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::bindGeometry()
+{
+    RenderStats::bindFramebuffer(GL_FRAMEBUFFER, mFBO);
+}
+
+void DeferredRenderer::lightViewport(GLuint lightingProg, const glm::mat4& projection,
+                                     int x, int y, int width, int height)
+{
+    RenderStats::bindFramebuffer(GL_FRAMEBUFFER, mTargetFBO);
+    glViewport(x, y, width, height);
+
+    GLuint textures[4] = { mAlbedo, mNormal, mAmbient, mDepth };
+    for(int i = 0; i < 4; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + kFirstTextureUnit + i);
+        RenderStats::bindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    RenderStats::useProgram(lightingProg);
+    RenderStats::uniform(glGetUniformLocation(lightingProg, "gAlbedo"), kFirstTextureUnit);
+    RenderStats::uniform(glGetUniformLocation(lightingProg, "gNormal"), kFirstTextureUnit + 1);
+    RenderStats::uniform(glGetUniformLocation(lightingProg, "gAmbient"), kFirstTextureUnit + 2);
+    RenderStats::uniform(glGetUniformLocation(lightingProg, "gDepth"), kFirstTextureUnit + 3);
+    RenderStats::uniform(glGetUniformLocation(lightingProg, "inverseProjection"), inverseProjection);
+    RenderStats::uniform(glGetUniformLocation(lightingProg, "viewportRect"),
+                         glm::vec4((float)x, (float)y, (float)width, (float)height));
+
+    // One triangle covering the viewport; it writes the G-buffer depth, so
+    // every fragment must pass
+    glDepthFunc(GL_ALWAYS);
+    RenderStats::bindVertexArray(mEmptyVAO);
+    RenderStats::drawArrays(GL_TRIANGLES, 0, 3);
+    RenderStats::bindVertexArray(0);
+    glDepthFunc(GL_LESS);
+}
+
+void DeferredRenderer::endFrame()
+{
+    RenderStats::bindFramebuffer(GL_FRAMEBUFFER, mTargetFBO);
+}
+
+void DeferredRenderer::cleanup()
+{
+    deleteTargets();
+    if (mEmptyVAO != 0)
+    {
+        glDeleteVertexArrays(1, &mEmptyVAO);
+        mEmptyVAO = 0;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/**
+ * DeferredRenderer is the G-buffer alternative to lighting every fragment
+ * as it is drawn. The geometry pass writes, per pixel:
+ *   albedo   RGBA8:   diffuse color, specular intensity
+ *   normal   RGBA16F: view-space normal, shininess
+ *   ambient  RGBA8:   ambient color
+ *   depth    DEPTH24
+ * and the lighting pass then shades each covered pixel once, reading the
+ * lights of its cluster from ClusteredLighting. Lighting cost follows the
+ * lit pixels, not drawn fragments times lights.
+ *
+ * Per frame:
+ *   beginFrame()                    clear the G-buffer, remember the target
+ *   bindGeometry(), draw            for each viewport
+ *   lightViewport(...)              for each viewport, after update/bind
+ *                                   on ClusteredLighting
+ *   endFrame()                      back to the target framebuffer
+ *
+ * The lighting pass writes the G-buffer depth into the target, so anything
+ * drawn forward afterwards is still depth tested against the drones.
+ */
+class DeferredRenderer
+{
+public:
+    DeferredRenderer();
+    ~DeferredRenderer();
+
+    // Create the G-buffer; false if the driver cannot render to it
+    bool init(int width, int height);
+
+    // Match the G-buffer to a new framebuffer size
+    void resize(int width, int height);
+
+    void beginFrame();
+    void bindGeometry();
+
+    // Shade one viewport (pixels) of the target with lightingProg, which
+    // reconstructs view-space positions with inverse(projection)
+    void lightViewport(GLuint lightingProg, const glm::mat4& projection,
+                       int x, int y, int width, int height);
+
+    void endFrame();
+    void cleanup();
+
+    bool isReady() const { return mFBO != 0; }
+
+private:
+    void createTargets();
+    void deleteTargets();
+
+private:
+    int    mWidth;
+    int    mHeight;
+    GLuint mFBO;
+    GLuint mAlbedo;
+    GLuint mNormal;
+    GLuint mAmbient;
+    GLuint mDepth;
+    GLuint mEmptyVAO;      // the fullscreen triangle comes from gl_VertexID
+    GLint  mTargetFBO;     // framebuffer bound when the frame began
+};
@@ -83,9 +83,9 @@ void DroneController::moveForward(float dist, glm::vec3 forward)
     mModel.setPosition(pos);
 }
 
-void DroneController::moveBackward(float dist)
+void DroneController::moveBackward(float dist, glm::vec3 forward)
 {
-    moveForward(-dist);
+    moveForward(-dist, forward);
 }
 
 void DroneController::reset()
@@ -1,178 +1,537 @@
 #include "DroneView.h"
+#include "VertexCacheOptimizer.h"
+#include "Frustum.h"
+#include "RenderStats.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <cstddef>
 #include <cmath>
 #include <iostream>
 
+// Bounding radius of a drone in model units (arm + blade reach)
+static const float kDroneRadius = 1.8f;
+
+// Projected diameter (pixels) needed to be drawn at each LOD, and the
+// fraction either side of a threshold a drone must cross before it switches
+static const float kFullDetailPixels = 96.f;
+static const float kHullPixels       = 12.f;
+static const float kLodHysteresis    = 0.2f;
+
+// Upper bounds per frame, whatever the fleet size. Drones over budget are
+// demoted (smallest on screen first) to the next cheaper LOD.
+static const int kMaxFullDetail = 16;
+static const int kMaxHull       = 256;
+
+// Parts of a full-detail drone: the nose (sphere) first, then 29 cubes
+static const int kPartsPerDrone = 30;
+
+// Size of an impostor point in pixels
+static const float kImpostorPointSize = 3.f;
+
+// Navigation lights: offset from the drone origin (port side; starboard
+// mirrors x) and how far they reach
+static const glm::vec3 kNavLightOffset(-1.35f, 0.15f, 0.5f);
+static const float     kNavLightRange = 2.5f;
+
+// Shader attribute locations shared by every drone mesh
+static const int kPositionLocation = 0;
+static const int kNormalLocation   = 1;
+static const int kColorLocation    = 2;
+static const int kInstanceLocation = 3; // mat4: locations 3..6
+
+// Full-detail nose resolution, and the coarse one baked into the hull
+static const int kSphereStacks     = 12;
+static const int kSphereSlices     = 12;
+static const int kHullSphereStacks = 4;
+static const int kHullSphereSlices = 6;
+
+typedef util::PolygonMesh<VertexAttrib> DroneMesh;
+
+// Unit cube: 24 vertices (4 per face, so each face has its own normal)
+// and 12 indexed triangles
+static DroneMesh buildCubeMesh()
+{
+    // normal, then two edge directions with u x v = normal
+    const glm::vec3 faces[6][3] = {
+        { glm::vec3( 0, 0, 1), glm::vec3( 1, 0, 0), glm::vec3(0, 1, 0) },
+        { glm::vec3( 0, 0,-1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0) },
+        { glm::vec3( 1, 0, 0), glm::vec3( 0, 0,-1), glm::vec3(0, 1, 0) },
+        { glm::vec3(-1, 0, 0), glm::vec3( 0, 0, 1), glm::vec3(0, 1, 0) },
+        { glm::vec3( 0, 1, 0), glm::vec3( 1, 0, 0), glm::vec3(0, 0,-1) },
+        { glm::vec3( 0,-1, 0), glm::vec3( 1, 0, 0), glm::vec3(0, 0, 1) }
+    };
+    const float corners[4][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,1} };
+
+    std::vector<VertexAttrib> verts;
+    std::vector<unsigned int> indices;
+
+    for(int f = 0; f < 6; f++)
+    {
+        unsigned int base = (unsigned int)verts.size();
+        for(int c = 0; c < 4; c++)
+        {
+            glm::vec3 p = 0.5f * (faces[f][0] + corners[c][0]*faces[f][1] + corners[c][1]*faces[f][2]);
+
+            VertexAttrib v;
+            v.set<util::Position>(glm::vec4(p, 1.f));
+            v.set<util::Normal>(glm::vec4(faces[f][0], 0.f));
+            verts.push_back(v);
+        }
+        indices.insert(indices.end(), { base, base+1, base+2, base+2, base+3, base });
+    }
+
+    DroneMesh mesh;
+    mesh.setVertexData(std::move(verts));
+    mesh.setPrimitives(std::move(indices));
+    mesh.setPrimitiveType(GL_TRIANGLES);
+    mesh.setPrimitiveSize(3);
+    return mesh;
+}
+
+// Unit sphere as an indexed grid of (stacks+1) x (slices+1) vertices.
+// The triangles that would collapse onto the poles are left out.
+static DroneMesh buildSphereMesh(int stacks, int slices)
+{
+    const float PI = 3.14159265359f;
+
+    std::vector<VertexAttrib> verts;
+    std::vector<unsigned int> indices;
+
+    for(int i = 0; i <= stacks; i++)
+    {
+        float phi = PI * (-0.5f + (float)i / stacks);
+        for(int j = 0; j <= slices; j++)
+        {
+            float theta = 2.0f * PI * ((float)j / slices);
+            glm::vec3 p(std::cos(theta) * std::cos(phi), std::sin(phi), std::sin(theta) * std::cos(phi));
+
+            VertexAttrib v;
+            v.set<util::Position>(glm::vec4(p, 1.f));
+            v.set<util::Normal>(glm::vec4(p, 0.f));
+            verts.push_back(v);
+        }
+    }
+
+    for(int i = 0; i < stacks; i++)
+    {
+        for(int j = 0; j < slices; j++)
+        {
+            unsigned int a = i * (slices+1) + j;
+            unsigned int b = a + (slices+1);
+            if (i != stacks-1) indices.insert(indices.end(), { a, b, b+1 });
+            if (i != 0)        indices.insert(indices.end(), { b+1, a+1, a });
+        }
+    }
+
+    DroneMesh mesh;
+    mesh.setVertexData(std::move(verts));
+    mesh.setPrimitives(std::move(indices));
+    mesh.setPrimitiveType(GL_TRIANGLES);
+    mesh.setPrimitiveSize(3);
+    return mesh;
+}
+
 DroneView::DroneView()
-    : mCubeVAO(0)
+    : mCube("cube")
+    , mSphere("sphere")
     , mDroneGeometryInitialized(false)
-    , mSphereVAO(0)
-    , mSphereVBO(0)
-    , mSphereNumVerts(0)
-{}
+    , mHullVAO(0)
+    , mHullVBO(0)
+    , mHullEBO(0)
+    , mHullNumIndices(0)
+    , mImpostorVAO(0)
+    , mCulledCount(0)
+    , mOccludedCount(0)
+    , mDrawCount(0)
+    , mTriangleCount(0)
+{
+    for(int i = 0; i < LOD_COUNT; i++)
+        mLodCounts[i] = 0;
+}
 
 DroneView::~DroneView()
 {
     cleanupDrone();
 }
 
-void DroneView::initSphereGeometry()
+void DroneView::optimizeMesh(const char* name, DroneMesh& mesh, int unindexedVerts)
 {
-    if (mSphereVAO != 0) return; // already inited
+    util::ArrayView<unsigned int> prims = mesh.getPrimitives();
+    std::vector<unsigned int> before(prims.begin(), prims.end());
+    std::vector<unsigned int> after  = util::VertexCacheOptimizer::optimize(before, mesh.getVertexCount());
+
+    MeshStats stats;
+    stats.name           = name;
+    stats.triangles      = (int)after.size() / 3;
+    stats.vertices       = mesh.getVertexCount();
+    stats.unindexedVerts = unindexedVerts;
+    stats.missesBefore   = (int)util::VertexCacheOptimizer::countCacheMisses(before, mesh.getVertexCount());
+    stats.missesAfter    = (int)util::VertexCacheOptimizer::countCacheMisses(after,  mesh.getVertexCount());
+    mMeshStats.push_back(stats);
+
+    mesh.setPrimitives(std::move(after));
+}
 
-    const int   stacks = 12;
-    const int   slices = 12;
-    const float PI     = 3.14159265359f;
+void DroneView::printMeshStats() const
+{
+    for(size_t i = 0; i < mMeshStats.size(); i++)
+    {
+        const MeshStats& s = mMeshStats[i];
+        float tris = (float)std::max(s.triangles, 1);
+        std::cout << s.name << ": " << s.triangles << " triangles, " << s.vertices << " vertices\n"
+                  << "  unindexed:         " << s.unindexedVerts << " vertex shader invocations\n"
+                  << "  indexed:           ACMR " << s.missesBefore / tris << " (" << s.missesBefore << " invocations)\n"
+                  << "  cache-optimized:   ACMR " << s.missesAfter / tris  << " (" << s.missesAfter  << " invocations, "
+                  << s.unindexedVerts - s.missesAfter << " saved)" << std::endl;
+    }
+}
 
-    std::vector<float> verts;
-    verts.reserve(stacks * slices * 6);
+// Floats per hull vertex: position, color, normal
+static const int kHullVertexFloats = 9;
 
-    for(int i = 0; i < stacks; i++)
+// Append a transformed, colored copy of mesh (pos + color + normal per vertex)
+static void appendMesh(std::vector<float>& verts, std::vector<unsigned int>& indices,
+                       const DroneMesh& mesh, const glm::mat4& xform, const glm::vec3& color)
+{
+    unsigned int base = (unsigned int)(verts.size() / kHullVertexFloats);
+    glm::mat3 normalXform = glm::transpose(glm::inverse(glm::mat3(xform)));
+
+    util::ArrayView<VertexAttrib> src = mesh.getVertexAttributes();
+    for(size_t i = 0; i < src.size(); i++)
     {
-        float phi0 = PI * (-0.5f + (float)i / stacks);
-        float phi1 = PI * (-0.5f + (float)(i+1) / stacks);
+        glm::vec4 q = xform * glm::vec4(glm::vec3(src[i].get<util::Position>()), 1.f);
+        glm::vec3 m = glm::normalize(normalXform * glm::vec3(src[i].get<util::Normal>()));
+        verts.insert(verts.end(), { q.x, q.y, q.z, color.r, color.g, color.b, m.x, m.y, m.z });
+    }
 
-        float y0 = std::sin(phi0);
-        float r0 = std::cos(phi0);
-        float y1 = std::sin(phi1);
-        float r1 = std::cos(phi1);
+    util::ArrayView<unsigned int> prims = mesh.getPrimitives();
+    for(size_t i = 0; i < prims.size(); i++)
+        indices.push_back(base + prims[i]);
+}
 
-        for(int j = 0; j <= slices; j++)
-        {
-            float theta = 2.0f * PI * ((float)j / slices);
-            float x = std::cos(theta);
-            float z = std::sin(theta);
-
-            // (x*r0, y0, z*r0)
-            verts.push_back(x * r0);
-            verts.push_back(y0);
-            verts.push_back(z * r0);
-
-            // (x*r1, y1, z*r1)
-            verts.push_back(x * r1);
-            verts.push_back(y1);
-            verts.push_back(z * r1);
-        }
+void DroneView::initHullGeometry(const DroneMesh& cube)
+{
+    if (mHullVAO != 0) return;
+
+    // Same layout as buildDroneParts, but baked into one mesh: each propeller is
+    // a single flat plate and the nose is a coarse sphere.
+    const glm::vec3 pink(1.f, 0.4f, 0.7f), yellow(1.f, 1.f, 0.f);
+    const glm::vec3 white(1.f, 1.f, 1.f),  red(1.f, 0.f, 0.f);
+    const float armX[4] = { -0.9f, +0.9f, -0.9f, +0.9f };
+    const float armZ[4] = { +0.5f, +0.5f, -0.5f, -0.5f };
+    const float legX[4] = { -0.5f, +0.5f, -0.5f, +0.5f };
+    const float legZ[4] = { +0.3f, +0.3f, -0.3f, -0.3f };
+    const glm::mat4 I(1.f);
+
+    std::vector<float> verts;
+    std::vector<unsigned int> indices;
+
+    appendMesh(verts, indices, cube, glm::scale(I, glm::vec3(1.6f, 0.5f, 1.0f)), pink);
+    appendMesh(verts, indices, buildSphereMesh(kHullSphereStacks, kHullSphereSlices),
+               glm::scale(glm::translate(I, glm::vec3(0.f, 0.f, 0.7f)), glm::vec3(0.2f)), yellow);
+
+    for(int i = 0; i < 4; i++)
+    {
+        float propX = armX[i] + (armX[i] < 0 ? -0.45f : +0.45f);
+
+        appendMesh(verts, indices, cube, glm::scale(glm::translate(I, glm::vec3(armX[i], 0.f, armZ[i])),
+                                                    glm::vec3(0.7f, 0.1f, 0.1f)), white);
+        appendMesh(verts, indices, cube, glm::scale(glm::translate(I, glm::vec3(propX, 0.1f, armZ[i])),
+                                                    glm::vec3(0.75f, 0.02f, 0.75f)), red);
+        appendMesh(verts, indices, cube, glm::scale(glm::translate(I, glm::vec3(legX[i], -0.3f, legZ[i])),
+                                                    glm::vec3(0.1f, 0.4f, 0.1f)), white);
     }
 
-    mSphereNumVerts = (int)verts.size() / 3;
+    indices = util::VertexCacheOptimizer::optimize(indices, (unsigned int)(verts.size() / kHullVertexFloats));
+    mHullNumIndices = (int)indices.size();
 
-    // Create VAO/VBO
-    glGenVertexArrays(1, &mSphereVAO);
-    glGenBuffers(1, &mSphereVBO);
+    glGenVertexArrays(1, &mHullVAO);
+    glGenBuffers(1, &mHullVBO);
+    glGenBuffers(1, &mHullEBO);
 
-    glBindVertexArray(mSphereVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, mSphereVBO);
+    glBindVertexArray(mHullVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mHullVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float)*verts.size(), verts.data(), GL_STATIC_DRAW);
-
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mHullEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
+
+    // Position + color + normal attributes
+    const GLsizei stride = kHullVertexFloats * sizeof(float);
+    glVertexAttribPointer(kPositionLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(kPositionLocation);
+    glVertexAttribPointer(kColorLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3*sizeof(float)));
+    glEnableVertexAttribArray(kColorLocation);
+    glVertexAttribPointer(kNormalLocation, 3, GL_FLOAT, GL_FALSE, stride, (void*)(6*sizeof(float)));
+    glEnableVertexAttribArray(kNormalLocation);
+
+    // Per-instance transform, one column per location. The pointers into
+    // the streaming buffer are set every frame by submitHulls.
+    for(int c = 0; c < 4; c++)
+    {
+        glEnableVertexAttribArray(kInstanceLocation + c);
+        glVertexAttribDivisor(kInstanceLocation + c, 1);
+    }
 
     glBindVertexArray(0);
 }
 
-void DroneView::initDroneGeometry()
+void DroneView::initImpostorGeometry()
 {
-    if (mDroneGeometryInitialized) return;
+    if (mImpostorVAO != 0) return;
 
-    // 1) Initialize the cube VAO
-    float vertices[] = {
-        // front
-        -0.5f, -0.5f,  0.5f,
-         0.5f, -0.5f,  0.5f,
-         0.5f,  0.5f,  0.5f,
-         0.5f,  0.5f,  0.5f,
-        -0.5f,  0.5f,  0.5f,
-        -0.5f, -0.5f,  0.5f,
-
-        // back
-        -0.5f, -0.5f, -0.5f,
-        -0.5f,  0.5f, -0.5f,
-         0.5f,  0.5f, -0.5f,
-         0.5f,  0.5f, -0.5f,
-         0.5f, -0.5f, -0.5f,
-        -0.5f, -0.5f, -0.5f,
-
-        // left
-        -0.5f,  0.5f,  0.5f,
-        -0.5f,  0.5f, -0.5f,
-        -0.5f, -0.5f, -0.5f,
-        -0.5f, -0.5f, -0.5f,
-        -0.5f, -0.5f,  0.5f,
-        -0.5f,  0.5f,  0.5f,
-
-        // right
-         0.5f,  0.5f,  0.5f,
-         0.5f, -0.5f,  0.5f,
-         0.5f, -0.5f, -0.5f,
-         0.5f, -0.5f, -0.5f,
-         0.5f,  0.5f, -0.5f,
-         0.5f,  0.5f,  0.5f,
-
-        // top
-        -0.5f,  0.5f, -0.5f,
-        -0.5f,  0.5f,  0.5f,
-         0.5f,  0.5f,  0.5f,
-         0.5f,  0.5f,  0.5f,
-         0.5f,  0.5f, -0.5f,
-        -0.5f,  0.5f, -0.5f,
-
-        // bottom
-        -0.5f, -0.5f, -0.5f,
-         0.5f, -0.5f, -0.5f,
-         0.5f, -0.5f,  0.5f,
-         0.5f, -0.5f,  0.5f,
-        -0.5f, -0.5f,  0.5f,
-        -0.5f, -0.5f, -0.5f
-    };
+    // Positions are streamed in every frame by submitImpostors
+    glGenVertexArrays(1, &mImpostorVAO);
 
-    GLuint VBO;
-    glGenVertexArrays(1, &mCubeVAO);
-    glGenBuffers(1, &VBO);
+    glBindVertexArray(mImpostorVAO);
+    glEnableVertexAttribArray(kPositionLocation);
 
-    glBindVertexArray(mCubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
 
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // GL_POINTS are only used for impostors
+    glPointSize(kImpostorPointSize);
+}
 
+void DroneView::initPartInstancing(const util::ObjectInstance& mesh)
+{
+    // Only the layout is fixed here; submitParts points the attributes at
+    // the frame's data in the streaming buffer.
+    glBindVertexArray(mesh.getVAO());
+    glEnableVertexAttribArray(kColorLocation);
+    glVertexAttribDivisor(kColorLocation, 1);
+    for(int c = 0; c < 4; c++)
+    {
+        glEnableVertexAttribArray(kInstanceLocation + c);
+        glVertexAttribDivisor(kInstanceLocation + c, 1);
+    }
     glBindVertexArray(0);
+}
+
+// Flat-colored material for a drone part
+static util::Material partMaterial(float r, float g, float b)
+{
+    util::Material m;
+    m.setAmbient(0.3f*r, 0.3f*g, 0.3f*b);
+    m.setDiffuse(r, g, b);
+    m.setSpecular(0.3f, 0.3f, 0.3f);
+    m.setShininess(16.f);
+    return m;
+}
 
-    // 2) Initialize the sphere for the circular nose
-    initSphereGeometry();
+void DroneView::initDroneGeometry(RenderQueue& queue, bool persistentMapping)
+{
+    if (mDroneGeometryInitialized) return;
+
+    // Instance data, rewritten every frame. Sized for one viewport's worth
+    // of full-detail parts and hulls plus a few thousand impostors; grows
+    // if needed.
+    mInstances.init(kMaxFullDetail * kPartsPerDrone * sizeof(PartInstance)
+                    + kMaxHull * sizeof(glm::mat4) + 4096 * sizeof(glm::vec3), persistentMapping);
+
+    // 0) Part materials; the hull's colors are per vertex
+    mMaterials[MAT_BODY]  = queue.registerMaterial(partMaterial(1.f, 0.4f, 0.7f));
+    mMaterials[MAT_NOSE]  = queue.registerMaterial(partMaterial(1.f, 1.f, 0.f));
+    mMaterials[MAT_FRAME] = queue.registerMaterial(partMaterial(1.f, 1.f, 1.f));
+    mMaterials[MAT_PROP]  = queue.registerMaterial(partMaterial(1.f, 0.f, 0.f));
+    mMaterials[MAT_VERTEX_COLOR] = queue.registerMaterial(partMaterial(1.f, 1.f, 1.f));
+
+    // Instanced parts carry their material's color per instance
+    for(int m = 0; m < MAT_COUNT; m++)
+        mPartColors[m] = glm::vec3(queue.getMaterial(mMaterials[m]).getDiffuse());
+
+    // Fixed attribute locations, matching the layout() qualifiers in the shader
+    util::ShaderLocationsVault locations;
+    locations.add("aPos",    kPositionLocation);
+    locations.add("aNormal", kNormalLocation);
+
+    std::map<std::string,std::string> attributes;
+    attributes["aPos"]    = "position";
+    attributes["aNormal"] = "normal";
+
+    // 1) Cube for the body, arms, legs and propellers (was 36 unindexed vertices)
+    DroneMesh cube = buildCubeMesh();
+    optimizeMesh("cube", cube, 36);
+    mCube.initPolygonMesh(locations, attributes, cube);
+
+    // 2) Sphere for the circular nose (was one triangle strip, 2 vertices per quad)
+    DroneMesh sphere = buildSphereMesh(kSphereStacks, kSphereSlices);
+    optimizeMesh("sphere", sphere, kSphereStacks * (kSphereSlices+1) * 2);
+    mSphere.initPolygonMesh(locations, attributes, std::move(sphere));
+
+    // Full-detail parts are drawn instanced: color and transform per instance
+    initPartInstancing(mCube);
+    initPartInstancing(mSphere);
+
+    // 3) Cheaper LODs for drones further away
+    initHullGeometry(cube);
+    initImpostorGeometry();
+
+    // Impostors have no color (location 2) or normal (location 1)
+    // attribute and read these constants instead: their material alone
+    // decides their color, and they are lit as if facing up.
+    glVertexAttrib3f(kColorLocation, 1.f, 1.f, 1.f);
+    glVertexAttrib3f(kNormalLocation, 0.f, 1.f, 0.f);
 
     mDroneGeometryInitialized = true;
 }
 
-void DroneView::drawCube(const glm::mat4& model, GLuint shaderProg)
+void DroneView::submitParts(const util::ObjectInstance& mesh, const std::vector<PartInstance>& parts,
+                            GLuint instancedProg, float depth, RenderQueue& queue)
 {
-    GLint modelLoc = glGetUniformLocation(shaderProg, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    if (parts.empty()) return;
+
+    GLintptr offset = 0;
+    void* dst = mInstances.allocate(sizeof(PartInstance) * parts.size(), offset);
+    if (!dst) return;
+    std::memcpy(dst, parts.data(), sizeof(PartInstance) * parts.size());
+
+    RenderStats::bindVertexArray(mesh.getVAO());
+    glBindBuffer(GL_ARRAY_BUFFER, mInstances.getBuffer());
+    for(int c = 0; c < 4; c++)
+        glVertexAttribPointer(kInstanceLocation + c, 4, GL_FLOAT, GL_FALSE, sizeof(PartInstance),
+                              (void*)(offset + offsetof(PartInstance, model) + c * sizeof(glm::vec4)));
+    glVertexAttribPointer(kColorLocation, 3, GL_FLOAT, GL_FALSE, sizeof(PartInstance),
+                          (void*)(offset + offsetof(PartInstance, color)));
+    RenderStats::bindVertexArray(0);
+
+    // Every instance of this mesh in one draw; color comes per instance
+    DrawItem item;
+    item.program       = instancedProg;
+    item.vao           = mesh.getVAO();
+    item.primitive     = mesh.getPrimitiveType();
+    item.indexed       = true;
+    item.count         = mesh.getPrimitiveCount();
+    item.instanceCount = (GLsizei)parts.size();
+    item.material      = mMaterials[MAT_VERTEX_COLOR];
+    queue.submit(item, depth);
+
+    mDrawCount++;
+    mTriangleCount += (int)parts.size() * item.count / 3;
+}
 
-    glBindVertexArray(mCubeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+void DroneView::beginFrame(const std::vector<DroneModel>& fleet, int viewportCount)
+{
+    // Worst case per viewport: full budgets, everyone else an impostor
+    GLsizeiptr perViewport = kMaxFullDetail * kPartsPerDrone * sizeof(PartInstance)
+                           + kMaxHull * sizeof(glm::mat4)
+                           + fleet.size() * sizeof(glm::vec3) + 64;
+    mInstances.beginFrame(perViewport * viewportCount);
+
+    // Shared by every viewport this frame
+    mDroneMatrices.resize(fleet.size());
+    for(size_t i = 0; i < fleet.size(); i++)
+        mDroneMatrices[i] = droneTransform(fleet[i]);
+
+    mPartsOffset.assign(fleet.size(), -1);
+    mFullParts.clear();
 }
 
-void DroneView::drawSphere(const glm::mat4& model, GLuint shaderProg)
+void DroneView::appendNavLights(std::vector<util::Light>& lights, size_t maxLights) const
 {
-    GLint modelLoc = glGetUniformLocation(shaderProg, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    const glm::vec3 colors[2] = { glm::vec3(1.f, 0.1f, 0.05f), glm::vec3(0.1f, 1.f, 0.2f) };
 
-    glBindVertexArray(mSphereVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, mSphereNumVerts);
-    glBindVertexArray(0);
+    for(size_t i = 0; i < mDroneMatrices.size() && lights.size() + 2 <= maxLights; i++)
+    {
+        for(int side = 0; side < 2; side++)
+        {
+            glm::vec3 offset = kNavLightOffset;
+            if (side == 1)
+                offset.x = -offset.x;
+
+            glm::vec3 pos = glm::vec3(mDroneMatrices[i] * glm::vec4(offset, 1.f));
+            util::Light light;
+            light.setPosition(pos.x, pos.y, pos.z);
+            light.setDiffuse(colors[side]);
+            light.setSpecular(colors[side]);
+            light.setRange(kNavLightRange);
+            lights.push_back(light);
+        }
+    }
+}
+
+const DroneView::PartInstance* DroneView::droneParts(const std::vector<DroneModel>& fleet, int index)
+{
+    // Built the first time any viewport wants this drone at full detail
+    if (mPartsOffset[index] < 0)
+    {
+        mPartsOffset[index] = (int)mFullParts.size();
+        mFullParts.resize(mFullParts.size() + kPartsPerDrone);
+        buildDroneParts(fleet[index], mDroneMatrices[index], &mFullParts[mPartsOffset[index]]);
+    }
+    return &mFullParts[mPartsOffset[index]];
+}
+
+void DroneView::endFrame()
+{
+    mInstances.endFrame();
+}
+
+void DroneView::submitHulls(const std::vector<glm::mat4>& transforms, GLuint instancedProg,
+                            float depth, RenderQueue& queue)
+{
+    if (transforms.empty()) return;
+
+    GLintptr offset = 0;
+    void* dst = mInstances.allocate(sizeof(glm::mat4) * transforms.size(), offset);
+    if (!dst) return;
+    std::memcpy(dst, transforms.data(), sizeof(glm::mat4) * transforms.size());
+
+    RenderStats::bindVertexArray(mHullVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstances.getBuffer());
+    for(int c = 0; c < 4; c++)
+        glVertexAttribPointer(kInstanceLocation + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (void*)(offset + c * sizeof(glm::vec4)));
+    RenderStats::bindVertexArray(0);
+
+    // One instanced draw for every hull; the transform is per instance
+    DrawItem item;
+    item.program       = instancedProg;
+    item.vao           = mHullVAO;
+    item.primitive     = GL_TRIANGLES;
+    item.indexed       = true;
+    item.count         = mHullNumIndices;
+    item.instanceCount = (GLsizei)transforms.size();
+    item.material      = mMaterials[MAT_VERTEX_COLOR];
+    queue.submit(item, depth);
+
+    mDrawCount++;
+    mTriangleCount += (int)transforms.size() * mHullNumIndices / 3;
+}
+
+void DroneView::submitImpostors(const std::vector<glm::vec3>& positions, GLuint shaderProg, RenderQueue& queue)
+{
+    if (positions.empty()) return;
+
+    GLintptr offset = 0;
+    void* dst = mInstances.allocate(sizeof(glm::vec3) * positions.size(), offset);
+    if (!dst) return;
+    std::memcpy(dst, positions.data(), sizeof(glm::vec3) * positions.size());
+
+    RenderStats::bindVertexArray(mImpostorVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstances.getBuffer());
+    glVertexAttribPointer(kPositionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+    RenderStats::bindVertexArray(0);
+
+    // Points are already in world space, and are the furthest things drawn
+    DrawItem item;
+    item.program   = shaderProg;
+    item.vao       = mImpostorVAO;
+    item.primitive = GL_POINTS;
+    item.count     = (GLsizei)positions.size();
+    item.material  = mMaterials[MAT_BODY];
+    queue.submit(item, FLT_MAX);
+
+    mDrawCount++;
 }
 
-void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
+glm::mat4 DroneView::droneTransform(const DroneModel& model)
 {
     // Convert angles to radians
-    float propRad  = glm::radians(model.getPropAngle());
     float rollRad  = glm::radians(model.getRollAngle());
     float yawRad   = glm::radians(model.getYaw());
     float pitchRad = glm::radians(model.getPitch());
@@ -187,25 +546,169 @@ void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
     // Overall scale + slight upward shift
     drone = glm::scale(drone, glm::vec3(1.0f));
     drone = glm::translate(drone, glm::vec3(0.0f, 0.2f, 0.0f));
+    return drone;
+}
 
-    glUseProgram(shaderProg);
-    GLint colorLoc = glGetUniformLocation(shaderProg, "objectColor");
+DroneLod DroneView::selectLod(DroneLod current, float screenSize)
+{
+    // Moving to a finer LOD needs the size to clear the threshold by the
+    // hysteresis margin; moving to a coarser one needs it to drop below
+    // by the same margin. In between, the drone keeps its current LOD.
+    const float up   = 1.f + kLodHysteresis;
+    const float down = 1.f - kLodHysteresis;
 
-    //------------------------------------------------
-    // (A) BODY (pink)
+    switch(current)
     {
-        glUniform3f(colorLoc, 1.f, 0.4f, 0.7f);
-        glm::mat4 body = glm::scale(drone, glm::vec3(1.6f, 0.5f, 1.0f));
-        drawCube(body, shaderProg);
+    case LOD_FULL:
+        if (screenSize < kHullPixels * down)       return LOD_IMPOSTOR;
+        if (screenSize < kFullDetailPixels * down) return LOD_HULL;
+        return LOD_FULL;
+    case LOD_HULL:
+        if (screenSize > kFullDetailPixels * up)   return LOD_FULL;
+        if (screenSize < kHullPixels * down)       return LOD_IMPOSTOR;
+        return LOD_HULL;
+    default:
+        if (screenSize > kFullDetailPixels * up)   return LOD_FULL;
+        if (screenSize > kHullPixels * up)         return LOD_HULL;
+        return LOD_IMPOSTOR;
+    }
+}
+
+void DroneView::submitFleet(const std::vector<DroneModel>& fleet,
+                            const glm::mat4& view, const glm::mat4& projection,
+                            int viewportHeight, int viewport,
+                            GLuint shaderProg, GLuint instancedProg, RenderQueue& queue,
+                            const OcclusionCuller* occlusion)
+{
+    mDrawCount = 0;
+    mTriangleCount = 0;
+    mCulledCount = 0;
+    mOccludedCount = 0;
+
+    std::vector<DroneLod>& droneLods = mDroneLods[viewport];
+    droneLods.resize(fleet.size(), LOD_FULL);
+
+    glm::vec4 frustum[6];
+    extractFrustum(projection * view, frustum);
+
+    // Projected diameter in pixels = pixelScale * diameter / depth
+    const float pixelScale = projection[1][1] * 0.5f * (float)viewportHeight;
+
+    std::vector<std::pair<float,int>> buckets[LOD_COUNT]; // (screen size, index)
+    std::vector<float> depths(fleet.size());
+
+    for(size_t i = 0; i < fleet.size(); i++)
+    {
+        // Outside this viewport's frustum: not drawn at any LOD
+        if (!sphereInFrustum(frustum, fleet[i].getPosition(), kDroneRadius))
+        {
+            mCulledCount++;
+            continue;
+        }
+
+        // Hidden behind the occluders: not drawn either, and keeps its LOD
+        if (occlusion && occlusion->isOccluded(fleet[i].getPosition(), kDroneRadius))
+        {
+            mOccludedCount++;
+            continue;
+        }
+
+        float depth = -(view * glm::vec4(fleet[i].getPosition(), 1.f)).z;
+        depths[i] = depth;
+
+        float size = pixelScale * 2.f * kDroneRadius / std::max(depth, kDroneRadius);
+
+        DroneLod lod = selectLod(droneLods[i], size);
+        buckets[lod].push_back(std::make_pair(size, (int)i));
+    }
+
+    // Enforce the per-LOD budgets, demoting the smallest drones first
+    const size_t budgets[LOD_IMPOSTOR] = { (size_t)kMaxFullDetail, (size_t)kMaxHull };
+    for(int lod = LOD_FULL; lod < LOD_IMPOSTOR; lod++)
+    {
+        std::vector<std::pair<float,int>>& b = buckets[lod];
+        if (b.size() <= budgets[lod]) continue;
+
+        std::nth_element(b.begin(), b.begin() + budgets[lod], b.end(),
+                         [](const std::pair<float,int>& x, const std::pair<float,int>& y)
+                         { return x.first > y.first; });
+        buckets[lod+1].insert(buckets[lod+1].end(), b.begin() + budgets[lod], b.end());
+        b.resize(budgets[lod]);
+    }
+
+    for(int lod = 0; lod < LOD_COUNT; lod++)
+    {
+        mLodCounts[lod] = (int)buckets[lod].size();
+        for(size_t k = 0; k < buckets[lod].size(); k++)
+            droneLods[buckets[lod][k].second] = (DroneLod)lod;
+    }
+
+    // (A) Full detail: every nose in one instanced draw, every cube part in
+    // another
+    std::vector<PartInstance> noses, cubes;
+    noses.reserve(buckets[LOD_FULL].size());
+    cubes.reserve(buckets[LOD_FULL].size() * (kPartsPerDrone - 1));
+    float nearestFull = FLT_MAX;
+    for(size_t k = 0; k < buckets[LOD_FULL].size(); k++)
+    {
+        int i = buckets[LOD_FULL][k].second;
+        const PartInstance* parts = droneParts(fleet, i);
+        noses.push_back(parts[0]);
+        cubes.insert(cubes.end(), parts + 1, parts + kPartsPerDrone);
+        nearestFull = std::min(nearestFull, depths[i]);
     }
+    submitParts(mSphere, noses, instancedProg, nearestFull, queue);
+    submitParts(mCube,   cubes, instancedProg, nearestFull, queue);
+
+    // (B) Merged hulls carry their own colors; one instanced draw for all
+    std::vector<glm::mat4> hulls;
+    hulls.reserve(buckets[LOD_HULL].size());
+    float nearestHull = FLT_MAX;
+    for(size_t k = 0; k < buckets[LOD_HULL].size(); k++)
+    {
+        int i = buckets[LOD_HULL][k].second;
+        hulls.push_back(mDroneMatrices[i]);
+        nearestHull = std::min(nearestHull, depths[i]);
+    }
+    submitHulls(hulls, instancedProg, nearestHull, queue);
+
+    // (C) Impostors: one point each, one draw for all of them
+    std::vector<glm::vec3> points;
+    points.reserve(buckets[LOD_IMPOSTOR].size());
+    for(size_t k = 0; k < buckets[LOD_IMPOSTOR].size(); k++)
+        points.push_back(fleet[buckets[LOD_IMPOSTOR][k].second].getPosition());
+
+    submitImpostors(points, shaderProg, queue);
+
+    // Instance data must be unmapped before the queue draws from it
+    mInstances.unmap();
+}
+
+void DroneView::buildDroneParts(const DroneModel& model, const glm::mat4& drone, PartInstance* parts) const
+{
+    float propRad = glm::radians(model.getPropAngle());
+    int   n = 0;
+
+    auto addPart = [&](const glm::mat4& part, int material)
+    {
+        parts[n].model = part;
+        parts[n].color = mPartColors[material];
+        n++;
+    };
 
     //------------------------------------------------
-    // (B) NOSE (yellow, sphere)
+    // (A) NOSE (yellow, sphere) - always parts[0]
     {
-        glUniform3f(colorLoc, 1.f, 1.f, 0.f);
         glm::mat4 nose = glm::translate(drone, glm::vec3(0.f, 0.f, 0.7f));
         nose = glm::scale(nose, glm::vec3(0.2f));
-        drawSphere(nose, shaderProg);
+        addPart(nose, MAT_NOSE);
+    }
+
+    //------------------------------------------------
+    // (B) BODY (pink)
+    {
+        glm::mat4 body = glm::scale(drone, glm::vec3(1.6f, 0.5f, 1.0f));
+        addPart(body, MAT_BODY);
     }
 
     //------------------------------------------------
@@ -214,10 +717,9 @@ void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
     {
         glm::mat4 arm = glm::translate(drone, glm::vec3(xOff, 0.f, zOff));
         arm = glm::scale(arm, glm::vec3(0.7f, 0.1f, 0.1f));
-        drawCube(arm, shaderProg);
+        addPart(arm, MAT_FRAME);
     };
 
-    glUniform3f(colorLoc, 1.f, 1.f, 1.f);
     drawArm(-0.9f, +0.5f); // front-left
     drawArm(+0.9f, +0.5f); // front-right
     drawArm(-0.9f, -0.5f); // back-left
@@ -233,7 +735,7 @@ void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
         glm::mat4 hub = glm::translate(drone, glm::vec3(propX, 0.1f, zOff));
         hub = glm::rotate(hub, propRad, glm::vec3(0,1,0));
         hub = glm::scale(hub, glm::vec3(0.1f));
-        drawCube(hub, shaderProg);
+        addPart(hub, MAT_PROP);
 
         // 4 blades
         for(int i = 0; i < 4; i++)
@@ -243,11 +745,10 @@ void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
             blade = glm::rotate(blade, glm::radians(90.f * i), glm::vec3(0,1,0));
             blade = glm::translate(blade, glm::vec3(0.f, 0.f, 0.2f));
             blade = glm::scale(blade, glm::vec3(0.05f, 0.02f, 0.35f));
-            drawCube(blade, shaderProg);
+            addPart(blade, MAT_PROP);
         }
     };
 
-    glUniform3f(colorLoc, 1.f, 0.f, 0.f);
     drawPropeller(-0.9f, +0.5f);
     drawPropeller(+0.9f, +0.5f);
     drawPropeller(-0.9f, -0.5f);
@@ -259,10 +760,9 @@ void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
     {
         glm::mat4 leg = glm::translate(drone, glm::vec3(xOff, -0.3f, zOff));
         leg = glm::scale(leg, glm::vec3(0.1f, 0.4f, 0.1f));
-        drawCube(leg, shaderProg);
+        addPart(leg, MAT_FRAME);
     };
 
-    glUniform3f(colorLoc, 1.f, 1.f, 1.f);
     drawLeg(-0.5f, +0.3f);
     drawLeg(+0.5f, +0.3f);
     drawLeg(-0.5f, -0.3f);
@@ -271,21 +771,31 @@ void DroneView::drawDrone(const DroneModel& model, GLuint shaderProg)
 
 void DroneView::cleanupDrone()
 {
-    if(mCubeVAO != 0)
+    mCube.cleanup();
+    mSphere.cleanup();
+
+    if(mHullVAO != 0)
+    {
+        glDeleteVertexArrays(1, &mHullVAO);
+        mHullVAO = 0;
+    }
+    if(mHullVBO != 0)
     {
-        glDeleteVertexArrays(1, &mCubeVAO);
-        mCubeVAO = 0;
+        glDeleteBuffers(1, &mHullVBO);
+        mHullVBO = 0;
     }
-    if(mSphereVAO != 0)
+    if(mHullEBO != 0)
     {
-        glDeleteVertexArrays(1, &mSphereVAO);
-        mSphereVAO = 0;
+        glDeleteBuffers(1, &mHullEBO);
+        mHullEBO = 0;
     }
-    if(mSphereVBO != 0)
+    if(mImpostorVAO != 0)
     {
-        glDeleteBuffers(1, &mSphereVBO);
-        mSphereVBO = 0;
+        glDeleteVertexArrays(1, &mImpostorVAO);
+        mImpostorVAO = 0;
     }
+    mInstances.cleanup();
 
+    mMeshStats.clear();
     mDroneGeometryInitialized = false;
 }
@@ -2,7 +2,31 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <vector>
 #include "DroneModel.h"
+#include "PolygonMesh.h"
+#include "VertexAttrib.h"
+#include "ObjectInstance.h"
+#include "Light.h"
+#include "RenderQueue.h"
+#include "StreamingBuffer.h"
+#include "OcclusionCuller.h"
+
+/**
+ * Level of detail a drone is drawn at:
+ *  - LOD_FULL:     every part, spinning propellers
+ *  - LOD_HULL:     one merged low-poly mesh
+ *  - LOD_IMPOSTOR: a single point
+ * Every LOD is drawn instanced, so a viewport costs the same few draws
+ * however many drones it shows.
+ */
+enum DroneLod
+{
+    LOD_FULL = 0,
+    LOD_HULL,
+    LOD_IMPOSTOR,
+    LOD_COUNT
+};
 
 /**
  * DroneView handles all rendering (VAOs, VBOs, draw calls).
@@ -11,31 +35,134 @@
 class DroneView
 {
 public:
+    // Viewports that keep their own LOD history (split screen)
+    static const int kMaxViewports = 4;
+
     DroneView();
     ~DroneView();
 
-    // Initialize geometry (cube + sphere)
-    void initDroneGeometry();
+    // Initialize geometry (cube + sphere) and register part materials.
+    // persistentMapping=false forces the buffer-orphaning streaming path.
+    void initDroneGeometry(RenderQueue& queue, bool persistentMapping = true);
 
-    // Draw the drone, reading data from the model
-    void drawDrone(const DroneModel& model, GLuint shaderProg);
+    // Bracket each frame's submits. beginFrame computes the drone transforms
+    // every viewport shares and picks this frame's region of the instance
+    // streaming buffer; endFrame fences it after the last flush.
+    void beginFrame(const std::vector<DroneModel>& fleet, int viewportCount);
+    void endFrame();
+
+    // Append each drone's navigation lights (red port, green starboard) at
+    // this frame's transforms, up to maxLights in total. Call after beginFrame.
+    void appendNavLights(std::vector<util::Light>& lights, size_t maxLights) const;
+
+    // Queue the fleet as seen by one viewport (0..kMaxViewports-1): cull it
+    // against the frustum and, if given, occluders already rendered for
+    // this viewport, then pick each drone's LOD from its projected size.
+    // instancedProg reads a per-instance color at location 2 and mat4 at
+    // locations 3..6. view and projection must be set on both programs, and
+    // the queue flushed, before the next viewport is submitted.
+    void submitFleet(const std::vector<DroneModel>& fleet,
+                     const glm::mat4& view, const glm::mat4& projection,
+                     int viewportHeight, int viewport,
+                     GLuint shaderProg, GLuint instancedProg, RenderQueue& queue,
+                     const OcclusionCuller* occlusion = nullptr);
 
     // Cleanup VAOs, VBOs, etc.
     void cleanupDrone();
 
+    // Print vertex cache statistics (ACMR, vertex shader invocations) for
+    // the meshes built by initDroneGeometry
+    void printMeshStats() const;
+
+    // Per-frame numbers from the last submitFleet
+    int getLodCount(DroneLod lod) const { return mLodCounts[lod]; }
+    int getCulledCount() const          { return mCulledCount; }
+    int getOccludedCount() const        { return mOccludedCount; }
+    int getDrawCount() const            { return mDrawCount; }
+    int getTriangleCount() const        { return mTriangleCount; }
+    const StreamingBuffer& getInstanceBuffer() const { return mInstances; }
+
 private:
+    // Materials used by the drone, as RenderQueue ids
+    enum PartMaterial
+    {
+        MAT_BODY = 0,
+        MAT_NOSE,
+        MAT_FRAME,
+        MAT_PROP,
+        MAT_VERTEX_COLOR, // white: color comes per vertex or per instance
+        MAT_COUNT
+    };
+
+    // Vertex cache numbers for one mesh, before and after optimizeMesh
+    struct MeshStats
+    {
+        const char* name;
+        int triangles;
+        int vertices;
+        int unindexedVerts; // what the old unindexed draw transformed
+        int missesBefore;
+        int missesAfter;
+    };
+
+    // Per-instance data of a full-detail part
+    struct PartInstance
+    {
+        glm::mat4 model;
+        glm::vec3 color;
+    };
+
     // Internal helpers
-    void initSphereGeometry();
-    void drawCube(const glm::mat4& model, GLuint shaderProg);
-    void drawSphere(const glm::mat4& model, GLuint shaderProg);
+    void optimizeMesh(const char* name, util::PolygonMesh<VertexAttrib>& mesh, int unindexedVerts);
+    void initHullGeometry(const util::PolygonMesh<VertexAttrib>& cube);
+    void initImpostorGeometry();
+    void initPartInstancing(const util::ObjectInstance& mesh);
+    void buildDroneParts(const DroneModel& model, const glm::mat4& drone, PartInstance* parts) const;
+    const PartInstance* droneParts(const std::vector<DroneModel>& fleet, int index);
+    void submitParts(const util::ObjectInstance& mesh, const std::vector<PartInstance>& parts,
+                     GLuint instancedProg, float depth, RenderQueue& queue);
+    void submitHulls(const std::vector<glm::mat4>& transforms, GLuint instancedProg,
+                     float depth, RenderQueue& queue);
+    void submitImpostors(const std::vector<glm::vec3>& positions, GLuint shaderProg, RenderQueue& queue);
+
+    static glm::mat4 droneTransform(const DroneModel& model);
+    static DroneLod  selectLod(DroneLod current, float screenSize);
 
 private:
-    // Cube
-    GLuint mCubeVAO;
+    // Indexed cube and sphere (position + normal per vertex)
+    util::ObjectInstance mCube;
+    util::ObjectInstance mSphere;
     bool   mDroneGeometryInitialized;
 
-    // Sphere
-    GLuint mSphereVAO;
-    GLuint mSphereVBO;
-    int    mSphereNumVerts;
+    // Merged hull (position + color + normal per vertex), drawn instanced
+    GLuint mHullVAO;
+    GLuint mHullVBO;
+    GLuint mHullEBO;
+    int    mHullNumIndices;
+
+    // Impostor points, refilled every frame
+    GLuint mImpostorVAO;
+
+    // Per-frame hull transforms and impostor positions
+    StreamingBuffer mInstances;
+
+    // This frame's drone transforms, and the parts of drones drawn at full
+    // detail in any viewport (mPartsOffset[i] into mFullParts, or -1)
+    std::vector<glm::mat4>    mDroneMatrices;
+    std::vector<int>          mPartsOffset;
+    std::vector<PartInstance> mFullParts;
+
+    // LOD each drone was drawn at last frame, per viewport
+    std::vector<DroneLod> mDroneLods[kMaxViewports];
+
+    std::vector<MeshStats> mMeshStats;
+
+    int       mMaterials[MAT_COUNT];
+    glm::vec3 mPartColors[MAT_COUNT];
+
+    int mLodCounts[LOD_COUNT];
+    int mCulledCount;
+    int mOccludedCount;
+    int mDrawCount;
+    int mTriangleCount;
 };
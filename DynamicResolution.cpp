@@ -0,0 +1,145 @@
+#include "DynamicResolution.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Weight of the newest GPU time in the smoothed one; the timer reports a
+// few frames late, so reacting to single frames would oscillate
+static const double kSmoothing = 0.15;
+
+// Frame times within this fraction under budget leave the scale alone
+static const double kDeadBand = 0.1;
+
+// Largest change of scale in one frame
+static const float kMaxStep = 0.03f;
+
+DynamicResolution::DynamicResolution()
+    : mWidth(0)
+    , mHeight(0)
+    , mBudgetMs(16.6)
+    , mMinScale(0.5f)
+    , mScale(1.f)
+    , mSmoothedMs(-1.0)
+    , mFBO(0)
+    , mColor(0)
+    , mDepth(0)
+    , mTargetFBO(0)
+{
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    cleanup();
+}
+
+bool DynamicResolution::init(int width, int height, double budgetMs, float minScale)
+{
+    mWidth    = width;
+    mHeight   = height;
+    mBudgetMs = budgetMs;
+    mMinScale = std::min(std::max(minScale, 0.1f), 1.f);
+    mScale    = 1.f;
+    createTargets();
+    return mFBO != 0;
+}
+
+bool DynamicResolution::resize(int width, int height)
+{
+    if (mFBO == 0 || (width == mWidth && height == mHeight) || width <= 0 || height <= 0)
+        return mFBO != 0;
+
+    mWidth  = width;
+    mHeight = height;
+    deleteTargets();
+    createTargets();
+    return mFBO != 0;
+}
+
+int DynamicResolution::getRenderWidth() const
+{
+    return std::max(1, (int)std::lround(mWidth * mScale));
+}
+
+int DynamicResolution::getRenderHeight() const
+{
+    return std::max(1, (int)std::lround(mHeight * mScale));
+}
+
+void DynamicResolution::createTargets()
+{
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+    glGenTextures(1, &mColor);
+    glBindTexture(GL_TEXTURE_2D, mColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mWidth, mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &mDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mWidth, mHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &mFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Dynamic resolution target incomplete (0x" << std::hex << status << std::dec << ")\n";
+        deleteTargets();
+    }
+}
+
+void DynamicResolution::deleteTargets()
+{
+    if (mFBO != 0)
+        glDeleteFramebuffers(1, &mFBO);
+    if (mColor != 0)
+        glDeleteTextures(1, &mColor);
+    if (mDepth != 0)
+        glDeleteRenderbuffers(1, &mDepth);
+    mFBO = mColor = mDepth = 0;
+}
+
+void DynamicResolution::update(double gpuFrameMs)
+{
+    if (gpuFrameMs <= 0.0)
+        return;
+    mSmoothedMs = mSmoothedMs < 0.0 ? gpuFrameMs : mSmoothedMs + (gpuFrameMs - mSmoothedMs) * kSmoothing;
+
+    // GPU time roughly follows the pixel count, i.e. the scale squared:
+    // aim for the scale that would just fit the budget
+    if (mSmoothedMs > mBudgetMs || mSmoothedMs < mBudgetMs * (1.0 - kDeadBand))
+    {
+        float ideal = mScale * (float)std::sqrt(mBudgetMs / mSmoothedMs);
+        float step  = std::min(std::max(ideal - mScale, -kMaxStep), kMaxStep);
+        mScale = std::min(std::max(mScale + step, mMinScale), 1.f);
+    }
+}
+
+void DynamicResolution::beginFrame()
+{
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &mTargetFBO);
+    RenderStats::bindFramebuffer(GL_FRAMEBUFFER, mFBO);
+}
+
+void DynamicResolution::endFrame()
+{
+    RenderStats::bindFramebuffer(GL_READ_FRAMEBUFFER, mFBO);
+    RenderStats::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mTargetFBO);
+    glBlitFramebuffer(0, 0, getRenderWidth(), getRenderHeight(), 0, 0, mWidth, mHeight,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    RenderStats::bindFramebuffer(GL_FRAMEBUFFER, mTargetFBO);
+}
+
+void DynamicResolution::cleanup()
+{
+    deleteTargets();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glad/glad.h>
+
+/**
+ * DynamicResolution renders the scene into an offscreen framebuffer at a
+ * fraction of the window size and stretches it over the window, adjusting
+ * the fraction so the GPU frame time stays within a budget. When a scene
+ * gets too heavy the resolution drops a little each frame instead of the
+ * frame rate falling off a cliff, and it climbs back as the load eases.
+ *
+ * The offscreen targets are allocated at full window size (resize() from
+ * the framebuffer size callback); lower scales only use their lower-left
+ * corner, so changing scale never reallocates.
+ *
+ * Per frame:
+ *   update(gpuMs)       feed the last measured GPU frame time
+ *   beginFrame()        bind the offscreen target; draw at
+ *                       getRenderWidth() x getRenderHeight()
+ *   endFrame()          upscale into the framebuffer bound before
+ */
+class DynamicResolution
+{
+public:
+    DynamicResolution();
+    ~DynamicResolution();
+
+    // budgetMs: GPU time to aim for; minScale: lowest fraction of the
+    // window size per axis
+    bool init(int width, int height, double budgetMs, float minScale);
+    // false if the targets could not be made at the new size; they are
+    // gone then and the object must not be used for frames any more
+    bool resize(int width, int height);
+
+    void update(double gpuFrameMs);
+
+    void beginFrame();
+    void endFrame();
+    void cleanup();
+
+    float getScale() const       { return mScale; }
+    int   getRenderWidth() const;
+    int   getRenderHeight() const;
+    bool  isReady() const        { return mFBO != 0; }
+
+private:
+    void createTargets();
+    void deleteTargets();
+
+private:
+    int    mWidth;
+    int    mHeight;
+    double mBudgetMs;
+    float  mMinScale;
+    float  mScale;
+    double mSmoothedMs;
+
+    GLuint mFBO;
+    GLuint mColor;
+    GLuint mDepth;
+    GLint  mTargetFBO;
+};
@@ -0,0 +1,94 @@
+#include "FramePacer.h"
+#include <chrono>
+
+// Weight of the newest sample in the averages
+static const double kAverageWeight = 0.1;
+
+static double nowSeconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void accumulate(double& average, double sample)
+{
+    if (average < 0.0)
+        average = sample;
+    else
+        average += (sample - average) * kAverageWeight;
+}
+
+FramePacer::FramePacer()
+    : mMaxFramesInFlight(2)
+    , mInputTime(0.0)
+    , mSwapLatencyMs(-1.0)
+    , mCompletionLatencyMs(-1.0)
+    , mWaitMs(-1.0)
+{
+}
+
+FramePacer::~FramePacer()
+{
+    cleanup();
+}
+
+void FramePacer::setMaxFramesInFlight(int frames)
+{
+    mMaxFramesInFlight = frames < 1 ? 1 : frames;
+}
+
+void FramePacer::inputSampled()
+{
+    mInputTime = nowSeconds();
+}
+
+void FramePacer::retire(double now, bool wait)
+{
+    PendingFrame& oldest = mPending.front();
+    GLenum status = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        if (!wait)
+            return;
+        while (glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        now = nowSeconds();
+    }
+
+    accumulate(mCompletionLatencyMs, (now - oldest.inputTime) * 1000.0);
+    glDeleteSync(oldest.fence);
+    mPending.pop_front();
+}
+
+void FramePacer::frameSubmitted()
+{
+    double now = nowSeconds();
+    accumulate(mSwapLatencyMs, (now - mInputTime) * 1000.0);
+
+    PendingFrame frame;
+    frame.fence     = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.inputTime = mInputTime;
+    mPending.push_back(frame);
+
+    // Retire whatever already finished, then block until the next frame
+    // is allowed to start
+    size_t before = 0;
+    while (!mPending.empty() && mPending.size() != before)
+    {
+        before = mPending.size();
+        retire(now, false);
+    }
+    while ((int)mPending.size() >= mMaxFramesInFlight)
+        retire(now, true);
+
+    accumulate(mWaitMs, (nowSeconds() - now) * 1000.0);
+}
+
+void FramePacer::cleanup()
+{
+    while (!mPending.empty())
+    {
+        glDeleteSync(mPending.front().fence);
+        mPending.pop_front();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <deque>
+
+/**
+ * FramePacer bounds how far the CPU may run ahead of the GPU and measures
+ * latency.
+ *
+ * Every frame is fenced when submitted. Before the next frame starts, the
+ * CPU waits until fewer than maxFramesInFlight frames are unfinished on the
+ * GPU: 1 serializes CPU and GPU for the lowest latency, larger values let
+ * them overlap for throughput.
+ *
+ * Latency is measured from the moment input was sampled to:
+ *  - swap:       the frame's swap call returning
+ *  - completion: the frame's fence being seen as signaled (an upper bound,
+ *                since fences are only checked once per frame)
+ */
+class FramePacer
+{
+public:
+    FramePacer();
+    ~FramePacer();
+
+    void setMaxFramesInFlight(int frames);
+    int  getMaxFramesInFlight() const { return mMaxFramesInFlight; }
+
+    // Call right after reading input for the frame
+    void inputSampled();
+
+    // Call after the frame's swap (or last draw, when headless); fences the
+    // frame and waits as needed for the frames-in-flight limit
+    void frameSubmitted();
+
+    void cleanup();
+
+    // Averages, in milliseconds
+    double getSwapLatencyMs() const       { return mSwapLatencyMs; }
+    double getCompletionLatencyMs() const { return mCompletionLatencyMs; }
+    double getWaitMs() const              { return mWaitMs; }
+
+private:
+    struct PendingFrame
+    {
+        GLsync fence;
+        double inputTime;
+    };
+
+    void retire(double now, bool wait);
+
+private:
+    std::deque<PendingFrame> mPending;
+    int    mMaxFramesInFlight;
+    double mInputTime;
+    double mSwapLatencyMs;
+    double mCompletionLatencyMs;
+    double mWaitMs;
+};
@@ -0,0 +1,334 @@
+#include "FrameRecorder.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// How long stop() waits for a readback still on the GPU
+static const GLuint64 kStopTimeoutNs = 1000000000ull;
+
+FrameRecorder::FrameRecorder()
+    : mPNG(false)
+    , mNext(0)
+    , mFrame(0)
+    , mDropped(0)
+    , mQuit(false)
+    , mWritten(0)
+{
+    std::memset(mSlots, 0, sizeof(mSlots));
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    stop();
+}
+
+void FrameRecorder::start(const std::string& dir, bool png)
+{
+    mDir = dir;
+    mPNG = png;
+    mNext = 0;
+    mFrame = 0;
+    mDropped = 0;
+    mWritten = 0;
+
+    std::error_code ec;
+    std::filesystem::create_directories(mDir, ec);
+
+    for(int i = 0; i < kSlots; i++)
+        glGenBuffers(1, &mSlots[i].buffer);
+
+    mQuit = false;
+    mWorker = std::thread(&FrameRecorder::workerLoop, this);
+}
+
+void FrameRecorder::capture(int width, int height)
+{
+    if (!isRecording())
+        return;
+
+    // Hand over every readback the GPU has finished
+    for(int i = 0; i < kSlots; i++)
+        if (mSlots[i].fence)
+            collect(mSlots[i], false);
+
+    Slot& slot = mSlots[mNext];
+    int frame = mFrame++;
+    if (slot.fence)
+    {
+        mDropped++; // the GPU is more than kSlots frames behind
+        return;
+    }
+
+    GLsizeiptr size = (GLsizeiptr)width * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.size != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.size = size;
+    }
+    // RGBA rows are always 4-byte aligned and need no conversion on most
+    // drivers, which keeps the copy on the GPU's side
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Later frames only poll the fence, which never flushes; make sure the
+    // readback and its fence reach the GPU instead of waiting in the queue
+    glFlush();
+    slot.frame  = frame;
+    slot.width  = width;
+    slot.height = height;
+    mNext = (mNext + 1) % kSlots;
+}
+
+bool FrameRecorder::collect(Slot& slot, bool wait)
+{
+    GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                     wait ? kStopTimeoutNs : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    if (status == GL_WAIT_FAILED)
+        return false;
+
+    Image image;
+    image.frame  = slot.frame;
+    image.width  = slot.width;
+    image.height = slot.height;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!wait && (int)mQueue.size() >= kMaxQueued)
+        {
+            mDropped++; // the encoder is behind; never wait for it
+            return false;
+        }
+        if (!mSpare.empty())
+        {
+            image.pixels.swap(mSpare.back());
+            mSpare.pop_back();
+        }
+    }
+    image.pixels.resize((size_t)slot.width * slot.height * 4);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)image.pixels.size(),
+                                          GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        std::memcpy(image.pixels.data(), mapped, image.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back(std::move(image));
+    }
+    mWake.notify_one();
+    return true;
+}
+
+void FrameRecorder::stop()
+{
+    if (!isRecording())
+        return;
+
+    // Oldest first, so the frames reach the encoder in order
+    for(int i = 0; i < kSlots; i++)
+    {
+        Slot& slot = mSlots[(mNext + i) % kSlots];
+        if (slot.fence && !collect(slot, true) && slot.fence)
+        {
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+            mDropped++;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mWake.notify_one();
+    mWorker.join();
+
+    for(int i = 0; i < kSlots; i++)
+    {
+        glDeleteBuffers(1, &mSlots[i].buffer);
+        mSlots[i] = Slot();
+    }
+    mSpare.clear();
+}
+
+void FrameRecorder::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(;;)
+    {
+        // Quitting still writes what is queued
+        mWake.wait(lock, [&]{ return mQuit || !mQueue.empty(); });
+        if (mQueue.empty())
+            return;
+
+        Image image = std::move(mQueue.front());
+        mQueue.pop_front();
+        lock.unlock();
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06d.%s", image.frame, mPNG ? "png" : "ppm");
+        std::string path = mDir + "/" + name;
+        if (mPNG)
+            writePNG(image, path);
+        else
+            writePPM(image, path);
+        mWritten++;
+
+        lock.lock();
+        mSpare.push_back(std::move(image.pixels));
+    }
+}
+
+// Rows top first, RGBA dropped to RGB, each prefixed by a rowPrefix byte
+// (PNG's per-row filter type) when it is not negative
+static std::vector<unsigned char> toRGBRows(const std::vector<unsigned char>& rgba, int width, int height,
+                                            int rowPrefix)
+{
+    size_t rowBytes = (size_t)width * 3 + (rowPrefix >= 0 ? 1 : 0);
+    std::vector<unsigned char> rows(rowBytes * height);
+    unsigned char* out = rows.data();
+    for(int y = height - 1; y >= 0; y--)
+    {
+        if (rowPrefix >= 0)
+            *out++ = (unsigned char)rowPrefix;
+        const unsigned char* in = &rgba[(size_t)y * width * 4];
+        for(int x = 0; x < width; x++, in += 4)
+        {
+            *out++ = in[0];
+            *out++ = in[1];
+            *out++ = in[2];
+        }
+    }
+    return rows;
+}
+
+void FrameRecorder::writePPM(const Image& image, const std::string& path) const
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Could not write " << path << "\n";
+        return;
+    }
+    std::vector<unsigned char> rows = toRGBRows(image.pixels, image.width, image.height, -1);
+    std::fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+    std::fwrite(rows.data(), 1, rows.size(), file);
+    std::fclose(file);
+}
+
+static uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    static bool filled = false;
+    if (!filled)
+    {
+        for(uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        filled = true;
+    }
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, uint32_t value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+static void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> header;
+    putBigEndian(header, (uint32_t)data.size());
+    header.insert(header.end(), type, type + 4);
+    uint32_t crc = crc32(&header[4], 4);
+    crc = crc32(data.data(), data.size(), crc);
+    std::vector<unsigned char> trailer;
+    putBigEndian(trailer, crc);
+
+    std::fwrite(header.data(), 1, header.size(), file);
+    std::fwrite(data.data(), 1, data.size(), file);
+    std::fwrite(trailer.data(), 1, trailer.size(), file);
+}
+
+void FrameRecorder::writePNG(const Image& image, const std::string& path) const
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Could not write " << path << "\n";
+        return;
+    }
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, (uint32_t)image.width);
+    putBigEndian(header, (uint32_t)image.height);
+    const unsigned char format[5] = { 8, 2, 0, 0, 0 }; // 8-bit RGB, no interlace
+    header.insert(header.end(), format, format + 5);
+    writeChunk(file, "IHDR", header);
+
+    // A zlib stream of stored (uncompressed) deflate blocks: encoding
+    // keeps up with the frame rate, at the cost of file size
+    std::vector<unsigned char> rows = toRGBRows(image.pixels, image.width, image.height, 0);
+    std::vector<unsigned char> data;
+    data.reserve(rows.size() + rows.size() / 65535 * 5 + 16);
+    data.push_back(0x78);
+    data.push_back(0x01);
+    for(size_t at = 0; at < rows.size(); )
+    {
+        size_t length = std::min<size_t>(rows.size() - at, 65535);
+        bool last = at + length == rows.size();
+        data.push_back(last ? 1 : 0);
+        data.push_back((unsigned char)length);
+        data.push_back((unsigned char)(length >> 8));
+        data.push_back((unsigned char)~length);
+        data.push_back((unsigned char)(~length >> 8));
+        data.insert(data.end(), rows.begin() + at, rows.begin() + at + length);
+        at += length;
+    }
+
+    // Adler-32, reduced every 5552 bytes (the most that cannot overflow)
+    uint32_t a = 1, b = 0;
+    for(size_t at = 0; at < rows.size(); )
+    {
+        size_t end = std::min<size_t>(rows.size(), at + 5552);
+        for(; at < end; at++)
+        {
+            a += rows[at];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    putBigEndian(data, (b << 16) | a);
+    writeChunk(file, "IDAT", data);
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+    std::fclose(file);
+}
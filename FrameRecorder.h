@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * FrameRecorder saves every rendered frame as a numbered image
+ * (frame_000000.ppm or .png) without ever making the render loop wait.
+ *
+ * capture() starts an asynchronous glReadPixels into one of kSlots pixel
+ * buffer objects and fences it. The copy is picked up kSlots - 1 frames
+ * later, once its fence has signalled, by mapping the buffer and copying
+ * the pixels out; a worker thread then flips, encodes and writes them.
+ *
+ * Nothing blocks: if the GPU has not finished the readback a slot is
+ * needed for, or the encoder has kMaxQueued frames waiting, that frame is
+ * dropped and counted instead. stop() is the one place that waits, for
+ * the readbacks in flight and the encoder's queue.
+ */
+class FrameRecorder
+{
+public:
+    static const int kSlots     = 3;   // readbacks in flight
+    static const int kMaxQueued = 8;   // frames waiting for the encoder
+
+    FrameRecorder();
+    ~FrameRecorder();
+
+    // Write frames into dir as PNG (uncompressed) or PPM
+    void start(const std::string& dir, bool png);
+
+    // Read back the bound framebuffer's width x height pixels
+    void capture(int width, int height);
+
+    // Finish the frames in flight and stop the encoder
+    void stop();
+
+    bool isRecording() const   { return mWorker.joinable(); }
+    int  getWrittenCount() const { return mWritten; }
+    int  getDroppedCount() const { return mDropped; }
+
+private:
+    struct Slot
+    {
+        GLuint     buffer;
+        GLsizeiptr size;
+        GLsync     fence;     // set while a readback is in flight
+        int        frame;
+        int        width;
+        int        height;
+    };
+
+    struct Image
+    {
+        int frame;
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;   // RGBA, bottom row first
+    };
+
+    bool collect(Slot& slot, bool wait);
+    void workerLoop();
+    void writePPM(const Image& image, const std::string& path) const;
+    void writePNG(const Image& image, const std::string& path) const;
+
+private:
+    std::string mDir;
+    bool        mPNG;
+    Slot        mSlots[kSlots];
+    int         mNext;       // slot the next capture uses
+    int         mFrame;
+    int         mDropped;
+
+    std::thread             mWorker;
+    std::mutex              mMutex;
+    std::condition_variable mWake;
+    std::deque<Image>       mQueue;
+    std::vector<std::vector<unsigned char>> mSpare;   // pixel buffers to reuse
+    bool                    mQuit;
+
+    std::atomic<int> mWritten;
+};
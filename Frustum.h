@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * View-frustum tests shared by the renderers. Planes are extracted from a
+ * view-projection matrix (Gribb/Hartmann), normalized, normals pointing in.
+ */
+
+// Planes (inward normals) of the view frustum of viewProj
+inline void extractFrustum(const glm::mat4& viewProj, glm::vec4 planes[6])
+{
+    glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row3 + row2;
+    planes[5] = row3 - row2;
+    for(int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+inline bool sphereInFrustum(const glm::vec4 planes[6], const glm::vec3& center, float radius)
+{
+    for(int i = 0; i < 6; i++)
+    {
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+// False only if the box is entirely outside one plane
+inline bool boxInFrustum(const glm::vec4 planes[6], const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    for(int i = 0; i < 6; i++)
+    {
+        // Corner furthest along the plane normal
+        glm::vec3 p(planes[i].x > 0.f ? boxMax.x : boxMin.x,
+                    planes[i].y > 0.f ? boxMax.y : boxMin.y,
+                    planes[i].z > 0.f ? boxMax.z : boxMin.z);
+        if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.f)
+            return false;
+    }
+    return true;
+}
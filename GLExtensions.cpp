@@ -0,0 +1,43 @@
+#include "GLExtensions.h"
+#include <cstring>
+
+GLExtensions gGLExt = {};
+
+bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i = 0; i < count; i++)
+    {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && std::strcmp(ext, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Is the context at least major.minor?
+static bool hasGLVersion(int major, int minor)
+{
+    GLint ctxMajor = 0, ctxMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &ctxMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &ctxMinor);
+    return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
+void loadGLExtensions(GLADloadproc load)
+{
+    gGLExt = GLExtensions();
+
+    if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+    {
+        gGLExt.BufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+        gGLExt.bufferStorage = gGLExt.BufferStorage != nullptr;
+    }
+
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        gGLExt.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        gGLExt.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    gGLExt.parallelShaderCompile = gGLExt.MaxShaderCompilerThreads != nullptr;
+}
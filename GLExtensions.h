@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glad/glad.h>
+
+/**
+ * Entry points newer than the GL 4.0 core that glad was generated for.
+ * They are looked up at runtime after gladLoadGLLoader; check the flag
+ * before calling a pointer, which is null when the driver lacks it.
+ */
+
+// ARB_buffer_storage (core in 4.4)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT  0x0040
+#define GL_MAP_COHERENT_BIT    0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT  0x0200
+#endif
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size,
+                                                const void* data, GLbitfield flags);
+
+// KHR_parallel_shader_compile (or its ARB twin): compiles and links run
+// on driver threads, polled with GL_COMPLETION_STATUS_KHR
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+struct GLExtensions
+{
+    bool bufferStorage;
+    PFNGLBUFFERSTORAGEPROC BufferStorage;
+    bool parallelShaderCompile;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreads;
+};
+
+extern GLExtensions gGLExt;
+
+// Fill gGLExt from the current context, using the same loader given to glad
+void loadGLExtensions(GLADloadproc load);
+
+// Is the named extension (e.g. "GL_ARB_buffer_storage") advertised?
+bool hasGLExtension(const char* name);
@@ -0,0 +1,165 @@
+#include "GpuTimer.h"
+
+// Weight of the newest sample in GpuPassTime::avgMs
+static const double kAverageWeight = 0.1;
+
+GpuTimer::GpuTimer()
+    : mFrameMs(-1.0)
+    , mFrame(0)
+    , mInPass(false)
+    , mDroppedFrames(0)
+    , mCollectedFrames(0)
+{
+    for(int i = 0; i < kFrameLatency; i++)
+    {
+        mFrames[i].used = 0;
+        mFrames[i].pending = false;
+    }
+}
+
+GpuTimer::~GpuTimer()
+{
+    cleanup();
+}
+
+int GpuTimer::passIndex(const char* name)
+{
+    for(size_t i = 0; i < mPasses.size(); i++)
+    {
+        if (mPasses[i].name == name)
+            return (int)i;
+    }
+
+    GpuPassTime pass;
+    pass.name   = name;
+    pass.lastMs = 0.0;
+    pass.avgMs  = -1.0; // no sample yet
+    mPasses.push_back(pass);
+    return (int)mPasses.size() - 1;
+}
+
+GLuint GpuTimer::nextQuery()
+{
+    // Queries are created as needed and kept for the slot's later frames
+    FrameQueries& frame = mFrames[mFrame];
+    if (frame.used == (int)frame.queries.size())
+    {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    return frame.queries[frame.used++];
+}
+
+void GpuTimer::collect(FrameQueries& frame)
+{
+    frame.pending = false;
+    if (frame.used == 0)
+        return;
+
+    // Timestamps complete in order: if the last one is in, all of them are
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        // Nothing is known about this frame: do not report the last one again
+        mDroppedFrames++;
+        mFrameMs = -1.0;
+        mLastFrame.clear();
+        return;
+    }
+
+    mFrameMs = 0.0;
+    mLastFrame.clear();
+    for(size_t i = 0; i < frame.passes.size(); i++)
+    {
+        const PassRecord& record = frame.passes[i];
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[record.firstQuery],     GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[record.firstQuery + 1], GL_QUERY_RESULT, &end);
+
+        GpuPassTime& pass = mPasses[record.pass];
+        pass.lastMs = (double)(end - begin) / 1.0e6;
+        if (pass.avgMs < 0.0)
+            pass.avgMs = pass.lastMs;
+        else
+            pass.avgMs += (pass.lastMs - pass.avgMs) * kAverageWeight;
+        PassSample sample = { record.pass, pass.lastMs };
+        mLastFrame.push_back(sample);
+        mFrameMs += pass.lastMs;
+    }
+    mCollectedFrames++;
+}
+
+void GpuTimer::beginFrame()
+{
+    // Reuse the oldest slot, reading back what it measured kFrameLatency
+    // frames ago
+    mFrame = (mFrame + 1) % kFrameLatency;
+    FrameQueries& frame = mFrames[mFrame];
+    if (frame.pending)
+        collect(frame);
+
+    frame.used = 0;
+    frame.passes.clear();
+}
+
+void GpuTimer::beginPass(const char* name)
+{
+    if (mInPass)
+        endPass();
+
+    PassRecord record;
+    record.pass = passIndex(name);
+    record.firstQuery = mFrames[mFrame].used;
+    mFrames[mFrame].passes.push_back(record);
+
+    glQueryCounter(nextQuery(), GL_TIMESTAMP);
+    mInPass = true;
+}
+
+void GpuTimer::endPass()
+{
+    if (!mInPass)
+        return;
+
+    glQueryCounter(nextQuery(), GL_TIMESTAMP);
+    mInPass = false;
+}
+
+void GpuTimer::endFrame()
+{
+    endPass();
+    mFrames[mFrame].pending = true;
+}
+
+double GpuTimer::getFrameMsExcluding(std::initializer_list<const char*> names) const
+{
+    if (mFrameMs < 0.0)
+        return mFrameMs;
+
+    double total = 0.0;
+    for(size_t i = 0; i < mLastFrame.size(); i++)
+    {
+        bool excluded = false;
+        for(const char* name : names)
+            excluded = excluded || mPasses[mLastFrame[i].pass].name == name;
+        if (!excluded)
+            total += mLastFrame[i].ms;
+    }
+    return total;
+}
+
+void GpuTimer::cleanup()
+{
+    for(int i = 0; i < kFrameLatency; i++)
+    {
+        FrameQueries& frame = mFrames[i];
+        if (!frame.queries.empty())
+            glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+        frame.queries.clear();
+        frame.passes.clear();
+        frame.used = 0;
+        frame.pending = false;
+    }
+}
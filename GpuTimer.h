@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/**
+ * GPU time of one named pass, in milliseconds
+ */
+struct GpuPassTime
+{
+    std::string name;
+    double      lastMs;  // most recent frame that was read back
+    double      avgMs;   // exponential moving average
+};
+
+/**
+ * GpuTimer measures how long the GPU spends on named passes of a frame.
+ * Each pass is bracketed by two GL_TIMESTAMP queries. Results are read
+ * kFrameLatency frames later, when the GPU has long finished with them, so
+ * measuring never makes the CPU wait; a frame whose results are still not
+ * ready by then is dropped rather than waited for.
+ *
+ * Per frame:
+ *   beginFrame();
+ *   beginPass("clear"); ... endPass();
+ *   beginPass("drones"); ... endPass();
+ *   endFrame();
+ * Passes must not nest.
+ */
+class GpuTimer
+{
+public:
+    static const int kFrameLatency = 3;
+
+    GpuTimer();
+    ~GpuTimer();
+
+    void beginFrame();
+    void beginPass(const char* name);
+    void endPass();
+    void endFrame();
+
+    void cleanup();
+
+    // Passes in the order they were first seen
+    const std::vector<GpuPassTime>& getPasses() const { return mPasses; }
+
+    // Total GPU time of the passes in the frame read back most recently;
+    // negative if that frame was dropped (or none has been read back yet)
+    double getFrameMs() const { return mFrameMs; }
+
+    // The same without the named passes
+    double getFrameMsExcluding(std::initializer_list<const char*> names) const;
+
+    // Frames read back so far; changes when getFrameMs() has a new value
+    int getCollectedFrames() const { return mCollectedFrames; }
+
+    // Frames whose queries were not ready when their slot came round again
+    int getDroppedFrames() const { return mDroppedFrames; }
+
+private:
+    struct PassRecord
+    {
+        int pass;        // index into mPasses
+        int firstQuery;  // begin timestamp; end is the next one
+    };
+
+    // Queries issued during one frame
+    struct FrameQueries
+    {
+        std::vector<GLuint>     queries;
+        std::vector<PassRecord> passes;
+        int                     used;
+        bool                    pending;
+    };
+
+    int    passIndex(const char* name);
+    GLuint nextQuery();
+    void   collect(FrameQueries& frame);
+
+private:
+    struct PassSample
+    {
+        int    pass;     // index into mPasses
+        double ms;
+    };
+
+    FrameQueries             mFrames[kFrameLatency];
+    std::vector<GpuPassTime> mPasses;
+    std::vector<PassSample>  mLastFrame;   // passes of the frame read back last
+    double                   mFrameMs;
+    int                      mFrame;
+    bool                     mInPass;
+    int                      mDroppedFrames;
+    int                      mCollectedFrames;
+};
@@ -0,0 +1,183 @@
+#include "HeadlessContext.h"
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#ifdef DRONE_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext()
+    : mDisplay(nullptr)
+    , mContext(nullptr)
+    , mFBO(0)
+    , mColorRB(0)
+    , mDepthRB(0)
+    , mWidth(0)
+    , mHeight(0)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
+
+#ifdef DRONE_HEADLESS
+
+GLADloadproc HeadlessContext::getProcAddress()
+{
+    return (GLADloadproc)eglGetProcAddress;
+}
+
+bool HeadlessContext::create(int width, int height)
+{
+    // Prefer the surfaceless platform; it works with no display server at all
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0, minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        std::cerr << "Headless: no EGL display\n";
+        return false;
+    }
+    mDisplay = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cerr << "Headless: EGL has no desktop OpenGL\n";
+        destroy();
+        return false;
+    }
+
+    // Same version and profile the GLFW window asks for. No config: there
+    // is no surface, everything is drawn into the FBO below.
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cerr << "Headless: could not create a GL 3.3 core context (EGL_KHR_no_config_context?)\n";
+        destroy();
+        return false;
+    }
+    mContext = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cerr << "Headless: context cannot be made current without a surface\n";
+        destroy();
+        return false;
+    }
+
+    if (!gladLoadGLLoader(getProcAddress()))
+    {
+        std::cerr << "Failed to init GLAD\n";
+        destroy();
+        return false;
+    }
+
+    mWidth  = width;
+    mHeight = height;
+
+    glGenFramebuffers(1, &mFBO);
+    glGenRenderbuffers(1, &mColorRB);
+    glGenRenderbuffers(1, &mDepthRB);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, mColorRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Headless: framebuffer incomplete\n";
+        destroy();
+        return false;
+    }
+
+    // The FBO stays bound; to the rest of the program it is the screen
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (mContext)
+    {
+        if (mFBO != 0)
+        {
+            glDeleteFramebuffers(1, &mFBO);
+            glDeleteRenderbuffers(1, &mColorRB);
+            glDeleteRenderbuffers(1, &mDepthRB);
+            mFBO = mColorRB = mDepthRB = 0;
+        }
+        eglMakeCurrent((EGLDisplay)mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay)mDisplay, (EGLContext)mContext);
+        mContext = nullptr;
+    }
+    if (mDisplay)
+    {
+        eglTerminate((EGLDisplay)mDisplay);
+        mDisplay = nullptr;
+    }
+}
+
+#else
+
+GLADloadproc HeadlessContext::getProcAddress()
+{
+    return nullptr;
+}
+
+bool HeadlessContext::create(int width, int height)
+{
+    std::cerr << "Headless rendering needs EGL; rebuild with -DDRONE_HEADLESS\n";
+    return false;
+}
+
+void HeadlessContext::destroy()
+{
+}
+
+#endif
+
+bool HeadlessContext::savePPM(const std::string& path) const
+{
+    if (mFBO == 0)
+        return false;
+
+    std::vector<unsigned char> pixels((size_t)mWidth * mHeight * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, mWidth, mHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Could not write " << path << "\n";
+        return false;
+    }
+
+    // GL's first row is the bottom one
+    std::fprintf(file, "P6\n%d %d\n255\n", mWidth, mHeight);
+    for(int y = mHeight - 1; y >= 0; y--)
+        std::fwrite(&pixels[(size_t)y * mWidth * 3], 1, (size_t)mWidth * 3, file);
+    std::fclose(file);
+    return true;
+}
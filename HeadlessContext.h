@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+
+/**
+ * HeadlessContext renders without a window: a surfaceless EGL context
+ * (EGL_MESA_platform_surfaceless, so no X/Wayland display or GPU is needed;
+ * Mesa's llvmpipe rasterizes on the CPU) with an FBO standing in for the
+ * default framebuffer.
+ *
+ * Only built where EGL is available (DRONE_HEADLESS, set by the Makefile
+ * on Linux); elsewhere create() reports that and fails.
+ */
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    // Create a GL 3.3 core context, load glad, and bind a width x height
+    // color + depth FBO. Returns false (and logs) on failure.
+    bool create(int width, int height);
+
+    void destroy();
+
+    // Loader for glad / loadGLExtensions / ProgramBinaryCache
+    static GLADloadproc getProcAddress();
+
+    // Write the FBO's color buffer as a binary PPM, top row first
+    bool savePPM(const std::string& path) const;
+
+    int getWidth() const  { return mWidth; }
+    int getHeight() const { return mHeight; }
+
+private:
+    void*  mDisplay;  // EGLDisplay
+    void*  mContext;  // EGLContext
+    GLuint mFBO;
+    GLuint mColorRB;
+    GLuint mDepthRB;
+    int    mWidth;
+    int    mHeight;
+};
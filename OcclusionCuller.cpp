@@ -0,0 +1,235 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Triangles covering less than this many square texels are skipped
+static const float kMinArea = 0.25f;
+
+// Signed area (times two) of a, b, p; positive if p is left of a->b
+static float edge(const glm::vec3& a, const glm::vec3& b, float px, float py)
+{
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+OcclusionCuller::OcclusionCuller()
+    : mViewProj(1.f)
+    , mView(1.f)
+    , mProjection(1.f)
+    , mRasterMs(0.0)
+{
+}
+
+void OcclusionCuller::setOccluders(const std::vector<glm::vec3>& triangles)
+{
+    mTriangles = triangles;
+    mTriangles.resize(mTriangles.size() / 3 * 3);
+}
+
+void OcclusionCuller::render(const glm::mat4& view, const glm::mat4& projection, float aspect)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    mView       = view;
+    mProjection = projection;
+    mViewProj   = projection * view;
+
+    // (Re)size the pyramid for this viewport's aspect
+    int width  = kWidth;
+    int height = std::min(4 * kWidth, std::max(1, (int)std::lround(kWidth / std::max(aspect, 1e-3f))));
+    if (mLevelSizes.empty() || mLevelSizes[0] != glm::ivec2(width, height))
+    {
+        mLevels.clear();
+        mLevelSizes.clear();
+        glm::ivec2 size(width, height);
+        for(;;)
+        {
+            mLevelSizes.push_back(size);
+            mLevels.push_back(std::vector<float>((size_t)size.x * size.y));
+            if (size.x == 1 && size.y == 1)
+                break;
+            size = glm::max(glm::ivec2(1), (size + 1) / 2);
+        }
+    }
+    std::fill(mLevels[0].begin(), mLevels[0].end(), 1.f);
+
+    for(size_t t = 0; t < mTriangles.size(); t += 3)
+    {
+        glm::vec4 in[3];
+        for(int k = 0; k < 3; k++)
+            in[k] = mViewProj * glm::vec4(mTriangles[t + k], 1.f);
+
+        // All three beyond one side of the frustum (near is clipped below)
+        bool outside = false;
+        for(int axis = 0; axis < 3 && !outside; axis++)
+        {
+            outside = (in[0][axis] >  in[0].w && in[1][axis] >  in[1].w && in[2][axis] >  in[2].w);
+            if (axis < 2)
+                outside = outside ||
+                          (in[0][axis] < -in[0].w && in[1][axis] < -in[1].w && in[2][axis] < -in[2].w);
+        }
+        if (outside)
+            continue;
+
+        // Clip against the near plane (z = -w): at most four vertices
+        glm::vec4 poly[4];
+        int count = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            const glm::vec4& a = in[k];
+            const glm::vec4& b = in[(k + 1) % 3];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.f)
+                poly[count++] = a;
+            if ((da >= 0.f) != (db >= 0.f))
+                poly[count++] = a + (b - a) * (da / (da - db));
+        }
+        for(int k = 2; k < count; k++)
+            rasterize(poly[0], poly[k - 1], poly[k]);
+    }
+
+    buildPyramid();
+
+    mRasterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionCuller::rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+    const glm::ivec2 size = mLevelSizes[0];
+    std::vector<float>& depth = mLevels[0];
+
+    // Window coordinates; z is depth in [0,1]
+    glm::vec3 s[3];
+    const glm::vec4* clip[3] = { &a, &b, &c };
+    for(int k = 0; k < 3; k++)
+    {
+        float invW = 1.f / std::max(clip[k]->w, 1e-6f);
+        s[k] = glm::vec3((clip[k]->x * invW * 0.5f + 0.5f) * size.x,
+                         (clip[k]->y * invW * 0.5f + 0.5f) * size.y,
+                          clip[k]->z * invW * 0.5f + 0.5f);
+    }
+
+    // Either winding: occluders need not be closed or consistently wound
+    float area = edge(s[0], s[1], s[2].x, s[2].y);
+    if (std::fabs(area) < kMinArea)
+        return;
+    if (area < 0.f)
+    {
+        std::swap(s[1], s[2]);
+        area = -area;
+    }
+
+    int x0 = std::max(0,          (int)std::floor(std::min(s[0].x, std::min(s[1].x, s[2].x))));
+    int x1 = std::min(size.x - 1, (int)std::ceil (std::max(s[0].x, std::max(s[1].x, s[2].x))));
+    int y0 = std::max(0,          (int)std::floor(std::min(s[0].y, std::min(s[1].y, s[2].y))));
+    int y1 = std::min(size.y - 1, (int)std::ceil (std::max(s[0].y, std::max(s[1].y, s[2].y))));
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // Edge functions at the first texel centre, stepped per texel
+    float invArea = 1.f / area;
+    float px = x0 + 0.5f, py = y0 + 0.5f;
+    float row0 = edge(s[1], s[2], px, py), dx0 = s[1].y - s[2].y, dy0 = s[2].x - s[1].x;
+    float row1 = edge(s[2], s[0], px, py), dx1 = s[2].y - s[0].y, dy1 = s[0].x - s[2].x;
+    float row2 = edge(s[0], s[1], px, py), dx2 = s[0].y - s[1].y, dy2 = s[1].x - s[0].x;
+
+    for(int y = y0; y <= y1; y++)
+    {
+        float w0 = row0, w1 = row1, w2 = row2;
+        float* line = &depth[(size_t)y * size.x];
+        for(int x = x0; x <= x1; x++)
+        {
+            if (w0 >= 0.f && w1 >= 0.f && w2 >= 0.f)
+            {
+                float z = (w0 * s[0].z + w1 * s[1].z + w2 * s[2].z) * invArea;
+                line[x] = std::min(line[x], z);
+            }
+            w0 += dx0;
+            w1 += dx1;
+            w2 += dx2;
+        }
+        row0 += dy0;
+        row1 += dy1;
+        row2 += dy2;
+    }
+}
+
+void OcclusionCuller::buildPyramid()
+{
+    for(size_t l = 1; l < mLevels.size(); l++)
+    {
+        const std::vector<float>& src = mLevels[l - 1];
+        std::vector<float>&       dst = mLevels[l];
+        glm::ivec2 srcSize = mLevelSizes[l - 1];
+        glm::ivec2 dstSize = mLevelSizes[l];
+
+        for(int y = 0; y < dstSize.y; y++)
+        {
+            int sy0 = 2 * y, sy1 = std::min(2 * y + 1, srcSize.y - 1);
+            for(int x = 0; x < dstSize.x; x++)
+            {
+                int sx0 = 2 * x, sx1 = std::min(2 * x + 1, srcSize.x - 1);
+                dst[(size_t)y * dstSize.x + x] =
+                    std::max(std::max(src[(size_t)sy0 * srcSize.x + sx0], src[(size_t)sy0 * srcSize.x + sx1]),
+                             std::max(src[(size_t)sy1 * srcSize.x + sx0], src[(size_t)sy1 * srcSize.x + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(const glm::vec3& center, float radius) const
+{
+    if (mLevels.empty())
+        return false;
+
+    // Nearest point of the sphere, as a depth in [0,1]
+    float nearest = -(mView * glm::vec4(center, 1.f)).z - radius;
+    if (nearest <= 0.f)
+        return false;
+    float ndcZ = (mProjection[2][2] * -nearest + mProjection[3][2]) / nearest;
+    float depth = ndcZ * 0.5f + 0.5f;
+    if (depth <= 0.f)
+        return false;
+
+    // Screen bounds from the corners of the sphere's box
+    glm::vec2 lo(1e30f), hi(-1e30f);
+    for(int k = 0; k < 8; k++)
+    {
+        glm::vec3 corner = center + radius * glm::vec3(k & 1 ? 1.f : -1.f,
+                                                       k & 2 ? 1.f : -1.f,
+                                                       k & 4 ? 1.f : -1.f);
+        glm::vec4 clip = mViewProj * glm::vec4(corner, 1.f);
+        if (clip.w <= 1e-4f)
+            return false;
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+
+    // Texel range, grown by one texel, clamped to the screen (what is off
+    // screen is not visible either)
+    const glm::ivec2 size = mLevelSizes[0];
+    int x0 = (int)std::floor((lo.x * 0.5f + 0.5f) * size.x) - 1;
+    int x1 = (int)std::floor((hi.x * 0.5f + 0.5f) * size.x) + 1;
+    int y0 = (int)std::floor((lo.y * 0.5f + 0.5f) * size.y) - 1;
+    int y1 = (int)std::floor((hi.y * 0.5f + 0.5f) * size.y) + 1;
+    if (x1 < 0 || y1 < 0 || x0 >= size.x || y0 >= size.y)
+        return false;
+    x0 = std::max(x0, 0); x1 = std::min(x1, size.x - 1);
+    y0 = std::max(y0, 0); y1 = std::min(y1, size.y - 1);
+
+    // Coarsest detail needed: the level where the range is 2x2 texels
+    size_t level = 0;
+    while (level + 1 < mLevels.size() &&
+           ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+
+    const std::vector<float>& hiZ = mLevels[level];
+    int width = mLevelSizes[level].x;
+    float farthest = 0.f;
+    for(int y = y0 >> level; y <= (y1 >> level); y++)
+        for(int x = x0 >> level; x <= (x1 >> level); x++)
+            farthest = std::max(farthest, hiZ[(size_t)y * width + x]);
+
+    return depth > farthest;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * OcclusionCuller answers "is this sphere hidden behind the big static
+ * geometry?" on the CPU, before anything is submitted.
+ *
+ * render() rasterizes the occluder triangles into a small depth buffer
+ * (kWidth texels across, height from the viewport's aspect) with the
+ * viewport's camera, keeping the nearest depth per texel, and builds a
+ * hierarchical-Z pyramid over it where each texel holds the farthest depth
+ * of the four below. isOccluded() projects a sphere's bounds, picks the
+ * level where they cover at most a couple of texels, and reports it hidden
+ * when its nearest point is behind the farthest occluder in all of them.
+ *
+ * Depths are NDC z mapped to [0,1], so comparisons need no linearization.
+ * Texels count as covered when their centre is, so tested bounds are grown
+ * by a texel to keep objects peeking past an occluder's edge visible.
+ */
+class OcclusionCuller
+{
+public:
+    static const int kWidth = 256;
+
+    OcclusionCuller();
+
+    // World-space triangles, three vertices each
+    void setOccluders(const std::vector<glm::vec3>& triangles);
+
+    // Rasterize the occluders for one viewport and rebuild the pyramid
+    void render(const glm::mat4& view, const glm::mat4& projection, float aspect);
+
+    // True if the whole sphere is behind the occluders of the last render()
+    bool isOccluded(const glm::vec3& center, float radius) const;
+
+    bool   hasOccluders() const      { return !mTriangles.empty(); }
+    int    getTriangleCount() const  { return (int)mTriangles.size() / 3; }
+    double getRasterMs() const       { return mRasterMs; }
+
+private:
+    void rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    void buildPyramid();
+
+private:
+    std::vector<glm::vec3> mTriangles;
+
+    // Level 0 is the rasterized depth, level n is half of level n-1
+    std::vector<std::vector<float>> mLevels;
+    std::vector<glm::ivec2>         mLevelSizes;
+
+    glm::mat4 mViewProj;
+    glm::mat4 mView;
+    glm::mat4 mProjection;
+    double    mRasterMs;
+};
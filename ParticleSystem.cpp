@@ -0,0 +1,309 @@
+#include "ParticleSystem.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Simulation constants, handed to the update shader as uniforms so both
+// paths agree
+static const float kDownwash    = 6.f;   // m/s straight down at nominal prop speed
+static const float kDrag        = 1.5f;  // 1/s
+static const float kGravity     = 1.f;   // m/s^2, dust is light
+static const float kGround      = -1.f;  // where downwash turns into dust
+static const float kRotorRadius = 1.4f;  // spawn disc under the drone
+static const float kMinLife     = 0.8f;
+static const float kMaxLife     = 2.f;
+
+// Prop speed (deg/s) that gives full strength: DroneController's default
+static const float kNominalPropSpeed = 180.f;
+
+// Floats per particle: position, age, velocity, life
+static const int kParticleFloats = 8;
+
+static const int kEmitterTextureUnit = 9;
+
+ParticleSystem::ParticleSystem()
+    : mCount(0)
+    , mDroneCount(0)
+    , mUpdateProgram(0)
+    , mCurrent(0)
+    , mEmitterBuffer(0)
+    , mEmitterTexture(0)
+    , mFrame(0)
+    , mCpuMs(0.0)
+    , mRandom(4300u)
+{
+    mBuffers[0] = mBuffers[1] = 0;
+    mVAOs[0] = mVAOs[1] = 0;
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    cleanup();
+}
+
+void ParticleSystem::init(int particleCount, int droneCount, GLuint updateProgram)
+{
+    mCount         = (std::max(particleCount, 0) + 3) & ~3; // whole SIMD groups
+    mDroneCount    = std::max(droneCount, 1);
+    mUpdateProgram = updateProgram;
+    mCurrent       = 0;
+    if (mCount == 0)
+        return;
+
+    // Nothing spawned yet: each particle waits a random part of a lifetime
+    // (age counts up to 0) so emission starts evenly spread out
+    std::vector<float> initial((size_t)mCount * kParticleFloats, 0.f);
+    for(int i = 0; i < mCount; i++)
+        initial[(size_t)i * kParticleFloats + 3] = -kMaxLife * (float)i / (float)mCount;
+
+    glGenBuffers(2, mBuffers);
+    glGenVertexArrays(2, mVAOs);
+    for(int b = 0; b < 2; b++)
+    {
+        glBindVertexArray(mVAOs[b]);
+        glBindBuffer(GL_ARRAY_BUFFER, mBuffers[b]);
+        glBufferData(GL_ARRAY_BUFFER, initial.size() * sizeof(float),
+                     b == 0 ? initial.data() : nullptr, isGpu() ? GL_DYNAMIC_COPY : GL_STREAM_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, kParticleFloats * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, kParticleFloats * sizeof(float),
+                              (void*)(4 * sizeof(float)));
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mEmitters.assign(mDroneCount, glm::vec4(0.f));
+    if (isGpu())
+    {
+        glGenBuffers(1, &mEmitterBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, mEmitterBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, mEmitters.size() * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glGenTextures(1, &mEmitterTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, mEmitterTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mEmitterBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return;
+    }
+
+    size_t n = (size_t)mCount;
+    mPosX.assign(n, 0.f); mPosY.assign(n, 0.f); mPosZ.assign(n, 0.f);
+    mVelX.assign(n, 0.f); mVelY.assign(n, 0.f); mVelZ.assign(n, 0.f);
+    mAge.resize(n);
+    mLife.assign(n, 0.f);
+    for(size_t i = 0; i < n; i++)
+        mAge[i] = initial[i * kParticleFloats + 3];
+    mUpload.resize(n * kParticleFloats);
+}
+
+void ParticleSystem::update(const std::vector<DroneModel>& fleet, float propSpeed, float dt)
+{
+    if (mCount == 0)
+        return;
+
+    float strength = std::min(std::max(propSpeed / kNominalPropSpeed, 0.f), 4.f);
+    for(int d = 0; d < mDroneCount && d < (int)fleet.size(); d++)
+        mEmitters[d] = glm::vec4(fleet[d].getPosition(), strength);
+    mFrame++;
+
+    if (!isGpu())
+    {
+        updateCpu(strength, dt);
+        return;
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, mEmitterBuffer);
+    RenderStats::bufferSubData(GL_TEXTURE_BUFFER, 0, mEmitters.size() * sizeof(glm::vec4), mEmitters.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    RenderStats::useProgram(mUpdateProgram);
+    glActiveTexture(GL_TEXTURE0 + kEmitterTextureUnit);
+    RenderStats::bindTexture(GL_TEXTURE_BUFFER, mEmitterTexture);
+    glActiveTexture(GL_TEXTURE0);
+    RenderStats::uniform(glGetUniformLocation(mUpdateProgram, "emitters"), kEmitterTextureUnit);
+    RenderStats::uniform(glGetUniformLocation(mUpdateProgram, "emitterCount"), mDroneCount);
+    RenderStats::uniform(glGetUniformLocation(mUpdateProgram, "dt"), dt);
+    RenderStats::uniform(glGetUniformLocation(mUpdateProgram, "seed"), mFrame);
+    RenderStats::uniform(glGetUniformLocation(mUpdateProgram, "physics"), glm::vec4(kDownwash, kDrag, kGravity, kGround));
+    RenderStats::uniform(glGetUniformLocation(mUpdateProgram, "spawn"), glm::vec3(kRotorRadius, kMinLife, kMaxLife));
+
+    // Read the current buffer, capture into the other
+    int next = 1 - mCurrent;
+    RenderStats::enable(GL_RASTERIZER_DISCARD);
+    RenderStats::bindVertexArray(mVAOs[mCurrent]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, mBuffers[next]);
+    glBeginTransformFeedback(GL_POINTS);
+    RenderStats::drawArrays(GL_POINTS, 0, mCount);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    RenderStats::bindVertexArray(0);
+    RenderStats::disable(GL_RASTERIZER_DISCARD);
+    mCurrent = next;
+}
+
+void ParticleSystem::spawnCpu(size_t i, const glm::vec3& emitter, float strength)
+{
+    auto random = [this]()
+    {
+        mRandom ^= mRandom << 13;
+        mRandom ^= mRandom >> 17;
+        mRandom ^= mRandom << 5;
+        return (float)(mRandom & 0xFFFFFF) / (float)0xFFFFFF;
+    };
+
+    float angle  = 6.2831853f * random();
+    float radius = kRotorRadius * std::sqrt(random());
+    float c = std::cos(angle) * radius, s = std::sin(angle) * radius;
+    float down = kDownwash * (0.7f + 0.6f * random());
+
+    mPosX[i] = emitter.x + c;
+    mPosY[i] = emitter.y - 0.3f;
+    mPosZ[i] = emitter.z + s;
+    mVelX[i] = 0.8f * c * strength;
+    mVelY[i] = -down * strength;
+    mVelZ[i] = 0.8f * s * strength;
+    mAge[i]  = 0.f;
+    mLife[i] = strength > 0.f ? kMinLife + (kMaxLife - kMinLife) * random() : 0.f;
+}
+
+void ParticleSystem::updateCpu(float strength, float dt)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const size_t n = (size_t)mCount;
+
+#if defined(__SSE2__)
+    const __m128 vDt      = _mm_set1_ps(dt);
+    const __m128 vKeep    = _mm_set1_ps(1.f - kDrag * dt);
+    const __m128 vFall    = _mm_set1_ps(-kGravity * dt);
+    const __m128 vGround  = _mm_set1_ps(kGround);
+    const __m128 vKick    = _mm_set1_ps(0.6f);
+    const __m128 vBounce  = _mm_set1_ps(-0.15f);
+    const __m128 vTiny    = _mm_set1_ps(1e-6f);
+    for(size_t i = 0; i < n; i += 4)
+    {
+        __m128 age = _mm_add_ps(_mm_loadu_ps(&mAge[i]), vDt);
+        __m128 vx = _mm_mul_ps(_mm_loadu_ps(&mVelX[i]), vKeep);
+        __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&mVelY[i]), vKeep), vFall);
+        __m128 vz = _mm_mul_ps(_mm_loadu_ps(&mVelZ[i]), vKeep);
+        __m128 px = _mm_add_ps(_mm_loadu_ps(&mPosX[i]), _mm_mul_ps(vx, vDt));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(&mPosY[i]), _mm_mul_ps(vy, vDt));
+        __m128 pz = _mm_add_ps(_mm_loadu_ps(&mPosZ[i]), _mm_mul_ps(vz, vDt));
+
+        // Hitting the ground: vertical speed turns into outward speed
+        __m128 hit   = _mm_cmplt_ps(py, vGround);
+        __m128 horiz = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz));
+        __m128 scale = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(vy, vKick), _mm_set1_ps(-1.f)),
+                                  _mm_sqrt_ps(_mm_max_ps(horiz, vTiny)));
+        scale = _mm_and_ps(scale, _mm_cmpgt_ps(horiz, vTiny));
+        __m128 bx = _mm_add_ps(vx, _mm_mul_ps(vx, scale));
+        __m128 bz = _mm_add_ps(vz, _mm_mul_ps(vz, scale));
+        __m128 by = _mm_mul_ps(vy, vBounce);
+        vx = _mm_or_ps(_mm_and_ps(hit, bx), _mm_andnot_ps(hit, vx));
+        vy = _mm_or_ps(_mm_and_ps(hit, by), _mm_andnot_ps(hit, vy));
+        vz = _mm_or_ps(_mm_and_ps(hit, bz), _mm_andnot_ps(hit, vz));
+        py = _mm_or_ps(_mm_and_ps(hit, vGround), _mm_andnot_ps(hit, py));
+
+        _mm_storeu_ps(&mAge[i], age);
+        _mm_storeu_ps(&mVelX[i], vx);
+        _mm_storeu_ps(&mVelY[i], vy);
+        _mm_storeu_ps(&mVelZ[i], vz);
+        _mm_storeu_ps(&mPosX[i], px);
+        _mm_storeu_ps(&mPosY[i], py);
+        _mm_storeu_ps(&mPosZ[i], pz);
+
+        // Expired lanes respawn one at a time
+        int expired = _mm_movemask_ps(_mm_cmpge_ps(age, _mm_loadu_ps(&mLife[i])));
+        for(int k = 0; expired != 0; k++, expired >>= 1)
+            if (expired & 1)
+                spawnCpu(i + k, glm::vec3(mEmitters[(i + k) % mDroneCount]), strength);
+
+        // Interleave into the draw layout: two transposed 4x4 blocks
+        __m128 r0 = _mm_loadu_ps(&mPosX[i]), r1 = _mm_loadu_ps(&mPosY[i]);
+        __m128 r2 = _mm_loadu_ps(&mPosZ[i]), r3 = _mm_loadu_ps(&mAge[i]);
+        __m128 s0 = _mm_loadu_ps(&mVelX[i]), s1 = _mm_loadu_ps(&mVelY[i]);
+        __m128 s2 = _mm_loadu_ps(&mVelZ[i]), s3 = _mm_loadu_ps(&mLife[i]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+        float* out = &mUpload[i * kParticleFloats];
+        _mm_storeu_ps(out,      r0); _mm_storeu_ps(out + 4,  s0);
+        _mm_storeu_ps(out + 8,  r1); _mm_storeu_ps(out + 12, s1);
+        _mm_storeu_ps(out + 16, r2); _mm_storeu_ps(out + 20, s2);
+        _mm_storeu_ps(out + 24, r3); _mm_storeu_ps(out + 28, s3);
+    }
+#else
+    const float keep = 1.f - kDrag * dt;
+    for(size_t i = 0; i < n; i++)
+    {
+        mAge[i] += dt;
+        mVelX[i] *= keep;
+        mVelY[i] = mVelY[i] * keep - kGravity * dt;
+        mVelZ[i] *= keep;
+        mPosX[i] += mVelX[i] * dt;
+        mPosY[i] += mVelY[i] * dt;
+        mPosZ[i] += mVelZ[i] * dt;
+        if (mPosY[i] < kGround)
+        {
+            float horiz = std::sqrt(mVelX[i] * mVelX[i] + mVelZ[i] * mVelZ[i]);
+            float scale = horiz > 1e-3f ? -mVelY[i] * 0.6f / horiz : 0.f;
+            mVelX[i] += mVelX[i] * scale;
+            mVelZ[i] += mVelZ[i] * scale;
+            mVelY[i] *= -0.15f;
+            mPosY[i] = kGround;
+        }
+        if (mAge[i] >= mLife[i])
+            spawnCpu(i, glm::vec3(mEmitters[i % mDroneCount]), strength);
+
+        float* out = &mUpload[i * kParticleFloats];
+        out[0] = mPosX[i]; out[1] = mPosY[i]; out[2] = mPosZ[i]; out[3] = mAge[i];
+        out[4] = mVelX[i]; out[5] = mVelY[i]; out[6] = mVelZ[i]; out[7] = mLife[i];
+    }
+#endif
+
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffers[0]);
+    RenderStats::bufferData(GL_ARRAY_BUFFER, mUpload.size() * sizeof(float), nullptr, GL_STREAM_DRAW);
+    RenderStats::bufferSubData(GL_ARRAY_BUFFER, 0, mUpload.size() * sizeof(float), mUpload.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mCpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ParticleSystem::draw(GLuint program, const glm::mat4& projection, int viewportHeight)
+{
+    if (mCount == 0)
+        return;
+
+    RenderStats::useProgram(program);
+    RenderStats::uniform(glGetUniformLocation(program, "pointScale"), projection[1][1] * 0.5f * (float)viewportHeight);
+
+    RenderStats::enable(GL_PROGRAM_POINT_SIZE);
+    RenderStats::enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    RenderStats::bindVertexArray(mVAOs[mCurrent]);
+    RenderStats::drawArrays(GL_POINTS, 0, mCount);
+    RenderStats::bindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    RenderStats::disable(GL_BLEND);
+    RenderStats::disable(GL_PROGRAM_POINT_SIZE);
+}
+
+void ParticleSystem::cleanup()
+{
+    if (mVAOs[0] != 0)
+    {
+        glDeleteVertexArrays(2, mVAOs);
+        glDeleteBuffers(2, mBuffers);
+        mVAOs[0] = mVAOs[1] = mBuffers[0] = mBuffers[1] = 0;
+    }
+    if (mEmitterBuffer != 0)
+    {
+        glDeleteTextures(1, &mEmitterTexture);
+        glDeleteBuffers(1, &mEmitterBuffer);
+        mEmitterTexture = mEmitterBuffer = 0;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "DroneModel.h"
+
+/**
+ * ParticleSystem simulates rotor downwash and the dust it kicks up.
+ *
+ * A fixed pool of particles is shared out among the drones (particle i
+ * belongs to drone i % fleet size). A particle is blown down from its
+ * drone's rotors at a speed set by the propeller speed, slows with drag,
+ * turns outward into dust when it reaches the ground and respawns at its
+ * drone when its life runs out. The only per-frame upload is one emitter
+ * (position, strength) per drone.
+ *
+ * Two ways to step the pool:
+ *  - GPU: a vertex shader with transform feedback reads one buffer and
+ *    writes the other (ping-pong) with rasterization off, so the
+ *    particles never touch the CPU, however many there are.
+ *  - CPU: the same simulation over structure-of-arrays data, four
+ *    particles at a time with SSE, then uploaded for drawing. Used
+ *    headless, or when the feedback program is unavailable.
+ *
+ * Either way the particles are drawn as blended, depth-tested round
+ * points, after a viewport's opaque geometry like the trails.
+ */
+class ParticleSystem
+{
+public:
+    ParticleSystem();
+    ~ParticleSystem();
+
+    // updateProgram: the transform feedback program (0 = step on the CPU)
+    void init(int particleCount, int droneCount, GLuint updateProgram);
+
+    // Replace a relinked feedback program; the CPU path stays on the CPU
+    void setUpdateProgram(GLuint program) { if (mUpdateProgram && program) mUpdateProgram = program; }
+
+    // Step every particle by dt; propSpeed in deg/s drives emission
+    void update(const std::vector<DroneModel>& fleet, float propSpeed, float dt);
+
+    // Draw the particles; program must have view and projection set
+    void draw(GLuint program, const glm::mat4& projection, int viewportHeight);
+
+    void cleanup();
+
+    bool   isGpu() const    { return mUpdateProgram != 0; }
+    int    getCount() const { return mCount; }
+    double getCpuMs() const { return mCpuMs; }
+
+private:
+    void updateCpu(float strength, float dt);
+    void spawnCpu(size_t i, const glm::vec3& emitter, float strength);
+
+private:
+    int    mCount;
+    int    mDroneCount;
+    GLuint mUpdateProgram;
+    GLuint mBuffers[2];    // particle state: position, age, velocity, life
+    GLuint mVAOs[2];       // reading mBuffers[i]
+    int    mCurrent;       // buffer holding the latest state
+    GLuint mEmitterBuffer;
+    GLuint mEmitterTexture;
+    unsigned mFrame;
+    double mCpuMs;
+
+    std::vector<glm::vec4> mEmitters;
+
+    // CPU state, one array per component
+    std::vector<float> mPosX, mPosY, mPosZ, mAge;
+    std::vector<float> mVelX, mVelY, mVelZ, mLife;
+    std::vector<float> mUpload;
+    uint32_t           mRandom;
+};
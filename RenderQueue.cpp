@@ -0,0 +1,188 @@
+#include "RenderQueue.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cstring>
+
+// Bits given to each field of the sort key
+static const int kProgramBits  = 8;
+static const int kVaoBits      = 16;
+static const int kMaterialBits = 16;
+static const int kDepthBits    = 24;
+
+RenderQueue::RenderQueue()
+    : mFarPlane(1000.f)
+{
+    std::memset(&mStats, 0, sizeof(mStats));
+}
+
+int RenderQueue::registerMaterial(const util::Material& material)
+{
+    mMaterials.push_back(material);
+    return (int)mMaterials.size() - 1;
+}
+
+int RenderQueue::slotFor(std::map<GLuint,int>& slots, GLuint id, int bits)
+{
+    std::map<GLuint,int>::iterator it = slots.find(id);
+    if (it != slots.end())
+        return it->second;
+
+    // Slots only need to keep equal names together, so wrapping around
+    // (more names than the field can hold) costs sorting quality, not
+    // correctness.
+    int slot = (int)slots.size() & ((1 << bits) - 1);
+    slots[id] = slot;
+    return slot;
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem& item, float viewDepth)
+{
+    uint64_t program  = (uint64_t)slotFor(mProgramSlots, item.program, kProgramBits);
+    uint64_t vao      = (uint64_t)slotFor(mVaoSlots, item.vao, kVaoBits);
+    uint64_t material = (uint64_t)item.material & ((1u << kMaterialBits) - 1);
+
+    float d = std::min(std::max(viewDepth / mFarPlane, 0.f), 1.f);
+    uint64_t depth = (uint64_t)(d * (float)((1u << kDepthBits) - 1));
+
+    return (program  << (kVaoBits + kMaterialBits + kDepthBits))
+         | (vao      << (kMaterialBits + kDepthBits))
+         | (material << kDepthBits)
+         | depth;
+}
+
+void RenderQueue::submit(const DrawItem& item, float viewDepth)
+{
+    SortEntry entry;
+    entry.key   = makeKey(item, viewDepth);
+    entry.index = (uint32_t)mItems.size();
+
+    mItems.push_back(item);
+    mEntries.push_back(entry);
+}
+
+void RenderQueue::radixSort()
+{
+    // LSD radix sort, one byte per pass. A pass where every key has the
+    // same byte would not move anything, so it is skipped; with few
+    // programs/VAOs/materials most of the high bytes are skipped this way.
+    size_t n = mEntries.size();
+    mScratch.resize(n);
+
+    for(int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = { 0 };
+        for(size_t i = 0; i < n; i++)
+            counts[(mEntries[i].key >> shift) & 0xFF]++;
+
+        if (counts[(mEntries[0].key >> shift) & 0xFF] == n)
+            continue;
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for(int b = 0; b < 256; b++)
+        {
+            offsets[b] = sum;
+            sum += counts[b];
+        }
+
+        for(size_t i = 0; i < n; i++)
+            mScratch[offsets[(mEntries[i].key >> shift) & 0xFF]++] = mEntries[i];
+
+        mEntries.swap(mScratch);
+    }
+}
+
+const RenderQueue::ProgramLocations& RenderQueue::locationsFor(GLuint program)
+{
+    std::map<GLuint,ProgramLocations>::iterator it = mLocations.find(program);
+    if (it != mLocations.end())
+        return it->second;
+
+    ProgramLocations& loc = mLocations[program];
+    loc.model     = glGetUniformLocation(program, "model");
+    loc.ambient   = glGetUniformLocation(program, "material.ambient");
+    loc.diffuse   = glGetUniformLocation(program, "material.diffuse");
+    loc.specular  = glGetUniformLocation(program, "material.specular");
+    loc.shininess = glGetUniformLocation(program, "material.shininess");
+    return loc;
+}
+
+void RenderQueue::flush()
+{
+    std::memset(&mStats, 0, sizeof(mStats));
+    mStats.items = (int)mItems.size();
+
+    if (!mItems.empty())
+    {
+        radixSort();
+
+        GLuint curProgram  = 0;
+        GLuint curVao      = 0;
+        int    curMaterial = -1;
+        const ProgramLocations* loc = 0;
+        bool   first = true;
+
+        for(size_t i = 0; i < mEntries.size(); i++)
+        {
+            const DrawItem& item = mItems[mEntries[i].index];
+
+            if (first || item.program != curProgram)
+            {
+                RenderStats::useProgram(item.program);
+                curProgram = item.program;
+                loc = &locationsFor(curProgram);
+                curMaterial = -1; // uniforms belong to the program
+                mStats.programChanges++;
+            }
+            if (first || item.vao != curVao)
+            {
+                RenderStats::bindVertexArray(item.vao);
+                curVao = item.vao;
+                mStats.vaoChanges++;
+            }
+            if (item.material != curMaterial)
+            {
+                const util::Material& mat = mMaterials[item.material];
+                if (loc->diffuse >= 0)
+                {
+                    glm::vec4 ambient  = mat.getAmbient();
+                    glm::vec4 diffuse  = mat.getDiffuse();
+                    glm::vec4 specular = mat.getSpecular();
+                    RenderStats::uniform(loc->ambient, glm::vec3(ambient));
+                    RenderStats::uniform(loc->diffuse, glm::vec3(diffuse));
+                    RenderStats::uniform(loc->specular, glm::vec3(specular));
+                    RenderStats::uniform(loc->shininess, mat.getShininess());
+                }
+                curMaterial = item.material;
+                mStats.materialChanges++;
+            }
+            first = false;
+
+            RenderStats::uniform(loc->model, item.model);
+
+            const void* firstIndex = (const void*)(sizeof(GLuint) * item.first);
+            if (item.instanceCount > 0)
+            {
+                if (item.indexed)
+                    RenderStats::drawElementsInstanced(item.primitive, item.count, GL_UNSIGNED_INT,
+                                            firstIndex, item.instanceCount);
+                else
+                    RenderStats::drawArraysInstanced(item.primitive, item.first, item.count, item.instanceCount);
+            }
+            else if (item.indexed)
+                RenderStats::drawElements(item.primitive, item.count, GL_UNSIGNED_INT, firstIndex);
+            else
+                RenderStats::drawArrays(item.primitive, item.first, item.count);
+        }
+
+        // Leave no VAO bound, as the individual draws used to
+        RenderStats::bindVertexArray(0);
+    }
+
+    mStats.programChangesAvoided  = mStats.items - mStats.programChanges;
+    mStats.vaoChangesAvoided      = mStats.items - mStats.vaoChanges;
+    mStats.materialChangesAvoided = mStats.items - mStats.materialChanges;
+
+    mItems.clear();
+    mEntries.clear();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "Material.h"
+
+/**
+ * One draw call waiting in the RenderQueue.
+ */
+struct DrawItem
+{
+    GLuint    program       = 0;
+    GLuint    vao           = 0;
+    GLenum    primitive     = GL_TRIANGLES; // GL_TRIANGLES, GL_POINTS, ...
+    bool      indexed       = false; // glDrawElements (GL_UNSIGNED_INT) or glDrawArrays
+    GLint     first         = 0;     // first vertex, or first index when indexed
+    GLsizei   count         = 0;
+    GLsizei   instanceCount = 0;     // > 0: instanced draw, per-instance data in the VAO
+    int       material      = 0;     // id from RenderQueue::registerMaterial
+    glm::mat4 model         = glm::mat4(1.f);
+};
+
+/**
+ * Counters from the last flush. "Avoided" is measured against drawing
+ * every item on its own: use program, bind VAO, set material, draw.
+ */
+struct RenderQueueStats
+{
+    int items;
+    int programChanges;
+    int vaoChanges;
+    int materialChanges;
+    int programChangesAvoided;
+    int vaoChangesAvoided;
+    int materialChangesAvoided;
+};
+
+/**
+ * RenderQueue collects a frame's draws, sorts them by a 64-bit key and
+ * issues them with redundant GL state changes skipped.
+ *
+ * Key layout, most significant first:
+ *   [63..56] program   [55..40] VAO   [39..24] material   [23..0] depth
+ * so draws are grouped by program, then VAO, then material, and drawn
+ * front to back inside a group.
+ *
+ * Programs must have a "model" (mat4) uniform. A material change sets
+ * "material.ambient", "material.diffuse", "material.specular" and
+ * "material.shininess" on programs that have them. Everything else (view,
+ * projection, lights) is left to the caller.
+ */
+class RenderQueue
+{
+public:
+    RenderQueue();
+
+    // Materials are registered once and referred to by id afterwards
+    int registerMaterial(const util::Material& material);
+    const util::Material& getMaterial(int id) const { return mMaterials[id]; }
+
+    // View-space distance mapped to the far end of the depth bits
+    void setFarPlane(float farPlane) { mFarPlane = farPlane; }
+    float getFarPlane() const        { return mFarPlane; }
+
+    // Queue a draw; viewDepth is its distance in front of the camera
+    void submit(const DrawItem& item, float viewDepth);
+
+    // Sort and execute everything submitted since the last flush
+    void flush();
+
+    // Drop uniform locations looked up per program (after a relink)
+    void forgetPrograms() { mLocations.clear(); }
+
+    const RenderQueueStats& getStats() const { return mStats; }
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // Uniform locations looked up once per program
+    struct ProgramLocations
+    {
+        GLint model;
+        GLint ambient;
+        GLint diffuse;
+        GLint specular;
+        GLint shininess;
+    };
+
+    uint64_t makeKey(const DrawItem& item, float viewDepth);
+    int      slotFor(std::map<GLuint,int>& slots, GLuint id, int bits);
+    void     radixSort();
+    const ProgramLocations& locationsFor(GLuint program);
+
+private:
+    std::vector<DrawItem>       mItems;
+    std::vector<SortEntry>      mEntries;
+    std::vector<SortEntry>      mScratch;
+    std::vector<util::Material> mMaterials;
+
+    // GL names are squeezed into a few key bits through these tables
+    std::map<GLuint,int> mProgramSlots;
+    std::map<GLuint,int> mVaoSlots;
+    std::map<GLuint,ProgramLocations> mLocations;
+
+    float            mFarPlane;
+    RenderQueueStats mStats;
+};
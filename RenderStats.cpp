@@ -0,0 +1,33 @@
+#include "RenderStats.h"
+#include <cstring>
+
+FrameStats RenderStats::sCurrent = FrameStats();
+FrameStats RenderStats::sLast    = FrameStats();
+
+void RenderStats::beginFrame()
+{
+    std::memset(&sCurrent, 0, sizeof(sCurrent));
+}
+
+void RenderStats::endFrame(double cpuMs, double gpuMs)
+{
+    sCurrent.cpuMs = cpuMs;
+    sCurrent.gpuMs = gpuMs;
+    sLast = sCurrent;
+}
+
+void RenderStats::countDraw(GLenum mode, GLsizei count, GLsizei instances)
+{
+    long long primitives;
+    switch(mode)
+    {
+    case GL_POINTS:         primitives = count;                      break;
+    case GL_LINES:          primitives = count / 2;                  break;
+    case GL_LINE_STRIP:     primitives = count > 1 ? count - 1 : 0;  break;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:   primitives = count > 2 ? count - 2 : 0;  break;
+    default:                primitives = count / 3;                  break;
+    }
+    sCurrent.drawCalls++;
+    sCurrent.primitives += primitives * instances;
+}
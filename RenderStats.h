@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+/**
+ * What one frame cost: counted by the RenderStats wrappers, timed by main.
+ */
+struct FrameStats
+{
+    int       drawCalls;
+    long long primitives;    // triangles, lines or points drawn
+    int       uniformCalls;
+    long long uploadBytes;   // buffer and texture data sent to the GPU
+    int       stateChanges;  // program, VAO, texture and framebuffer binds, capability toggles
+    double    cpuMs;         // loop start to swap
+    double    gpuMs;         // GpuTimer's frame total, negative if dropped
+};
+
+/**
+ * RenderStats counts the GL work of a frame. The renderers issue their
+ * per-frame draws, uniform uploads, buffer uploads and binds through the
+ * wrappers below, which forward to GL and count; setup code calls GL
+ * directly.
+ *
+ * Per frame:
+ *   RenderStats::beginFrame();   ... render ...
+ *   RenderStats::endFrame(cpuMs, gpuMs);
+ * after which getLastFrame() holds that frame's numbers.
+ */
+class RenderStats
+{
+public:
+    static void beginFrame();
+    static void endFrame(double cpuMs, double gpuMs);
+    static const FrameStats& getLastFrame() { return sLast; }
+
+    // Draws
+    static void drawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        glDrawArrays(mode, first, count);
+        countDraw(mode, count, 1);
+    }
+    static void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+    {
+        glDrawArraysInstanced(mode, first, count, instances);
+        countDraw(mode, count, instances);
+    }
+    static void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        glDrawElements(mode, count, type, indices);
+        countDraw(mode, count, 1);
+    }
+    static void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                      GLsizei instances)
+    {
+        glDrawElementsInstanced(mode, count, type, indices, instances);
+        countDraw(mode, count, instances);
+    }
+
+    // Uniforms, by value type
+    static void uniform(GLint loc, int v)                { glUniform1i(loc, v);  sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, unsigned v)           { glUniform1ui(loc, v); sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, float v)              { glUniform1f(loc, v);  sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, const glm::vec2& v)   { glUniform2f(loc, v.x, v.y); sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, const glm::vec3& v)   { glUniform3f(loc, v.x, v.y, v.z); sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, const glm::ivec3& v)  { glUniform3i(loc, v.x, v.y, v.z); sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, const glm::vec4& v)   { glUniform4f(loc, v.x, v.y, v.z, v.w); sCurrent.uniformCalls++; }
+    static void uniform(GLint loc, const glm::mat4& m)
+    {
+        glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(m));
+        sCurrent.uniformCalls++;
+    }
+    static void uniform(GLint loc, const glm::vec3* v, int count)
+    {
+        glUniform3fv(loc, count, glm::value_ptr(v[0]));
+        sCurrent.uniformCalls++;
+    }
+
+    // Uploads
+    static void bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        glBufferData(target, size, data, usage);
+        if (data)
+            sCurrent.uploadBytes += size;
+    }
+    static void bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        glBufferSubData(target, offset, size, data);
+        sCurrent.uploadBytes += size;
+    }
+    // Data written straight into mapped memory
+    static void countUpload(long long bytes) { sCurrent.uploadBytes += bytes; }
+
+    // State
+    static void useProgram(GLuint program)               { glUseProgram(program); sCurrent.stateChanges++; }
+    static void bindVertexArray(GLuint vao)              { glBindVertexArray(vao); sCurrent.stateChanges++; }
+    static void bindTexture(GLenum target, GLuint tex)   { glBindTexture(target, tex); sCurrent.stateChanges++; }
+    static void bindFramebuffer(GLenum target, GLuint f) { glBindFramebuffer(target, f); sCurrent.stateChanges++; }
+    static void enable(GLenum cap)                       { glEnable(cap); sCurrent.stateChanges++; }
+    static void disable(GLenum cap)                      { glDisable(cap); sCurrent.stateChanges++; }
+
+private:
+    static void countDraw(GLenum mode, GLsizei count, GLsizei instances);
+
+    static FrameStats sCurrent;
+    static FrameStats sLast;
+};
@@ -1,5 +1,6 @@
 #include "ShaderProgram.h"
 #include <iostream>
+#include <string>
 
 // Compile a single shader from given source
 static GLuint compileShader(GLenum type, const char* source)
@@ -20,8 +21,17 @@ static GLuint compileShader(GLenum type, const char* source)
     return shader;
 }
 
-GLuint createShaderProgram(const char* vertexSrc, const char* fragmentSrc)
+GLuint createShaderProgram(const char* vertexSrc, const char* fragmentSrc,
+                           util::ProgramBinaryCache* cache)
 {
+    // Skip compiling entirely if this exact program was linked before
+    if (cache)
+    {
+        GLuint cached = cache->load(vertexSrc, fragmentSrc);
+        if (cached)
+            return cached;
+    }
+
     GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSrc);
     GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSrc);
 
@@ -29,6 +39,8 @@ GLuint createShaderProgram(const char* vertexSrc, const char* fragmentSrc)
     GLuint program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    if (cache)
+        cache->prepare(program);
     glLinkProgram(program);
 
     // Check for link errors
@@ -40,9 +52,52 @@ GLuint createShaderProgram(const char* vertexSrc, const char* fragmentSrc)
         glGetProgramInfoLog(program, 512, nullptr, infoLog);
         std::cerr << "ERROR::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
+    else if (cache)
+        cache->store(program, vertexSrc, fragmentSrc);
 
     glDeleteShader(vs);
     glDeleteShader(fs);
 
     return program;
 }
+
+GLuint createFeedbackProgram(const char* vertexSrc, const char* const* varyings, int varyingCount,
+                             util::ProgramBinaryCache* cache)
+{
+    // The captured varyings are part of the linked program, so they key
+    // the cache where a fragment shader would
+    std::string feedback = "transform feedback:";
+    for(int i = 0; i < varyingCount; i++)
+        feedback += std::string(" ") + varyings[i];
+
+    if (cache)
+    {
+        GLuint cached = cache->load(vertexSrc, feedback);
+        if (cached)
+            return cached;
+    }
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSrc);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glTransformFeedbackVaryings(program, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+    if (cache)
+        cache->prepare(program);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success)
+    {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cerr << "ERROR::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    if (cache)
+        cache->store(program, vertexSrc, feedback);
+    return program;
+}
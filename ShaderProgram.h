@@ -1,8 +1,19 @@
 #pragma once
 #include <glad/glad.h>
+#include "ProgramBinaryCache.h"
 
 /**
  * Given vertex and fragment shader source code, compile & link an OpenGL shader program.
  * Returns the program ID (GLuint). On errors, logs to stderr.
+ * With a cache, a program linked on an earlier run is loaded from its binary instead.
  */
-GLuint createShaderProgram(const char* vertexSrc, const char* fragmentSrc);
+GLuint createShaderProgram(const char* vertexSrc, const char* fragmentSrc,
+                           util::ProgramBinaryCache* cache = nullptr);
+
+/**
+ * A vertex-shader-only program whose outputs are captured with transform
+ * feedback (interleaved, in the order given) rather than rasterized.
+ * Returns 0 if it does not link.
+ */
+GLuint createFeedbackProgram(const char* vertexSrc, const char* const* varyings, int varyingCount,
+                             util::ProgramBinaryCache* cache = nullptr);
@@ -0,0 +1,277 @@
+#include "ShaderReloader.h"
+#include "ShaderProgram.h"
+#include "GLExtensions.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderReloader::ShaderReloader()
+    : mCache(nullptr)
+    , mWatchFd(-1)
+    , mWatch(-1)
+{
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    cleanup();
+}
+
+void ShaderReloader::init(const std::string& dir, util::ProgramBinaryCache* cache)
+{
+    mDir = dir;
+    mCache = cache;
+    if (mDir.empty())
+        return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(mDir, ec);
+
+#ifdef __linux__
+    mWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    if (mWatchFd < 0)
+        std::cerr << "Cannot watch " << mDir << ", shaders are read from it once\n";
+    else
+        std::cout << "Watching " << mDir << " for shader edits"
+                  << (gGLExt.parallelShaderCompile ? " (compiled in the background)" : "") << std::endl;
+
+    // Let the driver pick how many threads compile
+    if (gGLExt.parallelShaderCompile)
+        gGLExt.MaxShaderCompilerThreads(0xFFFFFFFFu);
+}
+
+const std::string& ShaderReloader::sourceFor(const std::string& name, const char* builtIn)
+{
+    std::map<std::string,std::string>::iterator it = mSources.find(name);
+    if (it != mSources.end())
+        return it->second;
+
+    std::string& source = mSources[name];
+    source = builtIn;
+    if (mDir.empty())
+        return source;
+
+    std::string path = mDir + "/" + name;
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (in)
+    {
+        std::stringstream text;
+        text << in.rdbuf();
+        source = text.str();
+    }
+    else
+    {
+        std::ofstream out(path.c_str(), std::ios::binary);
+        out << source;
+    }
+    return source;
+}
+
+const GLuint& ShaderReloader::load(const char* vertexName, const char* vertexSrc,
+                                   const char* fragmentName, const char* fragmentSrc)
+{
+    Program program = {};
+    program.vertexName   = vertexName;
+    program.fragmentName = fragmentName;
+    program.id = createShaderProgram(sourceFor(vertexName, vertexSrc).c_str(),
+                                     sourceFor(fragmentName, fragmentSrc).c_str(), mCache);
+    mPrograms.push_back(program);
+    return mPrograms.back().id;
+}
+
+const GLuint& ShaderReloader::loadFeedback(const char* vertexName, const char* vertexSrc,
+                                           const char* const* varyings, int varyingCount)
+{
+    Program program = {};
+    program.vertexName = vertexName;
+    program.varyings.assign(varyings, varyings + varyingCount);
+    program.id = createFeedbackProgram(sourceFor(vertexName, vertexSrc).c_str(),
+                                       varyings, varyingCount, mCache);
+    mPrograms.push_back(program);
+    return mPrograms.back().id;
+}
+
+void ShaderReloader::readChanges(std::vector<std::string>& changed)
+{
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    for(;;)
+    {
+        ssize_t length = read(mWatchFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break; // EAGAIN: nothing more this frame
+
+        for(ssize_t at = 0; at < length; )
+        {
+            const inotify_event* event = (const inotify_event*)(buffer + at);
+            if (event->len > 0)
+            {
+                std::string name = event->name;
+                // Only stages in use; editors' swap and backup files are ignored
+                if (mSources.count(name) && std::find(changed.begin(), changed.end(), name) == changed.end())
+                    changed.push_back(name);
+            }
+            at += sizeof(inotify_event) + event->len;
+        }
+    }
+#else
+    (void)changed;
+#endif
+}
+
+void ShaderReloader::startLink(Program& program)
+{
+    dropPending(program);
+
+    const char* vertexSrc = mSources[program.vertexName].c_str();
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 1, &vertexSrc, nullptr);
+    glCompileShader(vs);
+    program.pendingShaders[0] = vs;
+
+    program.pending = glCreateProgram();
+    glAttachShader(program.pending, vs);
+    if (program.fragmentName.empty())
+    {
+        std::vector<const char*> varyings;
+        for(size_t i = 0; i < program.varyings.size(); i++)
+            varyings.push_back(program.varyings[i].c_str());
+        glTransformFeedbackVaryings(program.pending, (GLsizei)varyings.size(), varyings.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
+    else
+    {
+        const char* fragmentSrc = mSources[program.fragmentName].c_str();
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &fragmentSrc, nullptr);
+        glCompileShader(fs);
+        glAttachShader(program.pending, fs);
+        program.pendingShaders[1] = fs;
+    }
+    // No status queries here: with parallel compile that would wait
+    glLinkProgram(program.pending);
+}
+
+bool ShaderReloader::finishLink(Program& program)
+{
+    if (gGLExt.parallelShaderCompile)
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(program.pending, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done)
+            return false;
+    }
+
+    std::string name = program.vertexName;
+    if (!program.fragmentName.empty())
+        name += " + " + program.fragmentName;
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program.pending, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        char infoLog[1024];
+        std::cerr << "Shader reload: " << name << " failed, keeping the old program\n";
+        for(int i = 0; i < 2; i++)
+        {
+            GLint compiled = GL_TRUE;
+            if (program.pendingShaders[i])
+                glGetShaderiv(program.pendingShaders[i], GL_COMPILE_STATUS, &compiled);
+            if (!compiled)
+            {
+                glGetShaderInfoLog(program.pendingShaders[i], sizeof(infoLog), nullptr, infoLog);
+                std::cerr << (i == 0 ? program.vertexName : program.fragmentName) << ": " << infoLog << "\n";
+            }
+        }
+        glGetProgramInfoLog(program.pending, sizeof(infoLog), nullptr, infoLog);
+        std::cerr << infoLog << std::endl;
+        dropPending(program);
+        return false;
+    }
+
+    // The old program may still be in flight; GL frees it once it is not
+    glDeleteProgram(program.id);
+    program.id = program.pending;
+    program.pending = 0;
+    dropPending(program);
+    std::cout << "Shader reload: " << name << " relinked" << std::endl;
+    return true;
+}
+
+void ShaderReloader::dropPending(Program& program)
+{
+    if (program.pending)
+        glDeleteProgram(program.pending);
+    program.pending = 0;
+    for(int i = 0; i < 2; i++)
+    {
+        if (program.pendingShaders[i])
+            glDeleteShader(program.pendingShaders[i]);
+        program.pendingShaders[i] = 0;
+    }
+}
+
+bool ShaderReloader::update()
+{
+    if (mWatchFd < 0)
+        return false;
+
+#ifdef __linux__
+    // Watch from the first frame on, so writing out missing built-in
+    // sources during load() does not count as an edit. Editors either
+    // rewrite a file in place or save a new one over it.
+    if (mWatch < 0)
+    {
+        mWatch = inotify_add_watch(mWatchFd, mDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (mWatch < 0)
+        {
+            std::cerr << "Cannot watch " << mDir << ", shaders are read from it once\n";
+            close(mWatchFd);
+            mWatchFd = -1;
+        }
+        return false;
+    }
+#endif
+
+    std::vector<std::string> changed;
+    readChanges(changed);
+    for(size_t i = 0; i < changed.size(); i++)
+    {
+        std::ifstream in((mDir + "/" + changed[i]).c_str(), std::ios::binary);
+        if (!in)
+            continue;
+        std::stringstream text;
+        text << in.rdbuf();
+        mSources[changed[i]] = text.str();
+
+        for(size_t p = 0; p < mPrograms.size(); p++)
+            if (mPrograms[p].vertexName == changed[i] || mPrograms[p].fragmentName == changed[i])
+                startLink(mPrograms[p]);
+    }
+
+    bool swapped = false;
+    for(size_t p = 0; p < mPrograms.size(); p++)
+        if (mPrograms[p].pending && finishLink(mPrograms[p]))
+            swapped = true;
+    return swapped;
+}
+
+void ShaderReloader::cleanup()
+{
+    for(size_t p = 0; p < mPrograms.size(); p++)
+        dropPending(mPrograms[p]);
+#ifdef __linux__
+    if (mWatchFd >= 0)
+        close(mWatchFd);
+#endif
+    mWatchFd = -1;
+    mWatch = -1;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "ProgramBinaryCache.h"
+
+/**
+ * ShaderReloader links the app's shader programs and, given a directory,
+ * relinks them when their sources are edited there.
+ *
+ * Every shader stage has a file name ("drone.vert", "forward.frag", ...)
+ * and a built-in source. Without a directory the built-in sources are
+ * used. With one, each stage is read from its file there (the built-in
+ * source is written out first if the file is missing), and the directory
+ * is watched with inotify.
+ *
+ * When a file is saved, update() starts relinking every program that uses
+ * it. With KHR_parallel_shader_compile the compile and link run on driver
+ * threads and update() polls GL_COMPLETION_STATUS_KHR each frame, so the
+ * render loop never waits on them; without it they finish on the spot. A
+ * program is replaced only once its new version has linked: load()
+ * returns a reference the ID is swapped into between frames, and a failed
+ * edit just prints the log and keeps the old program running.
+ *
+ * Per frame:
+ *   if (reloader.update())   ... forget anything cached per program ID ...
+ */
+class ShaderReloader
+{
+public:
+    ShaderReloader();
+    ~ShaderReloader();
+
+    // dir: where stage files live and are watched ("" = built-in sources only)
+    void init(const std::string& dir, util::ProgramBinaryCache* cache);
+
+    // Link a program from two stages; the reference follows reloads
+    const GLuint& load(const char* vertexName, const char* vertexSrc,
+                       const char* fragmentName, const char* fragmentSrc);
+
+    // Link a vertex-only transform feedback program (0 if it fails)
+    const GLuint& loadFeedback(const char* vertexName, const char* vertexSrc,
+                               const char* const* varyings, int varyingCount);
+
+    // Start relinking programs whose files changed and swap in the ones
+    // that finished; true if any program ID changed
+    bool update();
+
+    void cleanup();
+
+    bool isWatching() const { return mWatchFd >= 0; }
+
+    // Programs loaded so far
+    int getProgramCount() const { return (int)mPrograms.size(); }
+
+private:
+    struct Program
+    {
+        GLuint id;
+        std::string vertexName;
+        std::string fragmentName;   // empty for transform feedback
+        std::vector<std::string> varyings;
+        GLuint pending;             // relinking, swapped in when it succeeds
+        GLuint pendingShaders[2];
+    };
+
+    const std::string& sourceFor(const std::string& name, const char* builtIn);
+    void readChanges(std::vector<std::string>& changed);
+    void startLink(Program& program);
+    bool finishLink(Program& program);
+    void dropPending(Program& program);
+
+private:
+    std::string mDir;
+    util::ProgramBinaryCache* mCache;
+    int mWatchFd;    // inotify instance
+    int mWatch;      // its watch on mDir, added by the first update()
+    std::map<std::string,std::string> mSources;   // stage file name -> source
+    std::deque<Program> mPrograms;                // deque: references stay valid
+};
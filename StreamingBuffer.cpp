@@ -0,0 +1,176 @@
+#include "StreamingBuffer.h"
+#include "GLExtensions.h"
+#include "RenderStats.h"
+
+// Allocations start on this boundary (enough for any vertex attribute)
+static const GLsizeiptr kAlignment = 16;
+
+StreamingBuffer::StreamingBuffer()
+    : mBuffer(0)
+    , mRegionSize(0)
+    , mAllowPersistent(true)
+    , mPersistent(false)
+    , mPersistentPtr(nullptr)
+    , mMappedPtr(nullptr)
+    , mRegion(0)
+    , mRegionUsed(0)
+    , mOrphanCount(0)
+{
+    for(int i = 0; i < kRegionCount; i++)
+        mFences[i] = 0;
+}
+
+StreamingBuffer::~StreamingBuffer()
+{
+    cleanup();
+}
+
+void StreamingBuffer::init(GLsizeiptr regionSize, bool allowPersistent)
+{
+    mAllowPersistent = allowPersistent;
+    createStorage(regionSize);
+}
+
+void StreamingBuffer::createStorage(GLsizeiptr regionSize)
+{
+    cleanup();
+
+    mRegionSize = (regionSize + kAlignment - 1) / kAlignment * kAlignment;
+    mPersistent = mAllowPersistent && gGLExt.bufferStorage;
+
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+
+    if (mPersistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gGLExt.BufferStorage(GL_ARRAY_BUFFER, mRegionSize * kRegionCount, nullptr, flags);
+        mPersistentPtr = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, mRegionSize * kRegionCount, flags);
+        if (!mPersistentPtr)
+        {
+            // Storage that won't map is no use to us, and can't be
+            // respecified; use a new buffer on the fallback path from now on
+            mAllowPersistent = false;
+            mPersistent = false;
+            glDeleteBuffers(1, &mBuffer);
+            glGenBuffers(1, &mBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+        }
+    }
+
+    if (!mPersistent)
+        glBufferData(GL_ARRAY_BUFFER, mRegionSize * kRegionCount, nullptr, GL_STREAM_DRAW);
+
+    // Start on the last region so the first beginFrame lands on region 0
+    mRegion = kRegionCount - 1;
+    mRegionUsed = 0;
+}
+
+void StreamingBuffer::beginFrame(GLsizeiptr bytesNeeded)
+{
+    // Outgrown: start over with bigger storage. Deleting the old buffer is
+    // safe, GL keeps it alive until pending draws are done with it.
+    if (bytesNeeded > mRegionSize)
+        createStorage(bytesNeeded + bytesNeeded / 2);
+
+    mRegion = (mRegion + 1) % kRegionCount;
+    mRegionUsed = 0;
+
+    GLsync fence = mFences[mRegion];
+    if (!fence)
+        return;
+
+    mFences[mRegion] = 0;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        // Hand the old storage to the driver and carry on with fresh
+        // storage; every region is free again.
+        mOrphanCount++;
+        if (mPersistent)
+        {
+            // Immutable storage can't be respecified, so replace the buffer.
+            // Deleting it is safe, as when growing.
+            int region = mRegion;
+            createStorage(mRegionSize);
+            mRegion = region;
+        }
+        else
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+            glBufferData(GL_ARRAY_BUFFER, mRegionSize * kRegionCount, nullptr, GL_STREAM_DRAW);
+            for(int i = 0; i < kRegionCount; i++)
+            {
+                if (mFences[i])
+                    glDeleteSync(mFences[i]);
+                mFences[i] = 0;
+            }
+        }
+    }
+    glDeleteSync(fence);
+}
+
+void* StreamingBuffer::allocate(GLsizeiptr bytes, GLintptr& offset)
+{
+    GLsizeiptr start = (mRegionUsed + kAlignment - 1) / kAlignment * kAlignment;
+    if (bytes <= 0 || start + bytes > mRegionSize)
+        return nullptr;
+
+    mRegionUsed = start + bytes;
+    offset = mRegion * mRegionSize + start;
+    RenderStats::countUpload(bytes);
+
+    if (mPersistent)
+        return mPersistentPtr + offset;
+
+    // Fallback: map just this range. The fence (or orphaning) in beginFrame
+    // already made sure the GPU is not reading it.
+    unmap();
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    mMappedPtr = (char*)glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                         GL_MAP_UNSYNCHRONIZED_BIT);
+    return mMappedPtr;
+}
+
+void StreamingBuffer::unmap()
+{
+    if (!mMappedPtr)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    mMappedPtr = nullptr;
+}
+
+void StreamingBuffer::endFrame()
+{
+    unmap();
+
+    if (mFences[mRegion])
+        glDeleteSync(mFences[mRegion]);
+    mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamingBuffer::cleanup()
+{
+    for(int i = 0; i < kRegionCount; i++)
+    {
+        if (mFences[i])
+            glDeleteSync(mFences[i]);
+        mFences[i] = 0;
+    }
+
+    if (mBuffer != 0)
+    {
+        unmap();
+        if (mPersistentPtr)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            mPersistentPtr = nullptr;
+        }
+        glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+
+/**
+ * StreamingBuffer is a GPU buffer for data rewritten every frame (instance
+ * transforms, impostor positions, ...), split into kRegionCount regions used
+ * round-robin: the CPU fills one region while the GPU may still be reading
+ * the previous ones. Each region is guarded by a glFenceSync placed after the
+ * frame's last draw from it.
+ *
+ * With ARB_buffer_storage the buffer is mapped once, persistently and
+ * coherently, and written in place. Otherwise writes go through
+ * glMapBufferRange(UNSYNCHRONIZED). Either way, if the region about to be
+ * reused is still in flight, the storage is orphaned (persistent storage is
+ * replaced) instead of waited on.
+ *
+ * Per frame:
+ *   beginFrame(bytes);  allocate(...) as often as needed;  unmap();
+ *   ... draws reading the data ...;  endFrame();
+ */
+class StreamingBuffer
+{
+public:
+    static const int kRegionCount = 3;
+
+    StreamingBuffer();
+    ~StreamingBuffer();
+
+    // Create the buffer with regionSize bytes per region
+    void init(GLsizeiptr regionSize, bool allowPersistent = true);
+
+    // Move to the next region; grows the buffer if bytesNeeded won't fit
+    void beginFrame(GLsizeiptr bytesNeeded);
+
+    // Reserve bytes in this frame's region. Returns where to write them and
+    // sets offset to their position in getBuffer(); null if the region is full.
+    void* allocate(GLsizeiptr bytes, GLintptr& offset);
+
+    // Finish writing before drawing (only does work on the fallback path)
+    void unmap();
+
+    // Fence the current region once every draw reading it has been issued
+    void endFrame();
+
+    void cleanup();
+
+    GLuint getBuffer() const    { return mBuffer; }
+    bool   isPersistent() const { return mPersistent; }
+
+    // Frames where the storage was orphaned because a region was still in use
+    int getOrphanCount() const { return mOrphanCount; }
+
+private:
+    void createStorage(GLsizeiptr regionSize);
+
+private:
+    GLuint     mBuffer;
+    GLsizeiptr mRegionSize;
+    bool       mAllowPersistent;
+    bool       mPersistent;
+    char*      mPersistentPtr;  // whole buffer, when persistent
+    char*      mMappedPtr;      // current allocation, fallback path
+    int        mRegion;
+    GLsizeiptr mRegionUsed;
+    GLsync     mFences[kRegionCount];
+    int        mOrphanCount;
+};
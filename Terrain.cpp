@@ -0,0 +1,350 @@
+#include "Terrain.h"
+#include "Frustum.h"
+#include "Material.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+// Size of a level 0 (finest) node; the terrain gets as many levels as it
+// takes to reach the requested size from here
+static const float kLeafSize = 64.f;
+
+// A level's LOD range, in node sizes of that level. Must stay above
+// sqrt(2) so a node's far corner never reaches two levels of morphing.
+static const float kLodRangeScale = 2.f;
+
+// Where in its range (0..1) a level starts morphing to the next one
+static const float kMorphStartRatio = 0.7f;
+
+// Morph range meaning "never"
+static const float kNoMorph = 1e30f;
+
+// Height tile cache, and tiles uploaded per frame at most
+static const int kMaxTileLayers     = 256;
+static const int kMaxUploadsPerFrame = 8;
+
+// Nodes drawn by one viewport at most
+static const int kMaxNodes     = 1024;
+static const int kMaxViewports = 4;
+
+// Texture unit of the height tiles (clusters use 1..3, the G-buffer 4..7)
+static const int kTileTextureUnit = 8;
+
+// Attribute locations
+static const int kGridLocation  = 0;
+static const int kNodeLocation  = 3;
+static const int kMorphLocation = 4;
+
+Terrain::Terrain()
+    : mSize(0.f)
+    , mLevels(0)
+    , mVAO(0)
+    , mVBO(0)
+    , mEBO(0)
+    , mNumIndices(0)
+    , mMaterial(0)
+    , mTileTexture(0)
+    , mLayerCount(0)
+    , mFrame(0)
+    , mCameraPos(0.f)
+{
+}
+
+Terrain::~Terrain()
+{
+    cleanup();
+}
+
+bool Terrain::init(float size, const std::string& cacheDir, RenderQueue& queue, bool persistentMapping)
+{
+    // Round up to a power-of-two number of leaves per side
+    mLevels = 1;
+    while (kLeafSize * (float)(1 << (mLevels - 1)) < size && mLevels < 20)
+        mLevels++;
+    mSize = kLeafSize * (float)(1 << (mLevels - 1));
+
+    mRanges.resize(mLevels);
+    for(int l = 0; l < mLevels; l++)
+        mRanges[l] = kLodRangeScale * nodeSize(l);
+
+    // Grid: (kGridSize + 1)^2 vertices over [0,1]^2
+    const int n = TerrainTiles::kGridSize;
+    std::vector<glm::vec2> verts;
+    std::vector<GLuint>    indices;
+    for(int j = 0; j <= n; j++)
+        for(int i = 0; i <= n; i++)
+            verts.push_back(glm::vec2((float)i / n, (float)j / n));
+    for(int j = 0; j < n; j++)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            GLuint a = j * (n + 1) + i, b = a + 1, c = a + (n + 1), d = c + 1;
+            GLuint quad[6] = { a, c, b, b, c, d };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    mNumIndices = (int)indices.size();
+
+    glGenVertexArrays(1, &mVAO);
+    glGenBuffers(1, &mVBO);
+    glGenBuffers(1, &mEBO);
+    glBindVertexArray(mVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(glm::vec2), verts.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(kGridLocation);
+    glVertexAttribPointer(kGridLocation, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    // Per-instance attributes; pointed at the streaming buffer per submit
+    glEnableVertexAttribArray(kNodeLocation);
+    glEnableVertexAttribArray(kMorphLocation);
+    glVertexAttribDivisor(kNodeLocation, 1);
+    glVertexAttribDivisor(kMorphLocation, 1);
+    glBindVertexArray(0);
+
+    mInstances.init(kMaxNodes * kMaxViewports * sizeof(NodeInstance), persistentMapping);
+
+    // Height tile cache
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    mLayerCount = std::min(kMaxTileLayers, (int)maxLayers);
+    glGenTextures(1, &mTileTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTileTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, TerrainTiles::kTileSamples, TerrainTiles::kTileSamples,
+                 mLayerCount, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    for(int i = mLayerCount - 1; i >= 0; i--)
+        mFreeLayers.push_back(i);
+
+    util::Material ground;
+    ground.setAmbient(0.3f, 0.3f, 0.3f);
+    ground.setDiffuse(1.f, 1.f, 1.f);
+    ground.setSpecular(0.05f, 0.05f, 0.05f);
+    ground.setShininess(8.f);
+    mMaterial = queue.registerMaterial(ground);
+
+    // Tiles are only valid for one terrain size, so each size caches apart.
+    // The root is always resident: without it there is nothing to draw.
+    mTiles.start(cacheDir + "/" + std::to_string((int)mSize), mSize, mLevels);
+    HeightTile root;
+    mTiles.loadNow(TerrainTiles::makeKey(mLevels - 1, 0, 0), root);
+    uploadTile(root);
+
+    return mTileTexture != 0;
+}
+
+Terrain::ResidentTile* Terrain::findResident(uint64_t key)
+{
+    std::map<uint64_t,ResidentTile>::iterator it = mResident.find(key);
+    return it == mResident.end() ? nullptr : &it->second;
+}
+
+void Terrain::requestTile(uint64_t key)
+{
+    if (mPending.insert(key).second)
+        mTiles.request(key);
+}
+
+void Terrain::uploadTile(const HeightTile& tile)
+{
+    mPending.erase(tile.key);
+
+    if (mFreeLayers.empty())
+    {
+        // Evict the least recently drawn tile, never the root or one the
+        // last frame drew (this frame will most likely want it again)
+        uint64_t rootKey = TerrainTiles::makeKey(mLevels - 1, 0, 0);
+        std::map<uint64_t,ResidentTile>::iterator victim = mResident.end();
+        for(std::map<uint64_t,ResidentTile>::iterator it = mResident.begin(); it != mResident.end(); ++it)
+        {
+            if (it->first == rootKey || it->second.lastUsed >= mFrame - 1)
+                continue;
+            if (victim == mResident.end() || it->second.lastUsed < victim->second.lastUsed)
+                victim = it;
+        }
+        if (victim == mResident.end())
+            return; // asked for again when still wanted
+        mFreeLayers.push_back(victim->second.layer);
+        mResident.erase(victim);
+    }
+
+    ResidentTile resident;
+    resident.layer     = mFreeLayers.back();
+    resident.minHeight = tile.minHeight;
+    resident.maxHeight = tile.maxHeight;
+    resident.lastUsed  = mFrame;
+    mFreeLayers.pop_back();
+
+    RenderStats::bindTexture(GL_TEXTURE_2D_ARRAY, mTileTexture);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, resident.layer,
+                    TerrainTiles::kTileSamples, TerrainTiles::kTileSamples, 1,
+                    GL_RED, GL_FLOAT, tile.heights.data());
+    RenderStats::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    mResident[tile.key] = resident;
+}
+
+void Terrain::beginFrame(int viewportCount)
+{
+    mFrame++;
+
+    HeightTile tile;
+    for(int i = 0; i < kMaxUploadsPerFrame && mTiles.poll(tile); i++)
+        uploadTile(tile);
+
+    mInstances.beginFrame(kMaxNodes * viewportCount * sizeof(NodeInstance));
+}
+
+static bool sphereTouchesBox(const glm::vec3& center, float radius,
+                             const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 d = center - glm::clamp(center, boxMin, boxMax);
+    return glm::dot(d, d) <= radius * radius;
+}
+
+void Terrain::addNode(int level, int x, int z, const ResidentTile& tile)
+{
+    if ((int)mSelected.size() >= kMaxNodes)
+        return;
+
+    float size = nodeSize(level);
+    NodeInstance inst;
+    inst.node = glm::vec4(-0.5f * mSize + x * size, -0.5f * mSize + z * size, size, (float)tile.layer);
+
+    // Morph to the parent's grid over the end of this level's range, then
+    // to the grandparent's over the end of the parent's
+    glm::vec2 stages[2];
+    for(int s = 0; s < 2; s++)
+    {
+        int l = level + s;
+        if (l >= mLevels - 1)
+            stages[s] = glm::vec2(kNoMorph, 2.f * kNoMorph);
+        else
+        {
+            float prev = l > 0 ? mRanges[l - 1] : 0.f;
+            stages[s] = glm::vec2(prev + (mRanges[l] - prev) * kMorphStartRatio, mRanges[l]);
+        }
+    }
+    inst.morph = glm::vec4(stages[0], stages[1]);
+    mSelected.push_back(inst);
+}
+
+void Terrain::selectNode(int level, int x, int z)
+{
+    ResidentTile* tile = findResident(TerrainTiles::makeKey(level, x, z));
+    if (!tile)
+        return;
+    tile->lastUsed = mFrame;
+
+    float size = nodeSize(level);
+    glm::vec3 boxMin(-0.5f * mSize + x * size, tile->minHeight, -0.5f * mSize + z * size);
+    glm::vec3 boxMax(boxMin.x + size, tile->maxHeight, boxMin.z + size);
+    if (!boxInFrustum(mFrustum, boxMin, boxMax))
+        return;
+
+    // Split when the children's range reaches this node, and all four are
+    // loaded; children always come as a set so neighbours differ by at
+    // most one level
+    if (level > 0 && sphereTouchesBox(mCameraPos, mRanges[level - 1], boxMin, boxMax))
+    {
+        bool ready = true;
+        for(int c = 0; c < 4; c++)
+        {
+            uint64_t key = TerrainTiles::makeKey(level - 1, 2 * x + (c & 1), 2 * z + (c >> 1));
+            ResidentTile* child = findResident(key);
+            if (child)
+                child->lastUsed = mFrame;
+            else
+            {
+                requestTile(key);
+                ready = false;
+            }
+        }
+
+        if (ready)
+        {
+            for(int c = 0; c < 4; c++)
+                selectNode(level - 1, 2 * x + (c & 1), 2 * z + (c >> 1));
+            return;
+        }
+    }
+
+    addNode(level, x, z, *tile);
+}
+
+void Terrain::submit(const glm::mat4& view, const glm::mat4& projection, GLuint program, RenderQueue& queue)
+{
+    extractFrustum(projection * view, mFrustum);
+    mCameraPos = glm::vec3(glm::inverse(view)[3]);
+
+    mSelected.clear();
+    selectNode(mLevels - 1, 0, 0);
+    if (mSelected.empty())
+        return;
+
+    GLintptr offset = 0;
+    void* dst = mInstances.allocate(mSelected.size() * sizeof(NodeInstance), offset);
+    if (!dst)
+        return;
+    std::memcpy(dst, mSelected.data(), mSelected.size() * sizeof(NodeInstance));
+    mInstances.unmap();
+
+    RenderStats::bindVertexArray(mVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mInstances.getBuffer());
+    glVertexAttribPointer(kNodeLocation, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance),
+                          (void*)(offset + offsetof(NodeInstance, node)));
+    glVertexAttribPointer(kMorphLocation, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance),
+                          (void*)(offset + offsetof(NodeInstance, morph)));
+    RenderStats::bindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0 + kTileTextureUnit);
+    RenderStats::bindTexture(GL_TEXTURE_2D_ARRAY, mTileTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    RenderStats::useProgram(program);
+    RenderStats::uniform(glGetUniformLocation(program, "heightTiles"), kTileTextureUnit);
+    RenderStats::uniform(glGetUniformLocation(program, "cameraPos"), mCameraPos);
+
+    // Keyed at the far plane: it covers most of the screen, so anything
+    // sharing its state should fill the depth buffer first
+    DrawItem item;
+    item.program       = program;
+    item.vao           = mVAO;
+    item.primitive     = GL_TRIANGLES;
+    item.indexed       = true;
+    item.count         = mNumIndices;
+    item.instanceCount = (GLsizei)mSelected.size();
+    item.material      = mMaterial;
+    queue.submit(item, queue.getFarPlane());
+}
+
+void Terrain::endFrame()
+{
+    mInstances.endFrame();
+}
+
+void Terrain::cleanup()
+{
+    mTiles.stop();
+    mInstances.cleanup();
+    if (mVAO != 0)
+    {
+        glDeleteVertexArrays(1, &mVAO);
+        glDeleteBuffers(1, &mVBO);
+        glDeleteBuffers(1, &mEBO);
+        glDeleteTextures(1, &mTileTexture);
+        mVAO = mVBO = mEBO = mTileTexture = 0;
+    }
+    mResident.clear();
+    mPending.clear();
+    mFreeLayers.clear();
+}
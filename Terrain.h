@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "RenderQueue.h"
+#include "StreamingBuffer.h"
+#include "TerrainTiles.h"
+
+/**
+ * Heightmap terrain drawn with CDLOD (continuous distance-dependent level
+ * of detail). The terrain is a quadtree: level 0 nodes are the finest,
+ * every node is drawn with the same kGridSize x kGridSize grid, scaled to
+ * its size and displaced by its own height tile.
+ *
+ * Each viewport selects the nodes to draw by distance: a node is split
+ * into its children when the camera is within the children's LOD range
+ * (and their tiles are resident). In the vertex shader, vertices morph
+ * towards the next coarser grid as they approach the end of their range,
+ * so there are no cracks or pops between levels. However big the terrain,
+ * a viewport draws a bounded number of nodes in one instanced draw.
+ *
+ * Height tiles stream in from TerrainTiles on a background thread into an
+ * array texture used as an LRU cache; until a node's children arrive the
+ * node is drawn at its own, coarser, level.
+ *
+ * The vertex shader reads "heightTiles" (sampler2DArray), "cameraPos",
+ * a vec2 grid position at location 0 and two vec4 per-instance attributes
+ * at locations 3 and 4, and outputs the same vColor / vViewPos /
+ * vViewNormal as the drone shaders, so either lighting backend shades it.
+ */
+class Terrain
+{
+public:
+    Terrain();
+    ~Terrain();
+
+    // size: width of the square terrain, centred on the origin
+    bool init(float size, const std::string& cacheDir, RenderQueue& queue, bool persistentMapping = true);
+
+    // Upload tiles that finished loading and start this frame's instances
+    void beginFrame(int viewportCount);
+
+    // Select the nodes seen from view and queue one instanced draw.
+    // program must already have view and projection set.
+    void submit(const glm::mat4& view, const glm::mat4& projection, GLuint program, RenderQueue& queue);
+
+    void endFrame();
+    void cleanup();
+
+    float getSize() const        { return mSize; }
+    int   getLevelCount() const  { return mLevels; }
+    int   getNodeCount() const   { return (int)mSelected.size(); }
+    int   getResidentCount() const { return (int)mResident.size(); }
+    int   getPendingCount() const  { return (int)mPending.size(); }
+    const TerrainTiles& getTiles() const { return mTiles; }
+
+private:
+    // Per-instance data: where the node is and how its vertices morph
+    struct NodeInstance
+    {
+        glm::vec4 node;   // origin x, origin z, size, tile layer
+        glm::vec4 morph;  // start/end distance to this level's parent grid,
+                          // then to the grandparent's
+    };
+
+    struct ResidentTile
+    {
+        int   layer;
+        float minHeight;
+        float maxHeight;
+        int   lastUsed;   // frame number
+    };
+
+    void uploadTile(const HeightTile& tile);
+    void selectNode(int level, int x, int z);
+    void addNode(int level, int x, int z, const ResidentTile& tile);
+    ResidentTile* findResident(uint64_t key);
+    void requestTile(uint64_t key);
+    float nodeSize(int level) const { return mSize / (float)(1 << (mLevels - 1 - level)); }
+
+private:
+    float mSize;
+    int   mLevels;
+    std::vector<float> mRanges;   // LOD range of each level
+
+    // Grid mesh shared by every node
+    GLuint mVAO;
+    GLuint mVBO;
+    GLuint mEBO;
+    int    mNumIndices;
+    int    mMaterial;
+
+    // Height tile cache
+    GLuint mTileTexture;
+    int    mLayerCount;
+    std::vector<int>                 mFreeLayers;
+    std::map<uint64_t,ResidentTile>  mResident;
+    std::set<uint64_t>               mPending;
+    TerrainTiles                     mTiles;
+    int                              mFrame;
+
+    // This viewport's selection
+    glm::vec4                 mFrustum[6];
+    glm::vec3                 mCameraPos;
+    std::vector<NodeInstance> mSelected;
+
+    StreamingBuffer mInstances;
+};
@@ -0,0 +1,229 @@
+#include "TerrainTiles.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// Height function: fractal value noise around kBaseHeight
+static const float kBaseHeight   = -80.f;
+static const float kAmplitude    = 150.f;  // total over all octaves
+static const float kWavelength   = 1200.f; // of the first octave
+static const int   kOctaves      = 7;
+static const unsigned kSeed      = 4300u;
+
+// Tile file: magic, sample count, then the heights
+static const char kTileMagic[4] = { 'H', 'T', 'L', '2' };
+
+static float hashNoise(int x, int z)
+{
+    uint32_t h = (uint32_t)x * 374761393u + (uint32_t)z * 668265263u + kSeed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return (float)(h & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+static float valueNoise(float x, float z)
+{
+    float fx = std::floor(x), fz = std::floor(z);
+    int   ix = (int)fx, iz = (int)fz;
+    float tx = x - fx, tz = z - fz;
+    tx = tx * tx * (3.f - 2.f * tx);
+    tz = tz * tz * (3.f - 2.f * tz);
+
+    float a = hashNoise(ix, iz),     b = hashNoise(ix + 1, iz);
+    float c = hashNoise(ix, iz + 1), d = hashNoise(ix + 1, iz + 1);
+    return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * tz;
+}
+
+// Noise in [0,1), summed so the octaves' amplitudes add up to 1
+static float heightAt(float x, float z)
+{
+    float sum = 0.f, amp = 0.5f, norm = 0.f, freq = 1.f / kWavelength;
+    for(int o = 0; o < kOctaves; o++)
+    {
+        sum  += amp * valueNoise(x * freq, z * freq);
+        norm += amp;
+        amp  *= 0.5f;
+        freq *= 2.f;
+    }
+    return kBaseHeight + kAmplitude * (sum / norm - 0.5f);
+}
+
+float TerrainTiles::minPossibleHeight() { return kBaseHeight - 0.5f * kAmplitude; }
+float TerrainTiles::maxPossibleHeight() { return kBaseHeight + 0.5f * kAmplitude; }
+
+TerrainTiles::TerrainTiles()
+    : mRootSize(1.f)
+    , mLevels(1)
+    , mQuit(false)
+    , mReadCount(0)
+    , mGeneratedCount(0)
+{
+}
+
+TerrainTiles::~TerrainTiles()
+{
+    stop();
+}
+
+void TerrainTiles::start(const std::string& cacheDir, float rootSize, int levels)
+{
+    mCacheDir = cacheDir;
+    mRootSize = rootSize;
+    mLevels   = levels;
+
+    std::error_code ec;
+    std::filesystem::create_directories(mCacheDir, ec);
+
+    mQuit = false;
+    mWorker = std::thread(&TerrainTiles::workerLoop, this);
+}
+
+void TerrainTiles::stop()
+{
+    if (!mWorker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mWake.notify_one();
+    mWorker.join();
+}
+
+void TerrainTiles::request(uint64_t key)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mQueued.insert(key).second)
+            return;
+        mRequests.push_back(key);
+    }
+    mWake.notify_one();
+}
+
+bool TerrainTiles::poll(HeightTile& tile)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFinished.empty())
+        return false;
+    tile = std::move(mFinished.front());
+    mFinished.pop_front();
+    return true;
+}
+
+int TerrainTiles::getQueuedCount()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return (int)mQueued.size();
+}
+
+void TerrainTiles::loadNow(uint64_t key, HeightTile& tile)
+{
+    if (!readTile(key, tile))
+    {
+        generateTile(key, tile);
+        writeTile(tile);
+    }
+}
+
+void TerrainTiles::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(;;)
+    {
+        mWake.wait(lock, [&]{ return mQuit || !mRequests.empty(); });
+        if (mQuit)
+            return;
+
+        uint64_t key = mRequests.front();
+        mRequests.pop_front();
+        lock.unlock();
+
+        HeightTile tile;
+        if (readTile(key, tile))
+            mReadCount++;
+        else
+        {
+            generateTile(key, tile);
+            writeTile(tile);
+            mGeneratedCount++;
+        }
+
+        lock.lock();
+        mQueued.erase(key);
+        mFinished.push_back(std::move(tile));
+    }
+}
+
+std::string TerrainTiles::pathFor(uint64_t key) const
+{
+    std::stringstream str;
+    str << mCacheDir << "/" << keyLevel(key) << "_" << keyX(key) << "_" << keyZ(key) << ".tile";
+    return str.str();
+}
+
+bool TerrainTiles::readTile(uint64_t key, HeightTile& tile) const
+{
+    std::ifstream file(pathFor(key).c_str(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    char magic[4];
+    int  samples = 0;
+    file.read(magic, 4);
+    file.read((char*)&samples, sizeof(samples));
+    if (!file || std::memcmp(magic, kTileMagic, 4) != 0 || samples != kTileSamples)
+        return false;
+
+    tile.key = key;
+    tile.heights.resize(kTileSamples * kTileSamples);
+    file.read((char*)tile.heights.data(), tile.heights.size() * sizeof(float));
+    if ((size_t)file.gcount() != tile.heights.size() * sizeof(float))
+        return false;
+
+    std::pair<std::vector<float>::iterator, std::vector<float>::iterator> range =
+        std::minmax_element(tile.heights.begin(), tile.heights.end());
+    tile.minHeight = *range.first;
+    tile.maxHeight = *range.second;
+    return true;
+}
+
+void TerrainTiles::generateTile(uint64_t key, HeightTile& tile) const
+{
+    int   level    = keyLevel(key);
+    float nodeSize = mRootSize / (float)(1 << (mLevels - 1 - level));
+    float spacing  = nodeSize / kGridSize;
+    float originX  = -0.5f * mRootSize + keyX(key) * nodeSize;
+    float originZ  = -0.5f * mRootSize + keyZ(key) * nodeSize;
+
+    tile.key = key;
+    tile.heights.resize(kTileSamples * kTileSamples);
+    tile.minHeight = 1e30f;
+    tile.maxHeight = -1e30f;
+    for(int j = 0; j < kTileSamples; j++)
+    {
+        for(int i = 0; i < kTileSamples; i++)
+        {
+            // Sample 1 is the node's corner; 0 and the last are the border
+            float h = heightAt(originX + (i - 1) * spacing, originZ + (j - 1) * spacing);
+            tile.heights[j * kTileSamples + i] = h;
+            tile.minHeight = std::min(tile.minHeight, h);
+            tile.maxHeight = std::max(tile.maxHeight, h);
+        }
+    }
+}
+
+void TerrainTiles::writeTile(const HeightTile& tile) const
+{
+    std::ofstream file(pathFor(tile.key).c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return;
+
+    int samples = kTileSamples;
+    file.write(kTileMagic, 4);
+    file.write((const char*)&samples, sizeof(samples));
+    file.write((const char*)tile.heights.data(), tile.heights.size() * sizeof(float));
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * One quadtree node's heights: kTileSamples x kTileSamples floats, the
+ * node's (kGridSize + 1)^2 grid samples plus a one-sample border so normals
+ * can be taken with central differences up to the edges.
+ */
+struct HeightTile
+{
+    uint64_t           key;
+    std::vector<float> heights;
+    float              minHeight;
+    float              maxHeight;
+};
+
+/**
+ * TerrainTiles streams height tiles on a background thread. A tile is read
+ * from the cache directory if it is there; otherwise it is generated from
+ * the terrain's height function and written there, so the next run (or
+ * the next visit) only reads it.
+ *
+ * The main thread request()s tiles and poll()s for finished ones; nothing
+ * here touches GL.
+ */
+class TerrainTiles
+{
+public:
+    static const int kGridSize    = 32;
+    static const int kTileSamples = kGridSize + 3;
+
+    // Node keys: level (0 = finest) and position in that level's grid
+    static uint64_t makeKey(int level, int x, int z)
+    {
+        return ((uint64_t)level << 48) | ((uint64_t)(uint32_t)x << 24) | (uint64_t)(uint32_t)z;
+    }
+    static int keyLevel(uint64_t key) { return (int)(key >> 48); }
+    static int keyX(uint64_t key)     { return (int)((key >> 24) & 0xFFFFFF); }
+    static int keyZ(uint64_t key)     { return (int)(key & 0xFFFFFF); }
+
+    TerrainTiles();
+    ~TerrainTiles();
+
+    // rootSize is the terrain's width in world units, levels the quadtree
+    // depth; together they fix where each node is
+    void start(const std::string& cacheDir, float rootSize, int levels);
+    void stop();
+
+    // Queue a tile for loading (ignored if it is already queued)
+    void request(uint64_t key);
+
+    // Take one finished tile, if any
+    bool poll(HeightTile& tile);
+
+    // Load on the calling thread (the root, before the first frame)
+    void loadNow(uint64_t key, HeightTile& tile);
+
+    // Height range any tile can have
+    static float minPossibleHeight();
+    static float maxPossibleHeight();
+
+    int getQueuedCount();
+    int getReadCount() const      { return mReadCount; }
+    int getGeneratedCount() const { return mGeneratedCount; }
+
+private:
+    void workerLoop();
+    bool readTile(uint64_t key, HeightTile& tile) const;
+    void generateTile(uint64_t key, HeightTile& tile) const;
+    void writeTile(const HeightTile& tile) const;
+    std::string pathFor(uint64_t key) const;
+
+private:
+    std::string mCacheDir;
+    float       mRootSize;
+    int         mLevels;
+
+    std::thread             mWorker;
+    std::mutex              mMutex;
+    std::condition_variable mWake;
+    std::deque<uint64_t>    mRequests;
+    std::set<uint64_t>      mQueued;
+    std::deque<HeightTile>  mFinished;
+    bool                    mQuit;
+
+    std::atomic<int> mReadCount;
+    std::atomic<int> mGeneratedCount;
+};
@@ -0,0 +1,227 @@
+#include "TextOverlay.h"
+#include "RenderStats.h"
+#include <cfloat>
+#include <cctype>
+
+// The font covers ' ' to 'Z'; each glyph is 7 rows of 5 bits, most
+// significant bit on the left. Characters it lacks are drawn as '?'.
+static const int kFirstGlyph = ' ';
+static const int kGlyphCount = 'Z' - ' ' + 1;
+static const int kGlyphWidth = 5;
+static const int kGlyphHeight = 7;
+static const unsigned char kFont[kGlyphCount][kGlyphHeight] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+    { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // #
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // $
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // &
+    { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // *
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ;
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // @
+    { 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 }, // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+};
+
+// Texture layout: one 6x8 cell per glyph (a pixel of spacing right and
+// below), then one solid cell the panel samples
+static const int kCellWidth  = kGlyphWidth + 1;
+static const int kCellHeight = kGlyphHeight + 1;
+static const int kSolidCell  = kGlyphCount;
+static const int kAtlasWidth = (kGlyphCount + 1) * kCellWidth;
+
+// Margin between the text and the edge of its panel, in screen pixels
+static const float kPanelMargin = 6.f;
+
+TextOverlay::TextOverlay()
+    : mVAO(0)
+    , mVBO(0)
+    , mFontTexture(0)
+    , mTextMin(FLT_MAX)
+    , mTextMax(-FLT_MAX)
+{
+}
+
+TextOverlay::~TextOverlay()
+{
+    cleanup();
+}
+
+void TextOverlay::init()
+{
+    std::vector<unsigned char> texels(kAtlasWidth * kCellHeight, 0);
+    for(int g = 0; g < kGlyphCount; g++)
+        for(int row = 0; row < kGlyphHeight; row++)
+            for(int col = 0; col < kGlyphWidth; col++)
+                if (kFont[g][row] & (0x10 >> col))
+                    texels[row * kAtlasWidth + g * kCellWidth + col] = 255;
+    for(int row = 0; row < kCellHeight; row++)
+        for(int col = 0; col < kCellWidth; col++)
+            texels[row * kAtlasWidth + kSolidCell * kCellWidth + col] = 255;
+
+    glGenTextures(1, &mFontTexture);
+    glBindTexture(GL_TEXTURE_2D, mFontTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, kAtlasWidth, kCellHeight, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenVertexArrays(1, &mVAO);
+    glGenBuffers(1, &mVBO);
+    glBindVertexArray(mVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void*)(4 * sizeof(float)));
+    glBindVertexArray(0);
+
+    clear();
+}
+
+void TextOverlay::clear()
+{
+    // Six vertices held for the panel, filled in by draw()
+    mVertices.assign(6, OverlayVertex());
+    mTextMin = glm::vec2(FLT_MAX);
+    mTextMax = glm::vec2(-FLT_MAX);
+}
+
+void TextOverlay::setQuad(size_t first, const glm::vec2& min, const glm::vec2& max,
+                          const glm::vec2& uvMin, const glm::vec2& uvMax, const glm::vec4& color)
+{
+    OverlayVertex corners[4] = {
+        { min,                        uvMin,                          color },
+        { glm::vec2(max.x, min.y),    glm::vec2(uvMax.x, uvMin.y),    color },
+        { max,                        uvMax,                          color },
+        { glm::vec2(min.x, max.y),    glm::vec2(uvMin.x, uvMax.y),    color },
+    };
+    static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+    for(int i = 0; i < 6; i++)
+        mVertices[first + i] = corners[order[i]];
+}
+
+void TextOverlay::addText(float x, float y, const std::string& text, const glm::vec4& color)
+{
+    glm::vec2 pen(x, y);
+    glm::vec2 glyphSize((float)(kGlyphWidth * kScale), (float)(kGlyphHeight * kScale));
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        int c = std::toupper((unsigned char)text[i]);
+        if (c != ' ')
+        {
+            if (c < kFirstGlyph || c >= kFirstGlyph + kGlyphCount)
+                c = '?';
+            float u = (float)((c - kFirstGlyph) * kCellWidth) / kAtlasWidth;
+            glm::vec2 uvMin(u, 0.f);
+            glm::vec2 uvMax(u + (float)kGlyphWidth / kAtlasWidth, (float)kGlyphHeight / kCellHeight);
+            mVertices.resize(mVertices.size() + 6);
+            setQuad(mVertices.size() - 6, pen, pen + glyphSize, uvMin, uvMax, color);
+        }
+        pen.x += kCellWidth * kScale;
+    }
+
+    mTextMin = glm::min(mTextMin, glm::vec2(x, y));
+    mTextMax = glm::max(mTextMax, glm::vec2(pen.x - kScale, y + glyphSize.y));
+}
+
+void TextOverlay::draw(GLuint program, int width, int height)
+{
+    if (mVertices.size() <= 6)
+        return;
+
+    // The panel: a dark quad over the solid cell, covering all the text
+    glm::vec2 solid((kSolidCell * kCellWidth + 0.5f * kCellWidth) / kAtlasWidth, 0.5f);
+    setQuad(0, mTextMin - kPanelMargin, mTextMax + kPanelMargin, solid, solid, glm::vec4(0.f, 0.f, 0.f, 0.6f));
+
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    RenderStats::bufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(OverlayVertex), mVertices.data(),
+                            GL_STREAM_DRAW);
+
+    RenderStats::useProgram(program);
+    RenderStats::uniform(glGetUniformLocation(program, "screenSize"), glm::vec2((float)width, (float)height));
+    RenderStats::uniform(glGetUniformLocation(program, "font"), 0);
+    RenderStats::bindTexture(GL_TEXTURE_2D, mFontTexture);
+
+    RenderStats::disable(GL_DEPTH_TEST);
+    RenderStats::enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    RenderStats::bindVertexArray(mVAO);
+    RenderStats::drawArrays(GL_TRIANGLES, 0, (GLsizei)mVertices.size());
+    RenderStats::bindVertexArray(0);
+    RenderStats::disable(GL_BLEND);
+    RenderStats::enable(GL_DEPTH_TEST);
+    RenderStats::bindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextOverlay::cleanup()
+{
+    if (mVAO)
+    {
+        glDeleteVertexArrays(1, &mVAO);
+        mVAO = 0;
+    }
+    if (mVBO)
+    {
+        glDeleteBuffers(1, &mVBO);
+        mVBO = 0;
+    }
+    if (mFontTexture)
+    {
+        glDeleteTextures(1, &mFontTexture);
+        mFontTexture = 0;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * TextOverlay draws lines of text in screen space, for the stats overlay.
+ *
+ * Glyphs come from a built-in 5x7 bitmap font (digits, capitals and a
+ * little punctuation; lower case is drawn as capitals) packed into one
+ * small texture. Every character added in a frame becomes a quad in a
+ * single vertex array, behind which draw() puts a translucent panel
+ * covering all the text, so however much text there is the overlay costs
+ * one buffer upload and one draw call.
+ *
+ * Per frame:
+ *   clear();  addText(...) as often as needed;  draw(program, w, h);
+ */
+class TextOverlay
+{
+public:
+    static const int kScale = 2;   // screen pixels per font pixel
+    static const int kLineHeight = 10 * kScale;
+
+    TextOverlay();
+    ~TextOverlay();
+
+    void init();
+
+    void clear();
+
+    // Add text with its top left corner at (x, y) pixels from the top left
+    // of the screen
+    void addText(float x, float y, const std::string& text,
+                 const glm::vec4& color = glm::vec4(1.f));
+
+    // Draw everything added since clear() over the bound framebuffer
+    void draw(GLuint program, int width, int height);
+
+    void cleanup();
+
+private:
+    struct OverlayVertex
+    {
+        glm::vec2 position;
+        glm::vec2 uv;
+        glm::vec4 color;
+    };
+
+    // Write the six vertices of a quad from mVertices[first] on
+    void setQuad(size_t first, const glm::vec2& min, const glm::vec2& max,
+                 const glm::vec2& uvMin, const glm::vec2& uvMax, const glm::vec4& color);
+
+private:
+    GLuint mVAO;
+    GLuint mVBO;
+    GLuint mFontTexture;
+    glm::vec2 mTextMin;    // bounds of the text added so far
+    glm::vec2 mTextMax;
+    std::vector<OverlayVertex> mVertices;   // the panel first, then the glyphs
+};
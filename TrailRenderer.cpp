@@ -0,0 +1,133 @@
+#include "TrailRenderer.h"
+#include "RenderStats.h"
+
+// Seconds between trail points
+static const float kSampleInterval = 0.05f;
+
+// Time stored in slots never written, so they are always fully faded
+static const float kNeverWritten = -1e9f;
+
+TrailRenderer::TrailRenderer()
+    : mDroneCount(0)
+    , mHead(0)
+    , mSlotStart(0.f)
+    , mVAO(0)
+    , mVBO(0)
+    , mEBO(0)
+{
+}
+
+TrailRenderer::~TrailRenderer()
+{
+    cleanup();
+}
+
+float TrailRenderer::getDuration() const
+{
+    return kSampleInterval * (kTrailPoints - 1);
+}
+
+void TrailRenderer::init(int droneCount)
+{
+    mDroneCount = droneCount;
+    mHead = 0;
+    mSlotStart = 0.f;
+
+    TrailPoint empty;
+    empty.position = glm::vec3(0.f);
+    empty.time = kNeverWritten;
+    std::vector<TrailPoint> points(kTrailPoints * droneCount, empty);
+
+    // Segment group g joins slot g to slot g+1 for every drone; groups are
+    // stored twice so any kTrailPoints - 1 consecutive ones are contiguous
+    std::vector<GLuint> indices;
+    indices.reserve(2 * kTrailPoints * droneCount * 2);
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(int g = 0; g < kTrailPoints; g++)
+        {
+            GLuint from = (GLuint)(g * droneCount);
+            GLuint to   = (GLuint)(((g + 1) % kTrailPoints) * droneCount);
+            for(int d = 0; d < droneCount; d++)
+            {
+                indices.push_back(from + d);
+                indices.push_back(to + d);
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &mVAO);
+    glGenBuffers(1, &mVBO);
+    glGenBuffers(1, &mEBO);
+    glBindVertexArray(mVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(TrailPoint), points.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TrailPoint), (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    mSlot.resize(droneCount);
+}
+
+void TrailRenderer::update(const std::vector<DroneModel>& fleet, float now)
+{
+    if (mVAO == 0)
+        return;
+
+    // Start a new slot once the head one has covered its interval; the old
+    // head keeps the positions it was last given
+    if (now - mSlotStart >= kSampleInterval)
+    {
+        mHead = (mHead + 1) % kTrailPoints;
+        mSlotStart = now;
+    }
+
+    for(int d = 0; d < mDroneCount; d++)
+    {
+        mSlot[d].position = fleet[d].getPosition();
+        mSlot[d].time = now;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+    RenderStats::bufferSubData(GL_ARRAY_BUFFER, (GLintptr)mHead * mDroneCount * sizeof(TrailPoint),
+                    mDroneCount * sizeof(TrailPoint), mSlot.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TrailRenderer::draw(GLuint program, float now)
+{
+    if (mVAO == 0 || mDroneCount == 0)
+        return;
+
+    RenderStats::useProgram(program);
+    RenderStats::uniform(glGetUniformLocation(program, "now"), now);
+    RenderStats::uniform(glGetUniformLocation(program, "duration"), getDuration());
+
+    // Every group but the one from the newest slot back to the oldest:
+    // groups head+1 .. head+kTrailPoints-1
+    size_t firstGroup = (size_t)((mHead + 1) % kTrailPoints);
+    const void* first = (const void*)(firstGroup * mDroneCount * 2 * sizeof(GLuint));
+    GLsizei count = (GLsizei)((kTrailPoints - 1) * mDroneCount * 2);
+
+    RenderStats::enable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    RenderStats::bindVertexArray(mVAO);
+    RenderStats::drawElements(GL_LINES, count, GL_UNSIGNED_INT, first);
+    RenderStats::bindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    RenderStats::disable(GL_BLEND);
+}
+
+void TrailRenderer::cleanup()
+{
+    if (mVAO != 0)
+    {
+        glDeleteVertexArrays(1, &mVAO);
+        glDeleteBuffers(1, &mVBO);
+        glDeleteBuffers(1, &mEBO);
+        mVAO = mVBO = mEBO = 0;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "DroneModel.h"
+
+/**
+ * TrailRenderer draws the recent path of every drone as a fading line.
+ *
+ * Points live in a GPU ring buffer of kTrailPoints slots, each slot holding
+ * one point (position, time) per drone. The current slot follows the
+ * drones every frame and a new one is started every kSampleInterval, so a
+ * frame uploads exactly one slot - a single glBufferSubData of
+ * fleet size x 16 bytes - however long the trails are.
+ *
+ * All trails are one GL_LINES draw. The index buffer holds the segments
+ * slot by slot, twice over, so the kTrailPoints - 1 segment groups that
+ * run from the oldest slot to the newest are always one contiguous range;
+ * the vertex shader fades each point by its age.
+ *
+ * Trails are blended and do not write depth, so they are drawn directly
+ * after the viewport's opaque geometry rather than through RenderQueue.
+ */
+class TrailRenderer
+{
+public:
+    static const int kTrailPoints = 64;
+
+    TrailRenderer();
+    ~TrailRenderer();
+
+    void init(int droneCount);
+
+    // Record this frame's positions; now is the time in seconds
+    void update(const std::vector<DroneModel>& fleet, float now);
+
+    // Draw every trail; program must have view and projection set
+    void draw(GLuint program, float now);
+
+    void cleanup();
+
+    // Seconds a point stays visible, and what update() uploads per frame
+    float getDuration() const;
+    int   getBytesPerFrame() const { return mDroneCount * (int)sizeof(TrailPoint); }
+
+private:
+    struct TrailPoint
+    {
+        glm::vec3 position;
+        float     time;
+    };
+
+private:
+    int    mDroneCount;
+    int    mHead;         // slot being written
+    float  mSlotStart;    // time the head slot was started
+    GLuint mVAO;
+    GLuint mVBO;
+    GLuint mEBO;
+    std::vector<TrailPoint> mSlot;
+};
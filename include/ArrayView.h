@@ -0,0 +1,54 @@
+#ifndef _ARRAYVIEW_H_
+#define _ARRAYVIEW_H_
+
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A read-only view of a contiguous array that something else owns, as
+ * std::span<const T> would be: a pointer and a count, cheap to pass by
+ * value. It stays valid only as long as the array is not changed.
+ *
+ * Copy it into a vector (vector<T>(view.begin(),view.end())) only where
+ * a copy is really needed.
+ */
+template <class T>
+class ArrayView
+{
+public:
+    ArrayView()
+        :first(nullptr),count(0)
+    {
+    }
+
+    ArrayView(const T *data, size_t size)
+        :first(data),count(size)
+    {
+    }
+
+    ArrayView(const vector<T>& v)
+        :first(v.data()),count(v.size())
+    {
+    }
+
+    const T *data() const { return first; }
+    size_t size() const { return count; }
+    bool empty() const { return count==0; }
+
+    const T *begin() const { return first; }
+    const T *end() const { return first+count; }
+
+    const T& operator[](size_t i) const { return first[i]; }
+
+private:
+    const T *first;
+    size_t count;
+};
+
+}
+
+#endif
@@ -31,12 +31,8 @@ Circle::Circle(int cx,int cy,int radius) {
 
     vector<VertexAttrib> vertexData;
     for (int i=0;i<positions.size();i++) {
-        vector<float> data;
         VertexAttrib v;
-        for (int j=0;j<4;j++) {
-            data.push_back(positions[i][j]);
-        }
-        v.setData("position",data);
+        v.set<util::Position>(positions[i]);
         vertexData.push_back(v);
     }
 
@@ -48,9 +44,9 @@ Circle::Circle(int cx,int cy,int radius) {
     indices.push_back(1);
 
 
-    this->setVertexData(vertexData);
+    this->setVertexData(std::move(vertexData));
     // give it the index data that forms the polygons
-    this->setPrimitives(indices);
+    this->setPrimitives(std::move(indices));
 
     this->setPrimitiveType(
         GL_TRIANGLE_FAN);         // when rendering specify this to OpenGL
@@ -24,6 +24,7 @@ namespace util
       position = glm::vec4(0, 0, 0, 1);
       spotDirection = glm::vec4(0, 0, 0, 0);
       spotCutoff = 0.0f;
+      range = 0.0f;
     }
     Light(const Light& l)
     {
@@ -34,6 +35,7 @@ namespace util
       position = glm::vec4(l.position);
       spotDirection = glm::vec4(l.spotDirection);
       spotCutoff = l.spotCutoff;
+      range = l.range;
     }
     ~Light()
     {
@@ -64,10 +66,18 @@ namespace util
     inline float getSpotCutoff() const;
     inline void setSpotAngle(float angle);
 
+    /**
+     * Distance beyond which a point or spot light has no effect,
+     * 0 for unlimited. Lets renderers skip lights far from a surface.
+     */
+    inline float getRange() const;
+    inline void setRange(float r);
+
   private:
     glm::vec3 ambient, diffuse, specular;
     glm::vec4 position, spotDirection;
     float spotCutoff;
+    float range;
   };
 
 
@@ -155,5 +165,15 @@ namespace util
   {
     return spotCutoff;
   }
+
+  float Light::getRange() const
+  {
+    return range;
+  }
+
+  void Light::setRange(float r)
+  {
+    range = r;
+  }
 }
 #endif
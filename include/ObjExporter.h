@@ -5,6 +5,7 @@
 #include <vector>
 using namespace std;
 #include "PolygonMesh.h"
+#include "VertexLayout.h"
 #include <glm/glm.hpp>
 
 namespace util
@@ -20,59 +21,48 @@ namespace util
 	class ObjExporter
 	{
 		public:
-			static bool exportFile(const PolygonMesh<K>& mesh,ofstream& out) throw (runtime_error)
+			static bool exportFile(const PolygonMesh<K>& mesh,ofstream& out)
 			{
 				int i,j;
 
-                vector<K> vertexData = mesh.getVertexAttributes();
+                ArrayView<K> vertexData = mesh.getVertexAttributes();
 				if (vertexData.size()==0)
 					return true;
 
                 vector<glm::vec4> vertices,normals,texcoords;
-                vector<unsigned int> primitives = mesh.getPrimitives();
+                ArrayView<unsigned int> primitives = mesh.getPrimitives();
 
-				for (i=0;i<vertexData.size();i++) {
-					if (vertexData[i].hasData("position")) {
-						vector<float> data = vertexData[i].getData("position");
+				if constexpr (K::template has<Position>()) {
+					for (i=0;i<vertexData.size();i++) {
+						glm::vec4 data = vertexData[i].template get<Position>();
 						out << "v ";
-						for (j=0;j<data.size();j++) {
+						for (j=0;j<4;j++) {
 							out << data[j] << " ";
 						}
 						out << endl;
 					}
-
 				}
 
-				for (int i=0;i<vertexData.size();i++) {
-					if (vertexData[i].hasData("normal")) {
-						vector<float> data = vertexData[i].getData("normal");
-                        if (data.size()<3) 
-                        {
-                            throw runtime_error("Normal data must have 3 or 4 numbers, with the 4th number being 0");
-                        }
+				if constexpr (K::template has<Normal>()) {
+					for (i=0;i<vertexData.size();i++) {
+						glm::vec4 data = vertexData[i].template get<Normal>();
 						out << "vn ";
 						for (j=0;j<3;j++) {
 							out << data[j] << " ";
 						}
 						out << endl;
 					}
-
 				}
 
-				for (int i=0;i<vertexData.size();i++) {
-					if (vertexData[i].hasData("texcoord")) {
-						vector<float> data = vertexData[i].getData("texcoord");
-                        if (data.size()<3) 
-                        {
-                            throw runtime_error("Texture coordinate data must have 3 or 4 numbers, with the 4th number being 1");
-                        }
+				if constexpr (K::template has<TexCoord>()) {
+					for (i=0;i<vertexData.size();i++) {
+						glm::vec4 data = vertexData[i].template get<TexCoord>();
 						out << "vt ";
 						for (j=0;j<3;j++) {
 							out << data[j] << " ";
 						}
 						out << endl;
 					}
-
 				}
 
 
@@ -3,332 +3,542 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "VertexLayout.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 namespace util
 {
 
+/*
+ * A read-only view of a whole file: memory mapped where mmap exists,
+ * read into memory elsewhere. Throws a string if the file cannot be read.
+ */
+class MappedFile
+{
+public:
+    MappedFile(const string& filename)
+        :data(nullptr),size(0)
+    {
+#ifndef _WIN32
+        int fd = open(filename.c_str(),O_RDONLY);
+        struct stat info;
+        if ((fd<0) || (fstat(fd,&info)!=0))
+        {
+            if (fd>=0)
+                close(fd);
+            throw string("Cannot open ")+filename;
+        }
+        size = (size_t)info.st_size;
+        if (size>0)
+        {
+            void *mapped = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+            if (mapped!=MAP_FAILED)
+            {
+                madvise(mapped,size,MADV_SEQUENTIAL);
+                data = (const char *)mapped;
+            }
+        }
+        close(fd);
+        if (data || (size==0))
+            return;
+#endif
+        //no mmap: read it all
+        ifstream in(filename.c_str(),ios::binary);
+        if (!in)
+            throw string("Cannot open ")+filename;
+        copy.assign(istreambuf_iterator<char>(in),istreambuf_iterator<char>());
+        data = copy.data();
+        size = copy.size();
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data && copy.empty())
+            munmap((void *)data,size);
+#endif
+    }
+
+    const char *begin() const { return data; }
+    const char *end() const { return data+size; }
 
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char *data;
+    size_t size;
+    string copy;
+};
 
 /*
  * A helper class to import a PolygonMesh object from an OBJ file.
- * It imports only position, normal and texture coordinate data (if present)
+ * It imports only position, normal and texture coordinate data (if present
+ * in the file and in the vertex layout K)
+ *
+ * The text is parsed in place: lines and tokens are pointer ranges into
+ * it and numbers are read with std::from_chars, so parsing allocates
+ * nothing per line.
+ *
+ * Large files are split into line-aligned chunks parsed on their own
+ * threads. Each chunk numbers its vertices from 0; once all are done the
+ * chunks' counts are prefix-summed into offsets and each chunk is copied
+ * into place with the offset added to its relative (negative) indices.
+ * Absolute indices already refer to the whole file and are copied as is.
  */
 template <class K>
 class ObjImporter
 {
 public:
-    static PolygonMesh<K> importFile(ifstream& in, bool scaleAndCenter)
+    //files smaller than this per thread are not worth splitting
+    static const size_t MIN_CHUNK_BYTES = 4<<20;
+
+    /*
+     * threads: how many threads parse the text, 0 for one per core
+     */
+    static PolygonMesh<K> importFile(ifstream& in, bool scaleAndCenter, int threads=0)
+    {
+        string text((istreambuf_iterator<char>(in)),istreambuf_iterator<char>());
+        return importText(text.data(),text.data()+text.size(),scaleAndCenter,threads);
+    }
+
+    /*
+     * Import straight from the named file, memory mapped
+     */
+    static PolygonMesh<K> importFile(const string& filename, bool scaleAndCenter, int threads=0)
+    {
+        MappedFile file(filename);
+        return importText(file.begin(),file.end(),scaleAndCenter,threads);
+    }
+
+    /*
+     * Import OBJ text held in memory
+     */
+    static PolygonMesh<K> importText(const char *begin, const char *end, bool scaleAndCenter, int threads=0)
     {
         vector<glm::vec4> vertices,normals,texcoords;
-        vector<unsigned int> triangles, triangle_texture_indices, triangle_normal_indices;
-        int i,j;
-        int lineno;
+        vector<unsigned int> triangles;
+        int i;
         PolygonMesh<K> mesh;
 
+        if (threads<=0)
+            threads = max(1,(int)thread::hardware_concurrency());
+        size_t length = end-begin;
+        threads = (int)max((size_t)1,min((size_t)threads,length/MIN_CHUNK_BYTES));
 
-        lineno = 0;
-
-        string line;
+        //split after the newline nearest each even share of the text
+        vector<const char *> bounds(threads+1,end);
+        bounds[0] = begin;
+        for (i=1;i<threads;i++)
+        {
+            const char *at = max(bounds[i-1],begin+length/threads*i);
+            const char *newline = (const char *)memchr(at,'\n',end-at);
+            bounds[i] = newline ? newline+1 : end;
+        }
 
+        vector<Chunk> chunks(threads);
+        forEach(threads,[&](int c) { parseChunk(bounds[c],bounds[c+1],chunks[c]); });
 
+        long long vertexTotal = 0;
+        for (i=0;i<threads;i++)
+            vertexTotal += chunks[i].vertices.size();
 
-        while (getline(in,line))
+        //the first error in the file is the one reported. Indices can only
+        //be checked now that the vertex counts are known; a chunk that has
+        //a bad one is parsed again, checking as it goes, to find its line
+        int lineno = 0;
+        long long vertexBase = 0;
+        for (i=0;i<threads;i++)
         {
-            lineno++;
-            if ((line.length()<=0) || (line[0] == '#'))
+            Chunk& chunk = chunks[i];
+            if ((chunk.maxAbsolute>=vertexTotal) || (vertexBase+chunk.minRelative<0))
             {
-                //line is a comment, ignore
-                continue;
+                Chunk checked;
+                parseChunk(bounds[i],bounds[i+1],checked,vertexBase,vertexTotal);
+                throw error(lineno+checked.errorLine,checked.errorMessage);
             }
+            if (chunk.errorMessage)
+                throw error(lineno+chunk.errorLine,chunk.errorMessage);
+            lineno += chunk.lines;
+            vertexBase += chunk.vertices.size();
+        }
 
-            stringstream str;
-
-            str << line;
-
-            vector<string> tokens;
-            string symbol;
-
-            while (str>>symbol)
-                tokens.push_back(symbol);
-
-            if (tokens[0]=="v")
+        if (threads==1)
+        {
+            Chunk& only = chunks[0];
+            vertices.swap(only.vertices);
+            texcoords.swap(only.texcoords);
+            normals.swap(only.normals);
+            triangles.swap(only.triangles);
+        }
+        else
+        {
+            //where each chunk's data starts in the merged arrays
+            vector<Offsets> offsets(threads+1);
+            for (i=0;i<threads;i++)
             {
-                if ((tokens.size()<4) || (tokens.size()>7))
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Vertex coordinate has an invalid number of values";
-                    throw str.str();
-                }
-
-                float num;
-                glm::vec4 v;
-
-                str.str("");
-                str.clear();
+                offsets[i+1].vertices = offsets[i].vertices+chunks[i].vertices.size();
+                offsets[i+1].texcoords = offsets[i].texcoords+chunks[i].texcoords.size();
+                offsets[i+1].normals = offsets[i].normals+chunks[i].normals.size();
+                offsets[i+1].triangles = offsets[i].triangles+chunks[i].triangles.size();
+            }
+            vertices.resize(offsets[threads].vertices);
+            texcoords.resize(offsets[threads].texcoords);
+            normals.resize(offsets[threads].normals);
+            triangles.resize(offsets[threads].triangles);
 
-                str << tokens[1] << " " << tokens[2] << " " << tokens[3];
+            forEach(threads,[&](int c)
+            {
+                Chunk& chunk = chunks[c];
+                Offsets& at = offsets[c];
+                copy(chunk.vertices.begin(),chunk.vertices.end(),vertices.begin()+at.vertices);
+                copy(chunk.texcoords.begin(),chunk.texcoords.end(),texcoords.begin()+at.texcoords);
+                copy(chunk.normals.begin(),chunk.normals.end(),normals.begin()+at.normals);
+                copy(chunk.triangles.begin(),chunk.triangles.end(),triangles.begin()+at.triangles);
+                //the chunk is no longer needed once it is in place
+                for (size_t r=0;r<chunk.relativeVertices.size();r++)
+                    triangles[at.triangles+chunk.relativeVertices[r]] += (unsigned int)at.vertices;
+                vector<glm::vec4>().swap(chunk.vertices);
+                vector<glm::vec4>().swap(chunk.texcoords);
+                vector<glm::vec4>().swap(chunk.normals);
+                vector<unsigned int>().swap(chunk.triangles);
+            });
+        }
 
-                str >> v.x >> v.y >> v.z;
-                v.w = 1.0f;
+        if (scaleAndCenter)
+        {
+            //center about the origin and within a cube of side 1 centered at the origin
+            //find the centroid
+            glm::vec4 center = vertices[0];
 
-                if (tokens.size()==5)
-                {
-                    str.str("");
-                    str.clear();
-                    str << tokens[4];
-                    str >> num;
-                    if (num!=0)
-                    {
-                        v.x/=num;
-                        v.y/=num;
-                        v.z/=num;
-                    }
-                }
+            glm::vec4 minimum = center;
+            glm::vec4 maximum = center;
 
-                vertices.push_back(v);
-            }
-            else if (tokens[0]=="vt")
+            for (size_t i=1;i<vertices.size();i++)
             {
-                if ((tokens.size()<3) || (tokens.size()>4))
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Texture coordinate has an invalid number of values";
-                    throw str.str();
-                }
+                //center = center.add(vertices.get(i).x,vertices.get(i).y,vertices.get(i).z,0.0f);
+                minimum = glm::min(minimum,vertices[i]);
+                maximum = glm::max(maximum,vertices[i]);
+            }
 
-                glm::vec4 v;
+            center = (minimum + maximum)*0.5f;
 
-                float n;
 
-                str.str("");
-                str.clear();
-                str << tokens[1] << " " << tokens[2];
+            float longest;
 
-                str >> v.x >> v.y;
-                v.z = 0.0f;
-                v.w = 1.0f;
 
+            longest = std::max(maximum.x-minimum.x,std::max(maximum.y-minimum.y,maximum.z-minimum.z));
 
-                if (tokens.size()>3)
-                {
-                    str.str("");
-                    str.clear();
-                    str << tokens[3];
-                    str >> v.z;
-                }
+            //first translate and then scale
+            glm::mat4 transformMatrix = glm::scale(glm::mat4(1.0),
+                                                    glm::vec3(1.0f/longest,
+                                                              1.0f/longest,
+                                                              1.0f/longest))
+                                                  * glm::translate(glm::mat4(1.0),
+                                                        glm::vec3(-center.x,
+                                                                 -center.y,
+                                                                 -center.z));
 
-                texcoords.push_back(v);
-            }
-            else if (tokens[0]=="vn")
+            //scale down each other
+            for (size_t i=0;i<vertices.size();i++)
             {
-                if (tokens.size()!=4)
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Normal has an invalid number of values";
-                    throw str.str();
-                }
-
-
-                float num;
-                glm::vec3 v;
-
-                str.str("");
-                str.clear();
-                str << tokens[1] << " " << tokens[2] << " " << tokens[3];
-                str >> v.x >> v.y >> v.z;
+                vertices[i] = transformMatrix * vertices[i];
+            }
+        }
 
-                v = glm::normalize(v);
-                normals.push_back(glm::vec4(v,0.0f));
+        //attributes the vertex layout has no room for are dropped
+        vector<K> vertexData(vertices.size());
+        for (size_t i=0;i<vertices.size();i++) {
+            vertexData[i].template set<Position>(vertices[i]);
+            if constexpr (K::template has<TexCoord>())
+            {
+                if (texcoords.size()==vertices.size())
+                    vertexData[i].template set<TexCoord>(texcoords[i]);
             }
-            else if (tokens[0]=="f")
+            if constexpr (K::template has<Normal>())
             {
-                if (tokens.size()<4)
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Face has too few vertices, must be at least 3";
-                }
+                if (normals.size()==vertices.size())
+                    vertexData[i].template set<Normal>(normals[i]);
+            }
+        }
 
+        mesh.setVertexData(std::move(vertexData));
+        mesh.setPrimitives(std::move(triangles));
+        mesh.setPrimitiveType(GL_TRIANGLES);
+        mesh.setPrimitiveSize(3);
 
-                vector <unsigned int> t_triangles,t_tex,t_normal;
+        //only once the mesh has its vertices and triangles to compute from
+        if ((normals.size()==0) || (normals.size()!=vertices.size()))
+            mesh.computeNormals();
+        return mesh;
+    }
 
+private:
+    /*
+     * What one chunk of the file parses into. Vertex indices are 0-based;
+     * relative ones were resolved against the chunk's own vertices, and
+     * their positions in triangles are listed so the vertices of earlier
+     * chunks can be added on when merging.
+     */
+    struct Chunk
+    {
+        vector<glm::vec4> vertices,normals,texcoords;
+        vector<unsigned int> triangles;
+        vector<size_t> relativeVertices;
+        long long maxAbsolute; //largest absolute index (0-based), -1 if none
+        long long minRelative; //smallest relative one, resolved in the chunk
+        int lines;
+        int errorLine; //set with errorMessage, counted from the chunk's first line
+        const char *errorMessage;
+
+        Chunk():maxAbsolute(-1),minRelative(0),lines(0),errorLine(0),errorMessage(nullptr) {}
+    };
+
+    struct Offsets
+    {
+        size_t vertices,normals,texcoords,triangles;
 
-                for (i=1;i<tokens.size();i++)
-                {
-                    str.str("");
-                    str.clear();
-                    str << tokens[i];
+        Offsets():vertices(0),normals(0),texcoords(0),triangles(0) {}
+    };
 
-                    vector<string> data;
-                    string temp;
+    //call f(0)...f(count-1), each but the first on a thread of its own
+    template <class F>
+    static void forEach(int count, F f)
+    {
+        vector<thread> workers;
+        for (int c=1;c<count;c++)
+            workers.push_back(thread(f,c));
+        f(0);
+        for (size_t w=0;w<workers.size();w++)
+            workers[w].join();
+    }
 
-                    while (getline(str,temp,'/'))
-                        data.push_back(temp);
+    /*
+     * Parse [begin,end) into chunk. With a vertexBase (the vertices before
+     * the chunk) every index is also checked against vertexTotal, and the
+     * first one out of range is an error.
+     */
+    static void parseChunk(const char *begin, const char *end, Chunk& chunk,
+                           long long vertexBase=-1, long long vertexTotal=0)
+    {
+        //reused by every face, so they stop allocating once large enough
+        vector <unsigned int> t_triangles;
+        vector <bool> t_relative;
+        float values[6];
+        int i;
+        int lineno = 0;
+
+        const char *next = begin;
+        while (next<end)
+        {
+            const char *line = next;
+            const char *lineEnd = (const char *)memchr(line,'\n',end-line);
+            if (!lineEnd)
+                lineEnd = end;
+            next = lineEnd+1;
 
+            lineno++;
+            if ((line==lineEnd) || (line[0] == '#'))
+            {
+                //line is a comment, ignore
+                continue;
+            }
 
-                    if ((data.size() < 1) && (data.size() > 3))
-                    {
-                        str.str("");
-                        str.clear();
-                        str << "Line " << lineno << ": Face specification has an incorrect number of values";
-                        throw str.str();
-                    }
+            const char *p = line;
+            if (!nextToken(p,lineEnd))
+                continue;
+            const char *keyword = p;
+            p = tokenEnd(p,lineEnd);
+            size_t keywordLength = p-keyword;
 
+            const char *message = nullptr;
+            if ((keywordLength==1) && (keyword[0]=='v'))
+            {
+                int count = parseFloats(p,lineEnd,values,6);
+                if ((count<3) || (count>6))
+                    message = "Vertex coordinate has an invalid number of values";
+                else
+                {
+                    glm::vec4 v(values[0],values[1],values[2],1.0f);
 
-                    //in OBJ file format all indices begin at 1, so must subtract 1 here
-                    int vi;
-                    str.str("");
-                    str.clear();
-                    str << data[0];
-                    str >> vi;
-                    t_triangles.push_back(vi-1); //vertex index
-                    if (data.size() > 1) {
-                        if (data[1].length() > 0) //a vertex texture index exists
+                    if (count==4)
+                    {
+                        float num = values[3];
+                        if (num!=0)
                         {
-                            str.str("");
-                            str.clear();
-                            str << data[1];
-                            str >> vi;
-                            t_tex.push_back(vi-1);
+                            v.x/=num;
+                            v.y/=num;
+                            v.z/=num;
                         }
+                    }
 
+                    chunk.vertices.push_back(v);
+                }
+            }
+            else if ((keywordLength==2) && (keyword[0]=='v') && (keyword[1]=='t'))
+            {
+                int count = parseFloats(p,lineEnd,values,3);
+                if ((count<2) || (count>3))
+                    message = "Texture coordinate has an invalid number of values";
+                else
+                {
+                    glm::vec4 v(values[0],values[1],0.0f,1.0f);
 
-                        if (data.size() > 2) //a vertex normal index exists
-                        {
-                            str.str("");
-                            str.clear();
-                            str << data[2];
-                            str >> vi;
-                            t_normal.push_back(vi-1);
-                        }
+                    if (count>2)
+                        v.z = values[2];
 
-                    }
+                    chunk.texcoords.push_back(v);
                 }
-
-                if (t_triangles.size()<3)
+            }
+            else if ((keywordLength==2) && (keyword[0]=='v') && (keyword[1]=='n'))
+            {
+                if (parseFloats(p,lineEnd,values,3)!=3)
+                    message = "Normal has an invalid number of values";
+                else
                 {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Fewer than 3 vertices for a polygon";
-                    throw str.str();
+                    glm::vec3 v(values[0],values[1],values[2]);
+
+                    v = glm::normalize(v);
+                    chunk.normals.push_back(glm::vec4(v,0.0f));
                 }
+            }
+            else if ((keywordLength==1) && (keyword[0]=='f'))
+            {
+                t_triangles.clear();
+                t_relative.clear();
 
-                //if face has more than 3 vertices, break down into a triangle fan
-                for (i=2;i<t_triangles.size();i++)
+                while (nextToken(p,lineEnd))
                 {
-                    triangles.push_back(t_triangles[0]);
-                    triangles.push_back(t_triangles[i-1]);
-                    triangles.push_back(t_triangles[i]);
-
-                    if (t_tex.size()>0)
+                    //vertex/texture/normal: only the vertex index is used
+                    const char *e = tokenEnd(p,lineEnd);
+                    long long index = toInt(p,find(p,e,'/'));
+                    if (index<0)
                     {
-                        triangle_texture_indices.push_back(t_tex[0]);
-                        triangle_texture_indices.push_back(t_tex[i-1]);
-                        triangle_texture_indices.push_back(t_tex[i]);
+                        //counted back from the last vertex so far
+                        index += chunk.vertices.size();
+                        chunk.minRelative = min(chunk.minRelative,index);
+                        if ((vertexBase>=0) && (vertexBase+index<0))
+                            message = "Vertex index out of range";
+                        t_triangles.push_back((unsigned int)index);
+                        t_relative.push_back(true);
                     }
-
-                    if (t_normal.size()>0)
+                    else
                     {
-                        triangle_normal_indices.push_back(t_normal[0]);
-                        triangle_normal_indices.push_back(t_normal[i-1]);
-                        triangle_normal_indices.push_back(t_normal[i]);
+                        //in OBJ file format all indices begin at 1, so must subtract 1 here.
+                        //0 is no vertex at all; unsigned, it is as out of range as any
+                        index = (unsigned int)(index-1);
+                        chunk.maxAbsolute = max(chunk.maxAbsolute,index);
+                        if ((vertexBase>=0) && (index>=vertexTotal))
+                            message = "Vertex index out of range";
+                        t_triangles.push_back((unsigned int)index);
+                        t_relative.push_back(false);
                     }
-
+                    p = e;
                 }
 
+                if (!message && (t_triangles.size()<3))
+                    message = "Fewer than 3 vertices for a polygon";
 
+                //if face has more than 3 vertices, break down into a triangle fan
+                for (i=2;i<(int)t_triangles.size();i++)
+                {
+                    int corners[3] = {0,i-1,i};
+                    for (int k=0;k<3;k++)
+                    {
+                        if (t_relative[corners[k]])
+                            chunk.relativeVertices.push_back(chunk.triangles.size());
+                        chunk.triangles.push_back(t_triangles[corners[k]]);
+                    }
+                }
             }
-        }
-
-        if (scaleAndCenter)
-        {
-            //center about the origin and within a cube of side 1 centered at the origin
-            //find the centroid
-            glm::vec4 center = vertices[0];
-
-            glm::vec4 minimum = center;
-            glm::vec4 maximum = center;
 
-            for (i=1;i<vertices.size();i++)
+            if (message)
             {
-                //center = center.add(vertices.get(i).x,vertices.get(i).y,vertices.get(i).z,0.0f);
-                minimum = glm::min(minimum,vertices[i]);
-                maximum = glm::max(maximum,vertices[i]);
+                chunk.errorLine = lineno;
+                chunk.errorMessage = message;
+                return;
             }
+        }
+        chunk.lines = lineno;
+    }
 
-            center = (minimum + maximum)*0.5f;
-
-
-            float longest;
-
-
-            longest = std::max(maximum.x-minimum.x,std::max(maximum.y-minimum.y,maximum.z-minimum.z));
+    //move p to the start of the next token on the line; false if there is none
+    static bool nextToken(const char *&p, const char *lineEnd)
+    {
+        while ((p<lineEnd) && isSpace(*p))
+            p++;
+        return p<lineEnd;
+    }
 
-            //first translate and then scale
-            glm::mat4 transformMatrix = glm::scale(glm::mat4(1.0),
-                                                    glm::vec3(1.0f/longest,
-                                                              1.0f/longest,
-                                                              1.0f/longest))
-                                                  * glm::translate(glm::mat4(1.0),
-                                                        glm::vec3(-center.x,
-                                                                 -center.y,
-                                                                 -center.z));
+    static const char *tokenEnd(const char *p, const char *lineEnd)
+    {
+        while ((p<lineEnd) && !isSpace(*p))
+            p++;
+        return p;
+    }
 
-            //scale down each other
-            for (i=0;i<vertices.size();i++)
+    /*
+     * Read the number at the start of each token after p into values, up
+     * to max of them; returns how many tokens there were. A number is read
+     * straight from the text and ends its token unless something else
+     * follows it, so tokens are only scanned when they are not numbers.
+     */
+    static int parseFloats(const char *p, const char *lineEnd, float *values, int max)
+    {
+        int count = 0;
+        while (nextToken(p,lineEnd))
+        {
+            if (count<max)
             {
-                vertices[i] = transformMatrix * vertices[i];
+                const char *start = p;
+                if (*start=='+')
+                    start++;
+                values[count] = 0.0f;
+                p = from_chars(start,lineEnd,values[count]).ptr;
+                if ((p<lineEnd) && !isSpace(*p))
+                    p = tokenEnd(p,lineEnd);
             }
+            else
+                p = tokenEnd(p,lineEnd);
+            count++;
         }
+        return count;
+    }
 
-        vector<K> vertexData;
-        vector<float> data;
-        for (i=0;i<vertices.size();i++) {
-            K v;
-			
-			data.clear();
-			data.push_back(vertices[i].x);
-			data.push_back(vertices[i].y);
-			data.push_back(vertices[i].z);
-			data.push_back(vertices[i].w);
-			
-            v.setData("position",data);
-            if (texcoords.size()==vertices.size())
-            {
-				data.clear();
-				data.push_back(texcoords[i].x);
-				data.push_back(texcoords[i].y);
-				data.push_back(texcoords[i].z);
-				data.push_back(texcoords[i].w);
-				v.setData("texcoord",data);
-			}    
-            if (normals.size()==vertices.size())
-			{
-				data.clear();
-				data.push_back(normals[i].x);
-				data.push_back(normals[i].y);
-				data.push_back(normals[i].z);
-				data.push_back(normals[i].w);
-				v.setData("normal",data);
-			}
-
-            vertexData.push_back(v);
-        }
+    static int toInt(const char *begin, const char *end)
+    {
+        if ((begin<end) && (*begin=='+'))
+            begin++;
+        int value = 0;
+        from_chars(begin,end,value);
+        return value;
+    }
 
-        if ((normals.size()==0) || (normals.size()!=vertices.size()))
-            mesh.computeNormals();
+    static bool isSpace(char c)
+    {
+        return (c==' ') || (c=='\t') || (c=='\r') || (c=='\v') || (c=='\f');
+    }
 
-        mesh.setVertexData(vertexData);
-        mesh.setPrimitives(triangles);
-        mesh.setPrimitiveType(GL_TRIANGLES);
-        mesh.setPrimitiveSize(3);
-        return mesh;
+    static string error(int lineno, const char *message)
+    {
+        stringstream str;
+        str << "Line " << lineno << ": " << message;
+        return str.str();
     }
 };
 }
@@ -2,6 +2,7 @@
 #define _OBJECTINSTANCE_H_
 
 #include "PolygonMesh.h"
+#include <stdexcept>
 #include <string>
 using namespace std;
 #include "ShaderProgram.h"
@@ -34,6 +35,12 @@ namespace util
       //set the name
       setName(name);
 
+      //nothing allocated on the GPU yet
+      vao = 0;
+      vbo[0] = vbo[1] = 0;
+      primitiveType = 0;
+      primitiveCount = 0;
+
 
     }
     ~ObjectInstance(){}
@@ -47,11 +54,37 @@ namespace util
     void initPolygonMesh(const ShaderLocationsVault& shaderLocations,
                          const map<string,string>& shaderVarsToAttributeNames,
                          const PolygonMesh<K>& mesh) ;
+    /*
+     * The same, consuming the mesh: its arrays are freed as soon as they
+     * are on the GPU rather than when the caller's copy goes away
+     */
+    template <class K>
+    void initPolygonMesh(ShaderProgram& program,
+                         const ShaderLocationsVault& shaderLocations,
+                         const map<string,string>& shaderVarsToAttributeNames,
+                         PolygonMesh<K>&& mesh)
+    {
+      PolygonMesh<K> consumed(std::move(mesh));
+      initPolygonMesh(program,shaderLocations,shaderVarsToAttributeNames,
+                      static_cast<const PolygonMesh<K>&>(consumed));
+    }
+    template <class K>
+    void initPolygonMesh(const ShaderLocationsVault& shaderLocations,
+                         const map<string,string>& shaderVarsToAttributeNames,
+                         PolygonMesh<K>&& mesh)
+    {
+      PolygonMesh<K> consumed(std::move(mesh));
+      initPolygonMesh(shaderLocations,shaderVarsToAttributeNames,
+                      static_cast<const PolygonMesh<K>&>(consumed));
+    }
     inline void draw() const;
     inline void setName(string name);
     inline string getName() const;
     inline glm::vec4 getMinimumBounds() const;
     inline glm::vec4 getMaximumBounds() const;
+    inline unsigned int getPrimitiveCount() const;
+    inline unsigned int getPrimitiveType() const;
+    inline GLuint getVAO() const;
     inline void cleanup();
   private:
     inline void initVertexObjects();
@@ -95,52 +128,19 @@ namespace util
                                        const map<string,string>& shaderVarsToAttributeNames,
                                        const PolygonMesh<K>& mesh)
   {
-    unsigned int i,j;
-
     initVertexObjects();
 
 
     primitiveType = mesh.getPrimitiveType();
     primitiveCount = mesh.getPrimitiveCount();
-    //get a list of all the vertex attributes from the mesh
-    vector<K> vertexDataList = mesh.getVertexAttributes();
-    vector<unsigned int> primitives = mesh.getPrimitives();
+    //views of the mesh's vertex attributes and indices, uploaded without a copy
+    ArrayView<K> vertexDataList = mesh.getVertexAttributes();
+    ArrayView<unsigned int> primitives = mesh.getPrimitives();
 
 
-    //No need to create buffers in C++!
-
-    int sizeOfOneVertex=0;
-    map<string,int> offsets;
-
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
-      {
-        offsets[it->second] = sizeOfOneVertex;
-        sizeOfOneVertex += vertexDataList[0].getData(it->second).size();
-      }
-
-    int stride;
-
-    if (shaderVarsToAttributeNames.size()>1)
-      stride = sizeOfOneVertex;
-    else
-      stride = 0;
-
-
-    vector<float> vertexDataAsFloats;
-    vector<float> data;
-
-    for (i=0;i<vertexDataList.size();i++)
-      {
-        for (map<string,string>::const_iterator e = shaderVarsToAttributeNames.cbegin();e!=shaderVarsToAttributeNames.cend();e++)
-          {
-            data.clear();
-            data = vertexDataList[i].getData(e->second);
-            for (j=0;j<data.size();j++)
-              {
-                vertexDataAsFloats.push_back(data[j]);
-              }
-          }
-      }
+    //the vertices are already packed floats, K::STRIDE per vertex, so they
+    //are uploaded as they are; only the attributes asked for get pointers
+    int stride = K::STRIDE;
 
 
 
@@ -157,8 +157,8 @@ namespace util
     //copy all the data to the vbo[0]
     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
     glBufferData(GL_ARRAY_BUFFER,
-                    sizeof(float) * vertexDataAsFloats.size(),
-                    &vertexDataAsFloats[0],
+                    sizeof(K) * vertexDataList.size(),
+                    vertexDataList.data(),
         GL_STATIC_DRAW);
 
 
@@ -179,17 +179,21 @@ namespace util
          */
 
 
+        const AttributeInfo *attribute = K::find(it->second);
+        if (attribute==nullptr)
+          throw runtime_error("No attribute: "+it->second+" found!");
+
         int shaderLocation = shaderLocations.getLocation(it->first);
         
         if (shaderLocation>=0)
           {
             //tell opengl how to interpret the above data
             glVertexAttribPointer(shaderLocation,
-                                     vertexDataList[0].getData(it->second).size(),
+                                     attribute->components,
                 GL_FLOAT,
                 GL_FALSE,
                 sizeof(float) * stride,
-                (void *)(sizeof(float) * offsets[it->second]));
+                (void *)(sizeof(float) * attribute->offset));
             //enable this attribute so that when rendered, this is sent to the vertex shader
             glEnableVertexAttribArray(shaderLocation);
           }
@@ -205,7 +209,7 @@ namespace util
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                     primitives.size()*sizeof(GLuint),
-                    &primitives[0],
+                    primitives.data(),
         GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
@@ -234,51 +238,18 @@ namespace util
                                        const map<string,string>& shaderVarsToAttributeNames,
                                        const PolygonMesh<K>& mesh)
   {
-    unsigned int i,j;
-
     initVertexObjects();
 
     primitiveType = mesh.getPrimitiveType();
     primitiveCount = mesh.getPrimitiveCount();
-    //get a list of all the vertex attributes from the mesh
-    vector<K> vertexDataList = mesh.getVertexAttributes();
-    vector<unsigned int> primitives = mesh.getPrimitives();
-
+    //views of the mesh's vertex attributes and indices, uploaded without a copy
+    ArrayView<K> vertexDataList = mesh.getVertexAttributes();
+    ArrayView<unsigned int> primitives = mesh.getPrimitives();
 
-    //No need to create buffers in C++!
 
-    int sizeOfOneVertex=0;
-    map<string,int> offsets;
-
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
-      {
-        offsets[it->second] = sizeOfOneVertex;
-        sizeOfOneVertex += vertexDataList[0].getData(it->second).size();
-      }
-
-    int stride;
-
-    if (shaderVarsToAttributeNames.size()>1)
-      stride = sizeOfOneVertex;
-    else
-      stride = 0;
-
-
-    vector<float> vertexDataAsFloats;
-    vector<float> data;
-
-    for (i=0;i<vertexDataList.size();i++)
-      {
-        for (map<string,string>::const_iterator e = shaderVarsToAttributeNames.cbegin();e!=shaderVarsToAttributeNames.cend();e++)
-          {
-            data.clear();
-            data = vertexDataList[i].getData(e->second);
-            for (j=0;j<data.size();j++)
-              {
-                vertexDataAsFloats.push_back(data[j]);
-              }
-          }
-      }
+    //the vertices are already packed floats, K::STRIDE per vertex, so they
+    //are uploaded as they are; only the attributes asked for get pointers
+    int stride = K::STRIDE;
 
 
 
@@ -293,8 +264,8 @@ namespace util
     //copy all the data to the vbo[0]
     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
     glBufferData(GL_ARRAY_BUFFER,
-                    sizeof(float) * vertexDataAsFloats.size(),
-                    &vertexDataAsFloats[0],
+                    sizeof(K) * vertexDataList.size(),
+                    vertexDataList.data(),
         GL_STATIC_DRAW);
 
 
@@ -315,17 +286,21 @@ namespace util
          */
 
 
+        const AttributeInfo *attribute = K::find(it->second);
+        if (attribute==nullptr)
+          throw runtime_error("No attribute: "+it->second+" found!");
+
         int shaderLocation = shaderLocations.getLocation(it->first);
         
         if (shaderLocation>=0)
           {
             //tell opengl how to interpret the above data
             glVertexAttribPointer(shaderLocation,
-                                     vertexDataList[0].getData(it->second).size(),
+                                     attribute->components,
                 GL_FLOAT,
                 GL_FALSE,
                 sizeof(float) * stride,
-                (void *)(sizeof(float) * offsets[it->second]));
+                (void *)(sizeof(float) * attribute->offset));
             //enable this attribute so that when rendered, this is sent to the vertex shader
             glEnableVertexAttribArray(shaderLocation);
           }
@@ -341,7 +316,7 @@ namespace util
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                     primitives.size()*sizeof(GLuint),
-                    &primitives[0],
+                    primitives.data(),
         GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
@@ -364,6 +339,8 @@ namespace util
         glDeleteBuffers(2,vbo);
         //give back the VAO ID to OpenGL, so that it can be reused
         glDeleteVertexArrays(1,&vao);
+        vao = 0;
+        vbo[0] = vbo[1] = 0;
       }
   }
 
@@ -388,6 +365,33 @@ namespace util
 
 
 
+  /*
+ * Gets the number of indices drawn by draw()
+ */
+
+  unsigned int ObjectInstance::getPrimitiveCount() const
+  {
+    return primitiveCount;
+  }
+
+  /*
+ * Gets the primitive type passed to glDrawElements by draw()
+ */
+
+  unsigned int ObjectInstance::getPrimitiveType() const
+  {
+    return primitiveType;
+  }
+
+  /*
+ * Gets the VAO that draw() binds, for callers that batch their own draws
+ */
+
+  GLuint ObjectInstance::getVAO() const
+  {
+    return vao;
+  }
+
   /*
  * Set the name of this object
  */
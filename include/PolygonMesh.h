@@ -3,7 +3,15 @@
 
 #define GLM_FORCE_SWIZZLE
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <thread>
+#include <utility>
 #include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "ArrayView.h"
+#include "VertexLayout.h"
 using namespace std;
 
 namespace util
@@ -12,8 +20,16 @@ namespace util
 
 /*
  * This class represents a polygon mesh. This class works with any
- * representation of vertex attributes that implements the
- * @link{IVertexData} interface.
+ * VertexLayout as its representation of vertex attributes; bounds and
+ * normals are computed when the layout has Position (and Normal).
+ *
+ * Vertices and indices are read through views, never copied out, and the
+ * setters have rvalue overloads so large arrays can be moved in
+ * (setVertexData(std::move(v))) rather than copied.
+ *
+ * The bounding box is a SIMD min/max over the packed positions, spread
+ * over threads for large meshes and kept per block of vertices so that
+ * updateVertexData() only rescans what changed.
  *
  * It stores a polygon mesh as follows:
  *
@@ -39,6 +55,10 @@ class PolygonMesh
 public:
     PolygonMesh();
     ~PolygonMesh();
+    PolygonMesh(const PolygonMesh&) = default;
+    PolygonMesh(PolygonMesh&&) = default;
+    PolygonMesh& operator=(const PolygonMesh&) = default;
+    PolygonMesh& operator=(PolygonMesh&&) = default;
     /*
      * Set the primitive type. The primitive type is represented by an integer.
      * For example in OpenGL, these would be GL_TRIANGLES, GL_TRIANGLE_FAN,
@@ -58,13 +78,25 @@ public:
 
     glm::vec4 getMinimumBounds() const;
     glm::vec4 getMaximumBounds() const;
-    vector<VertexType> getVertexAttributes() const;
-    vector<unsigned int> getPrimitives() const;
+    /*
+     * Views of the vertices and indices, valid until the mesh is changed
+     */
+    ArrayView<VertexType> getVertexAttributes() const;
+    ArrayView<unsigned int> getPrimitives() const;
     void setVertexData(const vector<VertexType>& vp);
+    void setVertexData(vector<VertexType>&& vp);
     void setPrimitives(const vector<unsigned int>& t);
+    void setPrimitives(vector<unsigned int>&& t);
     /*
-     * Compute vertex normals in this polygon mesh using Newell's method, if
-     * position data exists
+     * Overwrite the vertices from first on with vp; any that would fall
+     * past the last vertex are dropped. Only the bounds of the blocks they
+     * fall in are recomputed
+     */
+    void updateVertexData(size_t first, ArrayView<VertexType> vp);
+    /*
+     * Compute vertex normals in this polygon mesh, if position and normal
+     * data exist: each vertex gets the area-weighted average of the normals
+     * (by Newell's method) of the polygons around it
      */
     void computeNormals();
     /*
@@ -72,7 +104,26 @@ public:
      */
     void computeBoundingBox();
 
+    //vertices per block of cached bounds
+    static const size_t BOUNDS_BLOCK = 4096;
+    //fewer vertices than this are bounded on the calling thread
+    static const size_t PARALLEL_BOUNDS = 1<<18;
+    //fewer polygons than this get normals on the calling thread
+    static const size_t PARALLEL_NORMALS = 1<<16;
 
+private:
+    //call f(begin,end) over [0,count) split in one range per core, or
+    //as f(0,count) on this thread when count is below minParallel
+    template <class F>
+    static void forRanges(size_t count, size_t minParallel, F f);
+
+    /*
+     * Bounds are kept per block of BOUNDS_BLOCK vertices and reduced into
+     * minBounds/maxBounds, so changing a range of vertices only rescans
+     * the blocks it touches
+     */
+    void computeBlockBounds(size_t firstBlock, size_t lastBlock);
+    void reduceBlockBounds();
 
 protected:
     vector<VertexType> vertexData;
@@ -80,6 +131,7 @@ protected:
     int primitiveType;
     int primitiveSize;
     glm::vec4 minBounds,maxBounds; //bounding box
+    vector<glm::vec4> blockMin,blockMax;
 
 };
 
@@ -144,185 +196,276 @@ glm::vec4 PolygonMesh<VertexType>::getMaximumBounds() const
 
 
 template<class VertexType>
-vector<VertexType> PolygonMesh<VertexType>::getVertexAttributes() const
+ArrayView<VertexType> PolygonMesh<VertexType>::getVertexAttributes() const
 {
-    return vector<VertexType>(vertexData);
+    return ArrayView<VertexType>(vertexData);
 }
 
 template<class VertexType>
-vector<unsigned int> PolygonMesh<VertexType>::getPrimitives() const
+ArrayView<unsigned int> PolygonMesh<VertexType>::getPrimitives() const
 {
-    return vector<unsigned int>(primitives);
+    return ArrayView<unsigned int>(primitives);
 }
 
 template <class VertexType>
 void PolygonMesh<VertexType>::setVertexData(const vector<VertexType>& vp)
 {
-    vertexData = vector<VertexType>(vp);
+    vertexData = vp;
+    computeBoundingBox();
+}
+
+template <class VertexType>
+void PolygonMesh<VertexType>::setVertexData(vector<VertexType>&& vp)
+{
+    vertexData = std::move(vp);
     computeBoundingBox();
 }
 
 template<class VertexType>
 void PolygonMesh<VertexType>::setPrimitives(const vector<unsigned int>& t)
 {
-    primitives = vector<unsigned int>(t);
+    primitives = t;
 }
 
-
 template<class VertexType>
-void PolygonMesh<VertexType>::computeBoundingBox()
+void PolygonMesh<VertexType>::setPrimitives(vector<unsigned int>&& t)
 {
-    unsigned int i,j;
+    primitives = std::move(t);
+}
 
-    if (vertexData.size()<=0)
-        return;
 
-    if (!vertexData[0].hasData("position"))
-    {
+template<class VertexType>
+void PolygonMesh<VertexType>::updateVertexData(size_t first, ArrayView<VertexType> vp)
+{
+    if (first>=vertexData.size())
+        return;
+    size_t count = std::min(vp.size(),vertexData.size()-first);
+    if (count==0)
         return;
-    }
 
-    vector<glm::vec4> positions;
+    std::copy(vp.begin(),vp.begin()+count,vertexData.begin()+first);
+    computeBlockBounds(first/BOUNDS_BLOCK,(first+count-1)/BOUNDS_BLOCK+1);
+    reduceBlockBounds();
+}
 
-    for (i=0;i<vertexData.size();i++)
+template<class VertexType>
+void PolygonMesh<VertexType>::computeBoundingBox()
+{
+    if (vertexData.size()<=0)
     {
-        vector<float> data = vertexData[i].getData("position");
-        glm::vec4 pos = glm::vec4(0,0,0,1);
-        switch (data.size()) {
-        case 4: pos.w = data[3];
-        case 3: pos.z = data[2];
-        case 2: pos.y = data[1];
-        case 1: pos.x = data[0];
-        }
-        positions.push_back(pos);
+        //no vertices, nothing left of the old bounds
+        blockMin.clear();
+        blockMax.clear();
+        minBounds = maxBounds = glm::vec4(0.0f);
+        return;
     }
 
-    minBounds = glm::vec4(positions[0]);
-    maxBounds = glm::vec4(positions[0]);
+    size_t blocks = (vertexData.size()+BOUNDS_BLOCK-1)/BOUNDS_BLOCK;
+    blockMin.resize(blocks);
+    blockMax.resize(blocks);
 
-    for (j=0;j<positions.size();j++)
-    {
-        glm::vec4 p = positions[j];
+    //large meshes are split into runs of blocks, one per core
+    forRanges(blocks,(PARALLEL_BOUNDS+BOUNDS_BLOCK-1)/BOUNDS_BLOCK,
+              [this](size_t begin, size_t end) { computeBlockBounds(begin,end); });
 
-        if (p.x<minBounds.x)
-        {
-            minBounds.x = p.x;
-        }
+    reduceBlockBounds();
+}
 
-        if (p.x>maxBounds.x)
-        {
-            maxBounds.x = p.x;
-        }
+template<class VertexType>
+template <class F>
+void PolygonMesh<VertexType>::forRanges(size_t count, size_t minParallel, F f)
+{
+    size_t threads = 1;
+    if (count>=minParallel)
+        threads = std::min((size_t)std::max(1u,std::thread::hardware_concurrency()),count);
+
+    vector<std::thread> workers;
+    for (size_t t=1;t<threads;t++)
+        workers.push_back(std::thread(f,count*t/threads,count*(t+1)/threads));
+    f(0,count/threads);
+    for (size_t t=0;t<workers.size();t++)
+        workers[t].join();
+}
 
-        if (p.y<minBounds.y)
+template<class VertexType>
+void PolygonMesh<VertexType>::computeBlockBounds(size_t firstBlock, size_t lastBlock)
+{
+    if constexpr (VertexType::template has<Position>())
+    {
+        const int at = VertexType::template offset<Position>();
+        for (size_t b=firstBlock;b<lastBlock;b++)
         {
-            minBounds.y = p.y;
+            const VertexType *v = &vertexData[b*BOUNDS_BLOCK];
+            size_t count = std::min(BOUNDS_BLOCK,vertexData.size()-b*BOUNDS_BLOCK);
+
+#if defined(__SSE2__)
+            //all four components at once; min(p,lo) keeps lo when p is NaN,
+            //as the comparisons below do
+            static_assert(Position::components==4,"positions are loaded 4 floats at a time");
+            __m128 lo = _mm_loadu_ps(v[0].data()+at);
+            __m128 hi = lo;
+            for (size_t i=1;i<count;i++)
+            {
+                __m128 p = _mm_loadu_ps(v[i].data()+at);
+                lo = _mm_min_ps(p,lo);
+                hi = _mm_max_ps(p,hi);
+            }
+            _mm_storeu_ps(&blockMin[b].x,lo);
+            _mm_storeu_ps(&blockMax[b].x,hi);
+#else
+            glm::vec4 lo = v[0].template get<Position>();
+            glm::vec4 hi = lo;
+            for (size_t i=1;i<count;i++)
+            {
+                glm::vec4 p = v[i].template get<Position>();
+                for (int k=0;k<3;k++)
+                {
+                    if (p[k]<lo[k])
+                        lo[k] = p[k];
+                    if (p[k]>hi[k])
+                        hi[k] = p[k];
+                }
+            }
+            blockMin[b] = lo;
+            blockMax[b] = hi;
+#endif
         }
+    }
+}
 
-        if (p.y>maxBounds.y)
-        {
-            maxBounds.y = p.y;
-        }
+template<class VertexType>
+void PolygonMesh<VertexType>::reduceBlockBounds()
+{
+    if constexpr (VertexType::template has<Position>())
+    {
+        if (blockMin.empty())
+            return;
 
-        if (p.z<minBounds.z)
-        {
-            minBounds.z = p.z;
-        }
+        minBounds = blockMin[0];
+        maxBounds = blockMax[0];
 
-        if (p.z>maxBounds.z)
+        for (size_t j=1;j<blockMin.size();j++)
         {
-            maxBounds.z = p.z;
+            glm::vec4 lo = blockMin[j];
+            glm::vec4 hi = blockMax[j];
+
+            if (lo.x<minBounds.x)
+            {
+                minBounds.x = lo.x;
+            }
+
+            if (hi.x>maxBounds.x)
+            {
+                maxBounds.x = hi.x;
+            }
+
+            if (lo.y<minBounds.y)
+            {
+                minBounds.y = lo.y;
+            }
+
+            if (hi.y>maxBounds.y)
+            {
+                maxBounds.y = hi.y;
+            }
+
+            if (lo.z<minBounds.z)
+            {
+                minBounds.z = lo.z;
+            }
+
+            if (hi.z>maxBounds.z)
+            {
+                maxBounds.z = hi.z;
+            }
         }
+
+        //only x, y and z are bounds; w is the first vertex's
+        minBounds.w = maxBounds.w = vertexData[0].template get<Position>().w;
     }
 }
 
 /*
- * Compute vertex normals in this polygon mesh using Newell's method, if
- * position data exists
+ * Compute vertex normals in this polygon mesh, if position and normal data
+ * exist.
+ *
+ * Newell's method gives each polygon a normal whose length is twice its
+ * area, so summing them unnormalized weights every polygon by its area.
+ * The sum is gathered per vertex through a vertex -> polygon adjacency
+ * list rather than scattered per polygon: polygon normals and vertex sums
+ * are each computed over ranges on separate threads, and no two threads
+ * ever write the same vertex, so nothing needs atomics or locks and the
+ * result does not depend on the thread count.
  */
 
 template<class VertexType>
 void PolygonMesh<VertexType>::computeNormals()
 {
-    int i,j,k;
-
-    if (vertexData.size()<=0)
-        return;
-
-    if (!vertexData[0].hasData("position"))
+    if constexpr (VertexType::template has<Position>() && VertexType::template has<Normal>())
     {
-        return;
-    }
-
-    if (!vertexData[0].hasData("normal"))
-        return;
+        if ((vertexData.size()<=0) || (primitiveSize<=0))
+            return;
 
-    vector<glm::vec4> positions;
+        size_t polygonCount = primitives.size()/primitiveSize;
+        size_t vertexCount = vertexData.size();
+        int size = primitiveSize;
 
-    for (i=0;i<positions.size();i++) {
-        vector<float> data = vertexData[i].getData("position");
-        glm::vec4 pos;
-        switch (data.size()) {
-        case 4: pos.w = data[3];
-        case 3: pos.z = data[2];
-        case 2: pos.y = data[1];
-        case 1: pos.x = data[0];
-        }
-        positions.push_back(pos);
-    }
-    vector<glm::vec4> normals;
-
-    for (i=0;i<positions.size();i++)
-    {
-        normals.push_back(glm::vec4(0.0f,0.0f,0.0f,0.0f));
-    }
-
-    for (i=0;i<primitives.size();i+=primitiveSize)
-    {
-        glm::vec4 norm = glm::vec4(0.0f,0.0f,0.0f,0.0f);
-
-
-
-        //compute the normal of this triangle
-        vector<unsigned int>v;
-
-        for (k=0;k<primitiveSize;k++)
+        //1. the (area-weighted) normal of every polygon
+        vector<glm::vec3> polygonNormals(polygonCount);
+        forRanges(polygonCount,PARALLEL_NORMALS,[&](size_t begin, size_t end)
         {
-            v.push_back(primitives[i+k]);
-        }
-
-        //the newell's method to calculate normal
-
-        for (k=0;k<primitiveSize;k++)
+            for (size_t f=begin;f<end;f++)
+            {
+                const unsigned int *v = &primitives[f*size];
+                glm::vec3 norm(0.0f,0.0f,0.0f);
+
+                //a polygon with an index past the vertices has no normal
+                bool valid = true;
+                for (int k=0;k<size;k++)
+                    valid = valid && (v[k]<vertexCount);
+
+                //the newell's method to calculate normal
+                for (int k=0;valid && (k<size);k++)
+                {
+                    glm::vec4 p = vertexData[v[k]].template get<Position>();
+                    glm::vec4 q = vertexData[v[(k+1)%size]].template get<Position>();
+                    norm.x += (p.y-q.y)*(p.z+q.z);
+                    norm.y += (p.z-q.z)*(p.x+q.x);
+                    norm.z += (p.x-q.x)*(p.y+q.y);
+                }
+                polygonNormals[f] = norm;
+            }
+        });
+
+        //2. vertex -> polygons that use it, in compressed form
+        vector<unsigned int> firstPolygon(vertexCount+1,0);
+        for (size_t i=0;i<polygonCount*size;i++)
+            if (primitives[i]<vertexCount)
+                firstPolygon[primitives[i]+1]++;
+        for (size_t i=0;i<vertexCount;i++)
+            firstPolygon[i+1] += firstPolygon[i];
+
+        vector<unsigned int> vertexPolygons(firstPolygon[vertexCount]);
+        vector<unsigned int> fill(firstPolygon.begin(),firstPolygon.end()-1);
+        for (size_t i=0;i<polygonCount*size;i++)
+            if (primitives[i]<vertexCount)
+                vertexPolygons[fill[primitives[i]]++] = (unsigned int)(i/size);
+
+        //3. every vertex sums the polygons around it
+        forRanges(vertexCount,PARALLEL_NORMALS,[&](size_t begin, size_t end)
         {
-            norm.x += (positions[v[k]].y-positions[v[(k+1)%primitiveSize]].y)*
-                      (positions[v[k]].z+positions[v[(k+1)%primitiveSize]].z);
-            norm.y += (positions[v[k]].z-positions[v[(k+1)%primitiveSize]].z)*
-                      (positions[v[k]].x+positions[v[(k+1)%primitiveSize]].x);
-            norm.z += (positions[v[k]].x-positions[v[(k+1)%primitiveSize]].x)*
-                      (positions[v[k]].y+positions[v[(k+1)%primitiveSize]].y);
-        }
-        norm = glm::normalize(norm);
-
-        for (k=0;k<primitiveSize;k++)
-        {
-            normals[v[k]] = normals[v[k]] + norm;
-        }
-    }
-
-    for (i=0;i<normals.size();i++)
-    {
-
-        normals[i] = glm::normalize(normals[i]);
-    }
-    for (i=0;i<vertexData.size();i++) {
-        vector<float> n;
-
-        n.push_back(normals[i].x);
-        n.push_back(normals[i].y);
-        n.push_back(normals[i].z);
-        n.push_back(normals[i].w);
-        vertexData[i].setData("normal",n);
+            for (size_t i=begin;i<end;i++)
+            {
+                glm::vec3 sum(0.0f,0.0f,0.0f);
+                for (unsigned int j=firstPolygon[i];j<firstPolygon[i+1];j++)
+                    sum += polygonNormals[vertexPolygons[j]];
+
+                //vertices no polygon uses (or only degenerate ones) get none
+                float length = glm::length(sum);
+                glm::vec3 n = (length>0.0f) ? sum/length : glm::vec3(0.0f);
+                vertexData[i].template set<Normal>(glm::vec4(n,0.0f));
+            }
+        });
     }
 }
 
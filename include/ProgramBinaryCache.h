@@ -0,0 +1,272 @@
+#ifndef _PROGRAMBINARYCACHE_H_
+#define _PROGRAMBINARYCACHE_H_
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+//ARB_get_program_binary (core in 4.1), newer than the loader in glad/
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+#define GL_PROGRAM_BINARY_FORMATS          0x87FF
+#endif
+
+namespace util
+{
+
+/*
+ * Keeps linked shader programs on disk so later launches can skip compiling
+ * and linking GLSL. Each program is stored with glGetProgramBinary under a
+ * key that hashes its sources together with GL_RENDERER and GL_VERSION, so a
+ * new driver or GPU simply misses. A binary the driver refuses anyway (it is
+ * allowed to) is deleted and the caller compiles from source as before.
+ *
+ * Typical use:
+ *   GLuint program = cache.load(vs,fs);
+ *   if (!program)
+ *   {
+ *       ...create, attach shaders...
+ *       cache.prepare(program);
+ *       ...link...
+ *       cache.store(program,vs,fs);
+ *   }
+ */
+class ProgramBinaryCache
+{
+public:
+    ProgramBinaryCache()
+    {
+        enabled = false;
+        hits = misses = rejected = 0;
+        GetProgramBinary = NULL;
+        ProgramBinary = NULL;
+        ProgramParameteri = NULL;
+    }
+
+    ~ProgramBinaryCache(){}
+
+    /*
+     * Look up the entry points and create the cache directory. Must be called
+     * with the context current.
+     * \param load the loader given to gladLoadGLLoader
+     * \param directory where binaries are kept
+     * \return false if the driver cannot save program binaries; the cache
+     *         then misses every time
+     */
+    bool init(GLADloadproc load,const string& directory)
+    {
+        enabled = false;
+        dir = directory;
+
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION,&major);
+        glGetIntegerv(GL_MINOR_VERSION,&minor);
+        if (((major<4) || ((major==4) && (minor<1))) && !hasExtension("GL_ARB_get_program_binary"))
+            return false;
+
+        GetProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+        ProgramBinary = (ProgramBinaryProc)load("glProgramBinary");
+        ProgramParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+        if (!GetProgramBinary || !ProgramBinary || !ProgramParameteri)
+            return false;
+
+        //some drivers expose the API but no format to save in
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+        if (formats<=0)
+            return false;
+
+        driver = string((const char *)glGetString(GL_RENDERER)) + "\n"
+               + string((const char *)glGetString(GL_VERSION));
+
+        error_code ec;
+        filesystem::create_directories(dir,ec);
+        if (ec)
+            return false;
+
+        enabled = true;
+        return true;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    /*
+     * Create a program from a stored binary
+     * \return the linked program, or 0 on a miss
+     */
+    GLuint load(const string& vertSource,const string& fragSource)
+    {
+        if (!enabled)
+            return 0;
+
+        uint64_t key = makeKey(vertSource,fragSource);
+        ifstream file(pathFor(key).c_str(),ios::binary);
+        if (!file.is_open())
+        {
+            misses++;
+            return 0;
+        }
+
+        Header header;
+        file.read((char *)&header,sizeof(header));
+        vector<char> binary;
+        if (file && (memcmp(header.magic,kMagic,4)==0) && (header.key==key))
+        {
+            binary.resize(header.length);
+            file.read(binary.data(),header.length);
+        }
+        file.close();
+
+        if (binary.empty() || ((size_t)file.gcount()!=binary.size()))
+        {
+            reject(key);
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        ProgramBinary(program,header.format,binary.data(),(GLsizei)binary.size());
+
+        GLint linked = 0;
+        glGetProgramiv(program,GL_LINK_STATUS,&linked);
+        if (!linked)
+        {
+            //the driver changed in a way its strings didn't show
+            glDeleteProgram(program);
+            reject(key);
+            return 0;
+        }
+        hits++;
+        return program;
+    }
+
+    /*
+     * Ask the driver to keep the binary around. Call before linking.
+     */
+    void prepare(GLuint program)
+    {
+        if (enabled)
+            ProgramParameteri(program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+    }
+
+    /*
+     * Save a successfully linked program under its sources
+     */
+    void store(GLuint program,const string& vertSource,const string& fragSource)
+    {
+        if (!enabled)
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program,GL_PROGRAM_BINARY_LENGTH,&length);
+        if (length<=0)
+            return;
+
+        vector<char> binary(length);
+        Header header = {}; //padding is written to the file too
+        memcpy(header.magic,kMagic,4);
+        header.key = makeKey(vertSource,fragSource);
+        header.format = 0;
+        GLsizei written = 0;
+        GetProgramBinary(program,length,&written,&header.format,binary.data());
+        header.length = (uint32_t)written;
+
+        ofstream file(pathFor(header.key).c_str(),ios::binary|ios::trunc);
+        if (!file.is_open())
+            return;
+        file.write((const char *)&header,sizeof(header));
+        file.write(binary.data(),written);
+    }
+
+    //lookups served from disk, not found, and found but unusable
+    int getHits() const { return hits; }
+    int getMisses() const { return misses; }
+    int getRejected() const { return rejected; }
+
+private:
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program,GLsizei bufSize,GLsizei *length,
+                                                  GLenum *binaryFormat,void *binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program,GLenum binaryFormat,
+                                               const void *binary,GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program,GLenum pname,GLint value);
+
+    struct Header
+    {
+        char magic[4];
+        uint64_t key;
+        GLenum format;
+        uint32_t length;
+    };
+
+    static constexpr const char *kMagic = "PBC1";
+
+    //64-bit FNV-1a over both sources and the driver strings
+    uint64_t makeKey(const string& vertSource,const string& fragSource) const
+    {
+        uint64_t h = 14695981039346656037ULL;
+        const string *parts[3] = {&vertSource,&fragSource,&driver};
+        for (int i=0;i<3;i++)
+        {
+            const string& s = *parts[i];
+            for (unsigned int k=0;k<s.size();k++)
+            {
+                h ^= (unsigned char)s[k];
+                h *= 1099511628211ULL;
+            }
+            //separator, so moving text between the parts changes the key
+            h ^= 0xFF;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    string pathFor(uint64_t key) const
+    {
+        stringstream str;
+        str << dir << "/" << hex << key << ".bin";
+        return str.str();
+    }
+
+    void reject(uint64_t key)
+    {
+        rejected++;
+        error_code ec;
+        filesystem::remove(pathFor(key),ec);
+    }
+
+    static bool hasExtension(const char *name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS,&count);
+        for (int i=0;i<count;i++)
+        {
+            const char *ext = (const char *)glGetStringi(GL_EXTENSIONS,i);
+            if (ext && (strcmp(ext,name)==0))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    bool enabled;
+    string dir;
+    string driver;
+    int hits,misses,rejected;
+
+    GetProgramBinaryProc GetProgramBinary;
+    ProgramBinaryProc ProgramBinary;
+    ProgramParameteriProc ProgramParameteri;
+};
+}
+
+#endif
@@ -24,12 +24,8 @@ Rectangle::Rectangle(int x,int y,int width,int height) {
 
     vector<VertexAttrib> vertexData;
     for (int i=0;i<positions.size();i++) {
-        vector<float> data;
         VertexAttrib v;
-        for (int j=0;j<4;j++) {
-            data.push_back(positions[i][j]);
-        }
-        v.setData("position",data);
+        v.set<util::Position>(positions[i]);
         vertexData.push_back(v);
     }
 
@@ -43,9 +39,9 @@ Rectangle::Rectangle(int x,int y,int width,int height) {
     indices.push_back(2);
     indices.push_back(3);
 
-    this->setVertexData(vertexData);
+    this->setVertexData(std::move(vertexData));
     // give it the index data that forms the polygons
-    this->setPrimitives(indices);
+    this->setPrimitives(std::move(indices));
 
     /*
     It turns out, there are several ways of
@@ -3,6 +3,7 @@
 
 #include <glad/glad.h>
 #include "ShaderLocationsVault.h"
+#include "ProgramBinaryCache.h"
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -83,9 +84,12 @@ public:
      * \param fragShaderFile the file for the source code for the fragment
      *        shader. This file must be placed within the resources of this
      *        project for portability purposes.
+     * \param cache if not NULL, a program linked from the same sources on an
+     *        earlier run is loaded from its binary instead of compiled
      * \throws runtime_error if any error is encountered
      */
-    void createProgram(string vertShaderFile,string fragShaderFile)
+    void createProgram(string vertShaderFile,string fragShaderFile,
+                       ProgramBinaryCache *cache=NULL)
     {
 
         releaseShaders();
@@ -93,7 +97,7 @@ public:
         shaders[0] = ShaderInfo(GL_VERTEX_SHADER,vertShaderFile,-1);
         shaders[1] = ShaderInfo(GL_FRAGMENT_SHADER,fragShaderFile,-1);
 
-        program = createShaders();
+        program = createShaders(cache);
     }
 
     /*
@@ -207,39 +211,31 @@ private:
     }
 
 
-    int createShaders()
+    int createShaders(ProgramBinaryCache *cache)
     {
-        ifstream file;
         GLint linked,compiled;
-
-        program = glCreateProgram();
-
+        string sources[2];
 
         for (int i=0;i<2;i++)
-        {
-            file.open(shaders[i].filename.c_str());
-
+            sources[i] = readSource(shaders[i].filename);
 
-            if (!file.is_open())
+        if (cache!=NULL)
+        {
+            GLuint cached = cache->load(sources[0],sources[1]);
+            if (cached!=0)
             {
-                stringstream str;
-                str << "Shader " << shaders[i].filename << "not found or could not be opened!" << endl;
-                throw runtime_error(str.str());
+                //nothing was compiled, so there are no shaders to release
+                shaders[0].shader = shaders[1].shader = 0;
+                return cached;
             }
+        }
 
-            string source,line;
-
-
-            getline(file,line);
-            while (!file.eof())
-            {
-                source = source + "\n" + line;
-                getline(file,line);
-            }
-            file.close();
+        program = glCreateProgram();
 
 
-            const char *codev = source.c_str();
+        for (int i=0;i<2;i++)
+        {
+            const char *codev = sources[i].c_str();
 
 
             shaders[i].shader = glCreateShader(shaders[i].type);
@@ -256,6 +252,8 @@ private:
             glAttachShader(program, shaders[i].shader);
         }
 
+        if (cache!=NULL)
+            cache->prepare(program);
         glLinkProgram(program);
         glGetProgramiv(program,GL_LINK_STATUS,&linked);
 
@@ -266,9 +264,38 @@ private:
             throw runtime_error(error_message);
         }
 
+        if (cache!=NULL)
+            cache->store(program,sources[0],sources[1]);
+
         return program;
     }
 
+    string readSource(const string& filename)
+    {
+        ifstream file;
+        file.open(filename.c_str());
+
+
+        if (!file.is_open())
+        {
+            stringstream str;
+            str << "Shader " << filename << "not found or could not be opened!" << endl;
+            throw runtime_error(str.str());
+        }
+
+        string source,line;
+
+
+        getline(file,line);
+        while (!file.eof())
+        {
+            source = source + "\n" + line;
+            getline(file,line);
+        }
+        file.close();
+        return source;
+    }
+
     string printShaderInfoLog(GLuint shader)
     {
         int infologLen = 0;
@@ -0,0 +1,222 @@
+#ifndef _VERTEXCACHEOPTIMIZER_H_
+#define _VERTEXCACHEOPTIMIZER_H_
+
+#include <vector>
+#include <cmath>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Reorders the triangles of an indexed triangle list so that the GPU's
+ * post-transform vertex cache is hit as often as possible. It uses Tom
+ * Forsyth's "Linear-Speed Vertex Cache Optimisation": every vertex is scored
+ * on its position in a simulated LRU cache and on how many triangles still
+ * use it, and the triangle with the best total score is emitted next.
+ *
+ * It also measures the result as an ACMR (average cache miss ratio), i.e.
+ * vertex shader invocations per triangle on a FIFO cache. 3.0 means no reuse
+ * at all, 0.5 is the best a large regular grid can do.
+ */
+class VertexCacheOptimizer
+{
+public:
+    /*
+     * Return the triangles of the given list in cache-friendly order
+     * \param indices three indices per triangle
+     * \param vertexCount number of vertices the indices refer to
+     * \return the reordered index list (same triangles, same winding)
+     */
+    static vector<unsigned int> optimize(const vector<unsigned int>& indices,
+                                         unsigned int vertexCount)
+    {
+        unsigned int triCount = indices.size() / 3;
+        unsigned int i,k;
+
+        //vertex -> triangles that use it, in compressed form
+        vector<unsigned int> valence(vertexCount,0);
+        for (i=0;i<triCount*3;i++)
+            valence[indices[i]]++;
+
+        vector<unsigned int> firstTri(vertexCount+1,0);
+        for (i=0;i<vertexCount;i++)
+            firstTri[i+1] = firstTri[i] + valence[i];
+
+        vector<unsigned int> vertexTris(firstTri[vertexCount]);
+        vector<unsigned int> fill(firstTri.begin(),firstTri.end()-1);
+        for (i=0;i<triCount*3;i++)
+            vertexTris[fill[indices[i]]++] = i/3;
+
+        vector<int> cachePos(vertexCount,-1);
+        vector<float> vertexScore(vertexCount);
+        for (i=0;i<vertexCount;i++)
+            vertexScore[i] = scoreVertex(-1,valence[i]);
+
+        vector<bool> emitted(triCount,false);
+        vector<float> triScore(triCount);
+        for (i=0;i<triCount;i++)
+            triScore[i] = vertexScore[indices[3*i]]
+                        + vertexScore[indices[3*i+1]]
+                        + vertexScore[indices[3*i+2]];
+
+        vector<unsigned int> result;
+        result.reserve(triCount*3);
+
+        vector<unsigned int> cache,newCache;
+        int best = bestTriangle(triScore);
+        unsigned int scanFrom = 0;
+
+        while (best>=0)
+        {
+            //emit the triangle
+            emitted[best] = true;
+            for (k=0;k<3;k++)
+            {
+                unsigned int v = indices[3*best+k];
+                result.push_back(v);
+                valence[v]--;
+            }
+
+            //move its vertices to the front of the cache, keeping the rest in order
+            newCache.clear();
+            for (k=0;k<3;k++)
+                newCache.push_back(indices[3*best+k]);
+            for (i=0;i<cache.size();i++)
+            {
+                unsigned int v = cache[i];
+                if ((v!=newCache[0]) && (v!=newCache[1]) && (v!=newCache[2]))
+                    newCache.push_back(v);
+            }
+
+            //anything that fell off the end is no longer cached
+            for (i=kCacheSize;i<newCache.size();i++)
+            {
+                cachePos[newCache[i]] = -1;
+                vertexScore[newCache[i]] = scoreVertex(-1,valence[newCache[i]]);
+            }
+            if (newCache.size()>kCacheSize)
+                newCache.resize(kCacheSize);
+            cache.swap(newCache);
+
+            for (i=0;i<cache.size();i++)
+            {
+                cachePos[cache[i]] = i;
+                vertexScore[cache[i]] = scoreVertex(i,valence[cache[i]]);
+            }
+
+            //only triangles touching the cache changed score; pick the best of them
+            best = -1;
+            float bestScore = -1.0f;
+            for (i=0;i<cache.size();i++)
+            {
+                unsigned int v = cache[i];
+                for (k=firstTri[v];k<firstTri[v+1];k++)
+                {
+                    unsigned int t = vertexTris[k];
+                    if (emitted[t])
+                        continue;
+                    triScore[t] = vertexScore[indices[3*t]]
+                                + vertexScore[indices[3*t+1]]
+                                + vertexScore[indices[3*t+2]];
+                    if (triScore[t]>bestScore)
+                    {
+                        bestScore = triScore[t];
+                        best = t;
+                    }
+                }
+            }
+
+            //nothing connected to the cache is left: carry on from the first
+            //triangle not yet drawn, which keeps the whole pass linear
+            if (best<0)
+            {
+                while ((scanFrom<triCount) && (emitted[scanFrom]))
+                    scanFrom++;
+                if (scanFrom<triCount)
+                    best = scanFrom;
+            }
+        }
+        return result;
+    }
+
+    /*
+     * Count the vertex shader invocations needed to draw the triangle list on
+     * a FIFO post-transform cache of the given size
+     */
+    static unsigned int countCacheMisses(const vector<unsigned int>& indices,
+                                         unsigned int vertexCount,
+                                         unsigned int fifoSize=16)
+    {
+        //a vertex is cached if it was transformed fewer than fifoSize misses ago
+        vector<long> missedAt(vertexCount,-((long)fifoSize)-1);
+        long misses = 0;
+
+        for (unsigned int i=0;i<indices.size();i++)
+        {
+            unsigned int v = indices[i];
+            if (misses-missedAt[v]>(long)fifoSize)
+            {
+                missedAt[v] = misses;
+                misses++;
+            }
+        }
+        return (unsigned int)misses;
+    }
+
+    /*
+     * Average cache miss ratio: vertex shader invocations per triangle
+     */
+    static float computeACMR(const vector<unsigned int>& indices,
+                             unsigned int vertexCount,
+                             unsigned int fifoSize=16)
+    {
+        if (indices.size()<3)
+            return 0.0f;
+        return (float)countCacheMisses(indices,vertexCount,fifoSize) / (indices.size()/3);
+    }
+
+private:
+    //size of the LRU cache the optimizer models
+    static const unsigned int kCacheSize = 32;
+
+    static float scoreVertex(int cachePosition,unsigned int remainingValence)
+    {
+        //no triangles left to draw with it: never worth picking
+        if (remainingValence==0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition>=0)
+        {
+            //the three most recent vertices were just used by the last
+            //triangle, so they get a fixed, slightly lower score
+            if (cachePosition<3)
+                score = 0.75f;
+            else
+                score = pow(1.0f - (float)(cachePosition-3)/(kCacheSize-3),1.5f);
+        }
+
+        //boost vertices with few triangles left, so they get finished off
+        score += 2.0f * pow((float)remainingValence,-0.5f);
+        return score;
+    }
+
+    static int bestTriangle(const vector<float>& triScore)
+    {
+        int best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int t=0;t<triScore.size();t++)
+        {
+            if (triScore[t]>bestScore)
+            {
+                bestScore = triScore[t];
+                best = t;
+            }
+        }
+        return best;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef _VERTEXLAYOUT_H_
+#define _VERTEXLAYOUT_H_
+
+#include <glm/glm.hpp>
+#include <cstring>
+#include <string>
+#include <type_traits>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Attribute tags for VertexLayout. Each names the attribute (as shader
+ * variables are mapped to it in ObjectInstance) and gives its type, how
+ * many floats that is and what value a new vertex starts with.
+ */
+struct Position
+{
+    typedef glm::vec4 Type;
+    static constexpr const char *name = "position";
+    static constexpr int components = 4;
+    static Type initial() { return glm::vec4(0,0,0,1); }
+};
+
+struct Normal
+{
+    typedef glm::vec4 Type;
+    static constexpr const char *name = "normal";
+    static constexpr int components = 4;
+    static Type initial() { return glm::vec4(0,0,0,0); }
+};
+
+struct TexCoord
+{
+    typedef glm::vec4 Type;
+    static constexpr const char *name = "texcoord";
+    static constexpr int components = 4;
+    static Type initial() { return glm::vec4(0,0,0,1); }
+};
+
+/*
+ * Where one attribute sits in a vertex, in floats
+ */
+struct AttributeInfo
+{
+    const char *name;
+    int components;
+    int offset;
+};
+
+/*
+ * A vertex format fixed at compile time, e.g.
+ * VertexLayout<Position,Normal,TexCoord>. A vertex is nothing but its
+ * attributes' floats, packed in the order listed, so an array of them is
+ * exactly the interleaved vertex buffer OpenGL is given: STRIDE floats
+ * per vertex, each attribute at offset<A>().
+ *
+ * Attributes are read and written by tag, resolved when compiling:
+ *   v.set<Position>(p);  glm::vec4 n = v.get<Normal>();
+ * Asking for an attribute the layout does not have does not compile; use
+ * has<A>() (also a constant) to write code for several layouts.
+ */
+template <class... Attributes>
+class VertexLayout
+{
+public:
+    static constexpr int STRIDE = (Attributes::components + ... + 0);
+    static constexpr int ATTRIBUTE_COUNT = sizeof...(Attributes);
+
+    VertexLayout()
+    {
+        static_assert(sizeof(VertexLayout)==STRIDE*sizeof(float),"vertex is not packed");
+        (set<Attributes>(Attributes::initial()),...);
+    }
+
+    template <class A>
+    static constexpr bool has()
+    {
+        return (is_same<A,Attributes>::value || ...);
+    }
+
+    //floats before attribute A
+    template <class A>
+    static constexpr int offset()
+    {
+        static_assert(has<A>(),"attribute not in this vertex layout");
+        int at = 0;
+        bool found = false;
+        ((found = found || is_same<A,Attributes>::value,
+          at += found ? 0 : Attributes::components),...);
+        return at;
+    }
+
+    /*
+     * Every attribute in order, for setting up vertex attribute pointers
+     */
+    static const AttributeInfo *attributes()
+    {
+        static const AttributeInfo info[] = {
+            {Attributes::name,Attributes::components,offset<Attributes>()}...
+        };
+        return info;
+    }
+
+    /*
+     * Find an attribute by name; null if the layout does not have it
+     */
+    static const AttributeInfo *find(const string& name)
+    {
+        for (int i=0;i<ATTRIBUTE_COUNT;i++)
+            if (name == attributes()[i].name)
+                return &attributes()[i];
+        return nullptr;
+    }
+
+    template <class A>
+    typename A::Type get() const
+    {
+        typename A::Type value;
+        memcpy(&value,values+offset<A>(),sizeof(value));
+        return value;
+    }
+
+    template <class A>
+    void set(const typename A::Type& value)
+    {
+        memcpy(values+offset<A>(),&value,sizeof(value));
+    }
+
+    const float *data() const { return values; }
+
+private:
+    float values[STRIDE];
+};
+
+}
+
+#endif
@@ -2,25 +2,152 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include <cmath>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <thread>
 
 #include "DroneModel.h"
 #include "DroneView.h"
 #include "DroneController.h"
 #include "ShaderProgram.h"
+#include "RenderQueue.h"
+#include "GLExtensions.h"
+#include "ProgramBinaryCache.h"
+#include "HeadlessContext.h"
+#include "GpuTimer.h"
+#include "FramePacer.h"
+#include "ClusteredLighting.h"
+#include "DeferredRenderer.h"
+#include "Terrain.h"
+#include "TrailRenderer.h"
+#include "DynamicResolution.h"
+#include "CityView.h"
+#include "OcclusionCuller.h"
+#include "ParticleSystem.h"
+#include "RenderStats.h"
+#include "TextOverlay.h"
+#include "ShaderReloader.h"
+#include "FrameRecorder.h"
 
 // Window size
 static int gWindowWidth  = 800;
 static int gWindowHeight = 600;
 
+// Dynamic resolution: render below window size when the GPU frame time
+// exceeds the budget (0 = always full resolution)
+static double gFrameBudgetMs = 0.0;
+static float  gMinResScale   = 0.5f;
+static DynamicResolution* gDynamicResolution = nullptr;
+
+// Clip planes
+static float gNearPlane = 0.1f;
+static float gFarPlane  = 500.f;
+
 // Cameras
 static int   gCurrentCamera = 0;  
 static float gChopperAngle  = 0.0f; 
 static float gChopperSpeed  = 30.f; // deg/sec overhead orbit
 
+// Split screen: cameras 0-3 side by side, one per quarter of the window
+static bool  gSplitScreen   = false;
+
+// Escort drones flying in formation behind the controlled one
+static int   gEscortCount   = 0;
+static float gEscortSpacing = 4.f;
+
+// Print vertex cache statistics for the drone meshes at startup
+static bool  gPrintMeshStats = false;
+
+// Periodically print what the render queue did
+static bool  gPrintQueueStats = false;
+static float gQueueStatsTimer = 0.f;
+
+// Sync policy: vsync, and how many frames the GPU may lag behind the CPU
+// (1 = lowest latency, more = more CPU/GPU overlap)
+static bool  gVsync          = true;
+static int   gFramesInFlight = 2;
+
+// Periodically print input-to-swap latency
+static bool  gPrintLatencyStats = false;
+static float gLatencyStatsTimer = 0.f;
+
+// Periodically print GPU time per render pass
+static bool  gPrintGpuStats = false;
+static float gGpuStatsTimer = 0.f;
+
+// Per-frame draw, uniform, upload and state change counts: printed
+// periodically, and/or drawn over the scene
+static bool  gPrintRenderStats = false;
+static float gRenderStatsTimer = 0.f;
+static bool  gStatsOverlay     = false;
+
+// Periodically print clustered light culling numbers, and how many
+// worker threads cull (-1 = one less than the hardware has, at most 3)
+static bool  gPrintLightStats = false;
+static float gLightStatsTimer = 0.f;
+static int   gLightThreads    = -1;
+
+// Lighting backend: forward (shade while drawing) or deferred (G-buffer,
+// then one lighting pass), and how many drones carry nav lights
+static bool  gDeferred     = false;
+static int   gMaxNavLights = 1 << 30;
+
+// Heightmap terrain under the flight area, and its width. With terrain the
+// far plane moves out so the ground reaches the horizon.
+static bool        gTerrain         = false;
+static float       gTerrainSize     = 4096.f;
+static const float gTerrainFarPlane = 3000.f;
+static const char* gTerrainCacheDir = "terraincache";
+static bool        gPrintTerrainStats = false;
+static float       gTerrainStatsTimer = 0.f;
+
+// Fading trail behind every drone
+static bool  gTrails = true;
+
+// Rotor downwash particles, stepped on the GPU with transform feedback
+// or, headless or on request, with SIMD on the CPU
+static int  gParticleCount = 16384;
+static int  gGpuParticles  = -1; // -1: GPU unless headless
+
+// City blocks imported from an OBJ file; drones hidden behind them are
+// culled against a software-rasterized hierarchical Z buffer
+static std::string gCityPath;
+static bool        gOcclusion = true;
+static bool        gPrintOcclusionStats = false;
+static int         gImportThreads = 0;  // 0: one per core
+static float       gOcclusionStatsTimer = 0.f;
+
+// Stream per-frame instance data through a persistently mapped buffer
+// when GL_ARB_buffer_storage is available
+static bool  gUseBufferStorage = true;
+
+// Keep linked shader programs on disk between runs
+static bool        gUseShaderCache = true;
+static const char* gShaderCacheDir = "shadercache";
+
+// Read shader sources from this directory and relink them when edited
+// ("" = the built-in sources)
+static std::string gShaderDir;
+
+// Render a fixed number of frames offscreen instead of opening a window.
+// Frames advance by a fixed step so runs are repeatable.
+static bool        gHeadless       = false;
+static int         gHeadlessFrames = 300;
+static const float gHeadlessStep   = 1.f / 60.f;
+static std::string gCapturePath;   // last frame is written here (PPM) if set
+
+// Save every frame into this directory as an image sequence ("" = off)
+static std::string gRecordDir;
+static bool        gRecordPNG = false;
+
 //---------------------------------------------
 // GLFW Callbacks
 static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -28,6 +155,19 @@ static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     gWindowWidth  = width;
     gWindowHeight = height;
     glViewport(0, 0, width, height);
+    if (gDynamicResolution && !gDynamicResolution->resize(width, height))
+    {
+        std::cerr << "Dynamic resolution lost its targets, rendering at window size\n";
+        gDynamicResolution = nullptr;
+    }
+}
+
+//---------------------------------------------
+// Seconds since some fixed point; works with or without GLFW
+static double nowSeconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
 }
 
 //---------------------------------------------
@@ -46,15 +186,20 @@ static glm::vec3 getForwardVector(float yawDeg, float pitchDeg)
 }
 
 //---------------------------------------------
-// Return a view matrix for whichever camera is active
-static glm::mat4 getViewMatrix(float dt, DroneModel& droneModel)
+// Advance animated cameras; once per frame, however many are drawn
+static void updateCameras(float dt)
 {
     // Keep updating chopper angle for the overhead orbit camera
     gChopperAngle += gChopperSpeed * dt;
     if(gChopperAngle > 360.f)
         gChopperAngle = fmod(gChopperAngle, 360.f);
+}
 
-    switch(gCurrentCamera)
+//---------------------------------------------
+// Return a view matrix for the given camera
+static glm::mat4 getViewMatrix(int camera, DroneModel& droneModel)
+{
+    switch(camera)
     {
     // CASE 0 = angled vantage at startup
     case 0:
@@ -100,8 +245,12 @@ static glm::mat4 getViewMatrix(float dt, DroneModel& droneModel)
         glm::vec3 target = camPos + forward;
 
         // Prints out the position while camera 3 is active to show the camera is following the drone
-        glm::vec3 pos = droneModel.getPosition();
-        std::cout << "Drone Position: (" << pos.x << ", " << pos.y << ", " << pos.z << ")" << std::endl;
+        // (not in split screen, where camera 3 is always drawn and would flood the output)
+        if (!gSplitScreen)
+        {
+            glm::vec3 pos = droneModel.getPosition();
+            std::cout << "Drone Position: (" << pos.x << ", " << pos.y << ", " << pos.z << ")" << std::endl;
+        }
 
         // Compute 'up' from yaw/pitch
         glm::mat4 rot(1.f);
@@ -180,132 +329,1181 @@ static void processInput(GLFWwindow* window, float dt,
 
     // Switch cameras: 0 => angled vantage, 1 => top-down, 2 => orbit, 3 => FP
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+    {
         gCurrentCamera = 1;
+        gSplitScreen = false;
+    }
     if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+    {
         gCurrentCamera = 2;
+        gSplitScreen = false;
+    }
     if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+    {
         gCurrentCamera = 3;
+        gSplitScreen = false;
+    }
     if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
+    {
         gCurrentCamera = 0;
+        gSplitScreen = false;
+    }
+
+    // All four cameras at once with 'V'
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
+        gSplitScreen = true;
+
+    // Lighting backend: 'L' deferred, 'K' forward
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
+        gDeferred = true;
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+        gDeferred = false;
+
+    // Stats overlay: 'O' show, 'P' hide
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+        gStatsOverlay = true;
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+        gStatsOverlay = false;
+}
+
+//---------------------------------------------
+// Point a program's "view" and "projection" uniforms at a camera
+static void setCamera(GLuint program, const glm::mat4& view, const glm::mat4& projection)
+{
+    RenderStats::useProgram(program);
+    RenderStats::uniform(glGetUniformLocation(program, "view"), view);
+    RenderStats::uniform(glGetUniformLocation(program, "projection"), projection);
+}
+
+//---------------------------------------------
+// Lay out a frame's render stats as the overlay's lines of text
+static void addStatsText(TextOverlay& overlay, const FrameStats& st)
+{
+    std::ostringstream lines[5];
+    lines[0].precision(3);
+    lines[0] << "Frame " << st.cpuMs << " ms CPU, ";
+    if (st.gpuMs >= 0.0)
+        lines[0] << st.gpuMs << " ms GPU";
+    else
+        lines[0] << "- ms GPU"; // the frame's GPU times were dropped
+    lines[1] << "Draws " << st.drawCalls << ", triangles " << st.primitives;
+    lines[2] << "Uniforms " << st.uniformCalls;
+    lines[3] << "Uploaded " << st.uploadBytes / 1024 << " KB";
+    lines[4] << "State changes " << st.stateChanges;
+
+    const float margin = 12.f;
+    for(int i = 0; i < 5; i++)
+        overlay.addText(margin, margin + i * TextOverlay::kLineHeight, lines[i].str());
 }
 
 //---------------------------------------------
-int main()
+// Lay the escorts out on a square grid behind the lead drone (fleet[0])
+static void placeEscorts(std::vector<DroneModel>& fleet)
 {
-    // Init GLFW
-    if(!glfwInit())
+    int side = (int)std::ceil(std::sqrt((float)(fleet.size() - 1)));
+    for(size_t i = 1; i < fleet.size(); i++)
     {
-        std::cerr << "Failed to init GLFW\n";
-        return -1;
+        int row = (int)(i - 1) / std::max(side, 1);
+        int col = (int)(i - 1) % std::max(side, 1);
+        float x = (col - 0.5f * (side - 1)) * gEscortSpacing;
+        float z = -(row + 1) * gEscortSpacing;
+        fleet[i].setPosition(glm::vec3(x, 1.f, z));
     }
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_CORE_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+}
 
-    GLFWwindow* window = glfwCreateWindow(gWindowWidth, gWindowHeight,
-        "Drone (MVC)", nullptr, nullptr);
-    if(!window)
+//---------------------------------------------
+// Command line:
+//   --fleet N      add N escort drones
+//   --split        start in split screen (all four cameras)
+//   --mesh-stats   report ACMR / vertex shader invocations of the meshes
+//   --queue-stats  report draws and avoided state changes every 2 seconds
+//   --gpu-stats    report GPU milliseconds per render pass every 2 seconds
+//   --render-stats report draws, triangles, uniforms, uploads and state
+//                  changes per frame every 2 seconds
+//   --stats-overlay  draw those numbers over the scene
+//   --vsync 0|1    swap interval (default 1)
+//   --frames-in-flight N  frames the GPU may trail the CPU by (default 2)
+//   --latency-stats  report input-to-swap latency every 2 seconds
+//   --light-stats  report light culling time and cluster sizes every 2 seconds
+//   --light-threads N  worker threads for light culling (0 = main thread only)
+//   --lighting forward|deferred  lighting backend (default forward)
+//   --nav-lights N cap the number of drone navigation lights
+//   --no-trails    do not draw drone flight trails
+//   --frame-budget MS  lower the render resolution to keep GPU frames under MS
+//   --min-res-scale S  lowest resolution scale per axis (default 0.5)
+//   --particles N  rotor downwash particles (default 16384, 0 = none)
+//   --particle-update gpu|cpu  step them with transform feedback or SIMD
+//                  on the CPU (default gpu, cpu when headless)
+//   --city F.obj   draw the OBJ file F as city blocks among the drones
+//   --no-occlusion do not cull drones hidden behind the city
+//   --occlusion-stats  report drones occluded and occluder raster time every 2 seconds
+//   --import-threads N  threads parsing the city OBJ (default one per core)
+//   --terrain      draw heightmap terrain under the drones
+//   --terrain-size M  terrain width in metres (default 4096)
+//   --terrain-stats  report terrain nodes drawn and tiles streamed every 2 seconds
+//   --no-buffer-storage  stream instance data by orphaning instead of a
+//                  persistent mapping
+//   --no-shader-cache  always compile shaders from source
+//   --shader-dir D shader sources live in D (built-in ones are written
+//                  there if missing); edits are relinked while running
+//   --headless     render offscreen through EGL, no window or GPU needed
+//   --frames N     number of frames to render headless (default 300)
+//   --capture F    save the last headless frame to F (PPM)
+//   --record D     save every frame to D/frame_NNNNNN.ppm, read back and
+//                  written in the background
+//   --record-format ppm|png  image format for --record (default ppm)
+static void parseArgs(int argc, char** argv)
+{
+    for(int i = 1; i < argc; i++)
     {
-        std::cerr << "Failed to create GLFW window\n";
-        glfwTerminate();
-        return -1;
+        if (std::strcmp(argv[i], "--fleet") == 0 && i + 1 < argc)
+            gEscortCount = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--split") == 0)
+            gSplitScreen = true;
+        else if (std::strcmp(argv[i], "--mesh-stats") == 0)
+            gPrintMeshStats = true;
+        else if (std::strcmp(argv[i], "--queue-stats") == 0)
+            gPrintQueueStats = true;
+        else if (std::strcmp(argv[i], "--gpu-stats") == 0)
+            gPrintGpuStats = true;
+        else if (std::strcmp(argv[i], "--render-stats") == 0)
+            gPrintRenderStats = true;
+        else if (std::strcmp(argv[i], "--stats-overlay") == 0)
+            gStatsOverlay = true;
+        else if (std::strcmp(argv[i], "--vsync") == 0 && i + 1 < argc)
+            gVsync = std::atoi(argv[++i]) != 0;
+        else if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+            gFramesInFlight = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--latency-stats") == 0)
+            gPrintLatencyStats = true;
+        else if (std::strcmp(argv[i], "--light-stats") == 0)
+            gPrintLightStats = true;
+        else if (std::strcmp(argv[i], "--light-threads") == 0 && i + 1 < argc)
+            gLightThreads = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--lighting") == 0 && i + 1 < argc)
+            gDeferred = std::strcmp(argv[++i], "deferred") == 0;
+        else if (std::strcmp(argv[i], "--nav-lights") == 0 && i + 1 < argc)
+            gMaxNavLights = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--no-trails") == 0)
+            gTrails = false;
+        else if (std::strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+            gFrameBudgetMs = std::max(0.0, std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--min-res-scale") == 0 && i + 1 < argc)
+            gMinResScale = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+            gParticleCount = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--particle-update") == 0 && i + 1 < argc)
+            gGpuParticles = std::strcmp(argv[++i], "gpu") == 0 ? 1 : 0;
+        else if (std::strcmp(argv[i], "--city") == 0 && i + 1 < argc)
+            gCityPath = argv[++i];
+        else if (std::strcmp(argv[i], "--no-occlusion") == 0)
+            gOcclusion = false;
+        else if (std::strcmp(argv[i], "--occlusion-stats") == 0)
+            gPrintOcclusionStats = true;
+        else if (std::strcmp(argv[i], "--import-threads") == 0 && i + 1 < argc)
+            gImportThreads = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--terrain") == 0)
+            gTerrain = true;
+        else if (std::strcmp(argv[i], "--terrain-size") == 0 && i + 1 < argc)
+            gTerrainSize = std::max(64.f, (float)std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--terrain-stats") == 0)
+            gPrintTerrainStats = true;
+        else if (std::strcmp(argv[i], "--no-buffer-storage") == 0)
+            gUseBufferStorage = false;
+        else if (std::strcmp(argv[i], "--no-shader-cache") == 0)
+            gUseShaderCache = false;
+        else if (std::strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc)
+            gShaderDir = argv[++i];
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            gHeadless = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            gHeadlessFrames = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            gCapturePath = argv[++i];
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            gRecordDir = argv[++i];
+        else if (std::strcmp(argv[i], "--record-format") == 0 && i + 1 < argc)
+            gRecordPNG = std::strcmp(argv[++i], "png") == 0;
+        else
+            std::cerr << "Ignoring unknown argument " << argv[i] << "\n";
     }
-    glfwMakeContextCurrent(window);
+}
+
+//---------------------------------------------
+int main(int argc, char** argv)
+{
+    parseArgs(argc, argv);
+    if (gGpuParticles < 0)
+        gGpuParticles = gHeadless ? 0 : 1;
 
-    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    GLFWwindow*     window = nullptr;   // null when headless
+    HeadlessContext headless;
+    GLADloadproc    loadProc;
+
+    if (gHeadless)
     {
-        std::cerr << "Failed to init GLAD\n";
-        glfwTerminate();
-        return -1;
+        // Offscreen context; its FBO plays the part of the window
+        if (!headless.create(gWindowWidth, gWindowHeight))
+            return -1;
+        loadProc = HeadlessContext::getProcAddress();
     }
+    else
+    {
+        // Init GLFW
+        if(!glfwInit())
+        {
+            std::cerr << "Failed to init GLFW\n";
+            return -1;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_CORE_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(gWindowWidth, gWindowHeight,
+            "Drone (MVC)", nullptr, nullptr);
+        if(!window)
+        {
+            std::cerr << "Failed to create GLFW window\n";
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(gVsync ? 1 : 0);
+
+        loadProc = (GLADloadproc)glfwGetProcAddress;
+        if(!gladLoadGLLoader(loadProc))
+        {
+            std::cerr << "Failed to init GLAD\n";
+            glfwTerminate();
+            return -1;
+        }
+
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    }
+    loadGLExtensions(loadProc);
 
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glEnable(GL_DEPTH_TEST);
 
-    // Minimal vertex + fragment shaders
+    // Vertex shaders pass the view-space position and normal on for lighting
     static const char* vertexSrc = R"(
     #version 330 core
     layout(location=0) in vec3 aPos;
+    layout(location=1) in vec3 aNormal;
+    layout(location=2) in vec3 aColor;
     uniform mat4 model;
     uniform mat4 view;
     uniform mat4 projection;
+    out vec3 vColor;
+    out vec3 vViewPos;
+    out vec3 vViewNormal;
+    void main()
+    {
+        vec4 viewPos = view * model * vec4(aPos, 1.0);
+        vColor = aColor;
+        vViewPos = viewPos.xyz;
+        vViewNormal = mat3(view) * transpose(inverse(mat3(model))) * aNormal;
+        gl_Position = projection * viewPos;
+    }
+    )";
+
+    // Same, with a per-instance model matrix (locations 3..6) applied
+    // before the shared one. aColor is per vertex or per instance,
+    // depending on the VAO.
+    static const char* instancedVertexSrc = R"(
+    #version 330 core
+    layout(location=0) in vec3 aPos;
+    layout(location=1) in vec3 aNormal;
+    layout(location=2) in vec3 aColor;
+    layout(location=3) in mat4 aInstance;
+    uniform mat4 model;
+    uniform mat4 view;
+    uniform mat4 projection;
+    out vec3 vColor;
+    out vec3 vViewPos;
+    out vec3 vViewNormal;
+    void main()
+    {
+        mat4 world = model * aInstance;
+        vec4 viewPos = view * world * vec4(aPos, 1.0);
+        vColor = aColor;
+        vViewPos = viewPos.xyz;
+        vViewNormal = mat3(view) * transpose(inverse(mat3(world))) * aNormal;
+        gl_Position = projection * viewPos;
+    }
+    )";
+
+    // Terrain: a CDLOD grid node, displaced by its height tile. Vertices
+    // morph to the parent's grid (aMorph.xy), then the grandparent's
+    // (aMorph.zw), as their distance to the camera grows.
+    static const char* terrainVertexSrc = R"(
+    #version 330 core
+    layout(location=0) in vec2 aGrid;
+    layout(location=3) in vec4 aNode;   // origin x, z, size, tile layer
+    layout(location=4) in vec4 aMorph;
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform vec3 cameraPos;
+    uniform sampler2DArray heightTiles;
+    out vec3 vColor;
+    out vec3 vViewPos;
+    out vec3 vViewNormal;
+
+    const float gridSize = 32.0;
+
+    float heightAt(vec2 g)
+    {
+        vec2 size = vec2(textureSize(heightTiles, 0).xy);
+        return textureLod(heightTiles, vec3((g * gridSize + 1.5) / size, aNode.w), 0.0).r;
+    }
+
+    vec2 morph(vec2 g, float dim, float k)
+    {
+        return g - fract(g * dim * 0.5) * 2.0 / dim * k;
+    }
+
+    void main()
+    {
+        vec2 world = aNode.xy + aGrid * aNode.z;
+        float dist = distance(cameraPos, vec3(world.x, heightAt(aGrid), world.y));
+        float k1 = clamp((dist - aMorph.x) / (aMorph.y - aMorph.x), 0.0, 1.0);
+        float k2 = clamp((dist - aMorph.z) / (aMorph.w - aMorph.z), 0.0, 1.0);
+        vec2 g = morph(morph(aGrid, gridSize, k1), gridSize * 0.5, k2);
+
+        world = aNode.xy + g * aNode.z;
+        float h = heightAt(g);
+
+        float t = 1.0 / gridSize;
+        float spacing = aNode.z * t;
+        vec3 n = normalize(vec3(heightAt(g - vec2(t, 0.0)) - heightAt(g + vec2(t, 0.0)),
+                                2.0 * spacing,
+                                heightAt(g - vec2(0.0, t)) - heightAt(g + vec2(0.0, t))));
+
+        vec3 grass = vec3(0.32, 0.5, 0.25);
+        vec3 rock  = vec3(0.5, 0.46, 0.42);
+        vColor = mix(grass, rock, max(smoothstep(-60.0, -20.0, h), smoothstep(0.85, 0.7, n.y)));
+
+        vec4 viewPos = view * vec4(world.x, h, world.y, 1.0);
+        vViewPos = viewPos.xyz;
+        vViewNormal = mat3(view) * n;
+        gl_Position = projection * viewPos;
+    }
+    )";
+
+    // Trails: points carry their time in w and fade out with age
+    static const char* trailVertexSrc = R"(
+    #version 330 core
+    layout(location=0) in vec4 aPoint;
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform float now;
+    uniform float duration;
+    out float vFade;
+    void main()
+    {
+        vFade = 1.0 - (now - aPoint.w) / duration;
+        gl_Position = projection * view * vec4(aPoint.xyz, 1.0);
+    }
+    )";
+
+    static const char* trailFragmentSrc = R"(
+    #version 330 core
+    in float vFade;
+    out vec4 FragColor;
+    void main()
+    {
+        if (vFade <= 0.0)
+            discard;
+        FragColor = vec4(0.6, 0.9, 1.0, 0.8 * vFade * vFade);
+    }
+    )";
+
+    // Stats overlay: pixel positions from the top left, glyph coverage in
+    // the font texture's red channel
+    static const char* overlayVertexSrc = R"(
+    #version 330 core
+    layout(location=0) in vec4 aPosUV;
+    layout(location=1) in vec4 aColor;
+    uniform vec2 screenSize;
+    out vec2 vUV;
+    out vec4 vColor;
+    void main()
+    {
+        vUV = aPosUV.zw;
+        vColor = aColor;
+        vec2 ndc = aPosUV.xy / screenSize * 2.0 - 1.0;
+        gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    }
+    )";
+
+    static const char* overlayFragmentSrc = R"(
+    #version 330 core
+    in vec2 vUV;
+    in vec4 vColor;
+    uniform sampler2D font;
+    out vec4 FragColor;
+    void main()
+    {
+        float coverage = texture(font, vUV).r;
+        if (coverage == 0.0)
+            discard;
+        FragColor = vec4(vColor.rgb, vColor.a * coverage);
+    }
+    )";
+
+    // Particle step for transform feedback: respawn expired particles at
+    // their drone's rotors, move the rest. Must match ParticleSystem's CPU
+    // path.
+    static const char* particleUpdateVertexSrc = R"(
+    #version 330 core
+    layout(location=0) in vec4 aPosAge;
+    layout(location=1) in vec4 aVelLife;
+    uniform samplerBuffer emitters;  // xyz position, w strength
+    uniform int   emitterCount;
+    uniform float dt;
+    uniform uint  seed;
+    uniform vec4  physics;           // downwash, drag, gravity, ground height
+    uniform vec3  spawn;             // rotor radius, min life, max life
+    out vec4 tfPosAge;
+    out vec4 tfVelLife;
+
+    uint state;
+    float random()
+    {
+        state = state * 747796405u + 2891336453u;
+        uint w = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return float(((w >> 22u) ^ w) & 0xFFFFFFu) / 16777215.0;
+    }
+
+    void main()
+    {
+        vec3  pos  = aPosAge.xyz;
+        float age  = aPosAge.w + dt;
+        vec3  vel  = aVelLife.xyz;
+        float life = aVelLife.w;
+
+        vel = vel * (1.0 - physics.y * dt) + vec3(0.0, -physics.z * dt, 0.0);
+        pos += vel * dt;
+        if (pos.y < physics.w)
+        {
+            float horiz = length(vel.xz);
+            if (horiz > 1e-3)
+                vel.xz += vel.xz * (-vel.y * 0.6 / horiz);
+            vel.y *= -0.15;
+            pos.y = physics.w;
+        }
+
+        if (age >= life)
+        {
+            state = uint(gl_VertexID) * 2654435761u ^ seed * 40503u;
+            vec4 emitter = texelFetch(emitters, gl_VertexID % emitterCount);
+            float angle  = 6.2831853 * random();
+            float radius = spawn.x * sqrt(random());
+            vec2  disc   = vec2(cos(angle), sin(angle)) * radius;
+            pos  = emitter.xyz + vec3(disc.x, -0.3, disc.y);
+            vel  = vec3(0.8 * disc.x, -physics.x * (0.7 + 0.6 * random()), 0.8 * disc.y) * emitter.w;
+            age  = 0.0;
+            life = emitter.w > 0.0 ? mix(spawn.y, spawn.z, random()) : 0.0;
+        }
+
+        tfPosAge  = vec4(pos, age);
+        tfVelLife = vec4(vel, life);
+    }
+    )";
+
+    // Particles: soft round points that grow and fade with age
+    static const char* particleVertexSrc = R"(
+    #version 330 core
+    layout(location=0) in vec4 aPosAge;
+    layout(location=1) in vec4 aVelLife;
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform float pointScale;  // pixels per unit at distance 1
+    out float vAlpha;
     void main()
     {
-        gl_Position = projection * view * model * vec4(aPos, 1.0);
+        float t = aVelLife.w > 0.0 ? clamp(aPosAge.w / aVelLife.w, 0.0, 1.0) : 1.0;
+        vec4 viewPos = view * vec4(aPosAge.xyz, 1.0);
+        gl_Position = projection * viewPos;
+        gl_PointSize = clamp(pointScale * mix(0.1, 0.6, t) / max(-viewPos.z, 0.1), 1.0, 64.0);
+        vAlpha = 0.3 * (1.0 - t);
     }
     )";
 
-    static const char* fragmentSrc = R"(
+    static const char* particleFragmentSrc = R"(
     #version 330 core
+    in float vAlpha;
     out vec4 FragColor;
-    uniform vec3 objectColor;
     void main()
     {
-        FragColor = vec4(objectColor, 1.0);
+        vec2 d = gl_PointCoord * 2.0 - 1.0;
+        float r2 = dot(d, d);
+        if (vAlpha <= 0.0 || r2 > 1.0)
+            discard;
+        FragColor = vec4(0.72, 0.66, 0.56, vAlpha * (1.0 - r2));
     }
     )";
 
-    // Build & link our shader program
-    GLuint shaderProg = createShaderProgram(vertexSrc, fragmentSrc);
+    // Blinn-Phong: the sun, plus the point/spot lights ClusteredLighting
+    // found for this fragment's cluster. Shared by the forward and the
+    // deferred lighting fragment shaders.
+    static const char* clusterLightingSrc = R"(
+    uniform vec3 sunDirection;
+    uniform vec3 sunAmbient;
+    uniform vec3 sunDiffuse;
+    uniform vec3 sunSpecular;
+
+    uniform samplerBuffer  lightData;
+    uniform usamplerBuffer clusterGrid;
+    uniform usamplerBuffer lightIndices;
+    uniform ivec3 clusterDims;
+    uniform vec2  clusterOrigin;
+    uniform vec2  clusterTileSize;
+    uniform float clusterScale;
+    uniform float clusterBias;
+
+    vec3 blinnPhong(vec3 L, vec3 N, vec3 V, vec3 lightDiffuse, vec3 lightSpecular,
+                    vec3 albedo, vec3 specular, float shininess)
+    {
+        float nDotL = max(dot(N, L), 0.0);
+        float spec = 0.0;
+        if (nDotL > 0.0)
+            spec = pow(max(dot(N, normalize(L + V)), 0.0), shininess);
+        return lightDiffuse * albedo * nDotL + lightSpecular * specular * spec;
+    }
+
+    vec3 shadeClustered(vec3 viewPos, vec3 N, vec3 ambient, vec3 albedo,
+                        vec3 specular, float shininess)
+    {
+        vec3 V = normalize(-viewPos);
+        vec3 color = sunAmbient * ambient
+                   + blinnPhong(normalize(-sunDirection), N, V, sunDiffuse, sunSpecular,
+                                albedo, specular, shininess);
+
+        ivec2 tile = ivec2((gl_FragCoord.xy - clusterOrigin) / clusterTileSize);
+        int slice = int(log(max(-viewPos.z, 1e-4)) * clusterScale + clusterBias);
+        tile  = clamp(tile, ivec2(0), clusterDims.xy - 1);
+        slice = clamp(slice, 0, clusterDims.z - 1);
+        int cluster = (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x;
+
+        uvec2 range = texelFetch(clusterGrid, cluster).xy;
+        for (uint i = 0u; i < range.y; i++)
+        {
+            int light = int(texelFetch(lightIndices, int(range.x + i)).x);
+            vec4 posRange  = texelFetch(lightData, 4 * light);
+            vec4 diffCone  = texelFetch(lightData, 4 * light + 1);
+            vec3 spotDir   = texelFetch(lightData, 4 * light + 2).xyz;
+            vec3 lightSpec = texelFetch(lightData, 4 * light + 3).rgb;
+
+            vec3 toLight = posRange.xyz - viewPos;
+            float d2 = max(dot(toLight, toLight), 1e-6);
+            float falloff = clamp(1.0 - d2 / (posRange.w * posRange.w), 0.0, 1.0);
+            falloff *= falloff;
+
+            vec3 L = toLight * inversesqrt(d2);
+            if (diffCone.w > -1.0)
+                falloff *= smoothstep(diffCone.w, mix(diffCone.w, 1.0, 0.2), dot(-L, spotDir));
+
+            color += falloff * blinnPhong(L, N, V, diffCone.rgb, lightSpec,
+                                          albedo, specular, shininess);
+        }
+        return color;
+    }
+    )";
+
+    static const char* materialSrc = R"(
+    struct MaterialProperties
+    {
+        vec3 ambient;
+        vec3 diffuse;
+        vec3 specular;
+        float shininess;
+    };
+    uniform MaterialProperties material;
+    )";
+
+    // Forward: light each fragment as it is drawn
+    const std::string forwardFragmentSrc = std::string("#version 330 core\n")
+        + materialSrc + clusterLightingSrc + R"(
+    in vec3 vColor;
+    in vec3 vViewPos;
+    in vec3 vViewNormal;
+    out vec4 FragColor;
+    void main()
+    {
+        vec3 color = shadeClustered(vViewPos, normalize(vViewNormal),
+                                    material.ambient * vColor, material.diffuse * vColor,
+                                    material.specular, material.shininess);
+        FragColor = vec4(color, 1.0);
+    }
+    )";
+
+    // Deferred geometry pass: store what lighting needs in the G-buffer
+    const std::string gbufferFragmentSrc = std::string("#version 330 core\n")
+        + materialSrc + R"(
+    in vec3 vColor;
+    in vec3 vViewPos;
+    in vec3 vViewNormal;
+    layout(location=0) out vec4 gAlbedo;
+    layout(location=1) out vec4 gNormal;
+    layout(location=2) out vec4 gAmbient;
+    void main()
+    {
+        gAlbedo  = vec4(material.diffuse * vColor, material.specular.r);
+        gNormal  = vec4(normalize(vViewNormal), material.shininess);
+        gAmbient = vec4(material.ambient * vColor, 1.0);
+    }
+    )";
+
+    // Deferred lighting pass: one triangle over the viewport, shading each
+    // covered pixel from the G-buffer
+    static const char* lightingVertexSrc = R"(
+    #version 330 core
+    void main()
+    {
+        vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+    }
+    )";
+
+    const std::string lightingFragmentSrc = std::string("#version 330 core\n")
+        + clusterLightingSrc + R"(
+    uniform sampler2D gAlbedo;
+    uniform sampler2D gNormal;
+    uniform sampler2D gAmbient;
+    uniform sampler2D gDepth;
+    uniform mat4 inverseProjection;
+    uniform vec4 viewportRect;
+    out vec4 FragColor;
+    void main()
+    {
+        ivec2 pixel = ivec2(gl_FragCoord.xy);
+        float depth = texelFetch(gDepth, pixel, 0).r;
+        if (depth == 1.0)
+            discard;
+
+        vec2 ndc = (gl_FragCoord.xy - viewportRect.xy) / viewportRect.zw * 2.0 - 1.0;
+        vec4 viewPos = inverseProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+        viewPos /= viewPos.w;
+
+        vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+        vec4 normal = texelFetch(gNormal, pixel, 0);
+        vec3 ambient = texelFetch(gAmbient, pixel, 0).rgb;
+        vec3 color = shadeClustered(viewPos.xyz, normalize(normal.xyz), ambient, albedo.rgb,
+                                    vec3(albedo.a), normal.w);
+        FragColor = vec4(color, 1.0);
+        gl_FragDepth = depth;
+    }
+    )";
+
+    // Build & link our shader programs, or load them as linked last run
+    util::ProgramBinaryCache shaderCache;
+    if (gUseShaderCache && !shaderCache.init(loadProc, gShaderCacheDir))
+        std::cerr << "Program binaries not supported, compiling shaders from source\n";
+
+    // The programs below are references into the reloader, which swaps
+    // in relinked ones when --shader-dir files are edited
+    ShaderReloader shaders;
+    shaders.init(gShaderDir, &shaderCache);
+
+    double shaderStart = nowSeconds();
+    const GLuint& shaderProg    = shaders.load("drone.vert", vertexSrc, "forward.frag", forwardFragmentSrc.c_str());
+    const GLuint& instancedProg = shaders.load("drone_instanced.vert", instancedVertexSrc,
+                                               "forward.frag", forwardFragmentSrc.c_str());
+    const GLuint& gbufferProg   = shaders.load("drone.vert", vertexSrc, "gbuffer.frag", gbufferFragmentSrc.c_str());
+    const GLuint& gbufferInstancedProg = shaders.load("drone_instanced.vert", instancedVertexSrc,
+                                                      "gbuffer.frag", gbufferFragmentSrc.c_str());
+    const GLuint& lightingProg  = shaders.load("lighting.vert", lightingVertexSrc,
+                                               "lighting.frag", lightingFragmentSrc.c_str());
+    const GLuint& terrainProg   = shaders.load("terrain.vert", terrainVertexSrc, "forward.frag", forwardFragmentSrc.c_str());
+    const GLuint& gbufferTerrainProg = shaders.load("terrain.vert", terrainVertexSrc,
+                                                    "gbuffer.frag", gbufferFragmentSrc.c_str());
+    const GLuint& trailProg     = shaders.load("trail.vert", trailVertexSrc, "trail.frag", trailFragmentSrc);
+    const GLuint& particleProg  = shaders.load("particle.vert", particleVertexSrc, "particle.frag", particleFragmentSrc);
+    const GLuint& overlayProg   = shaders.load("overlay.vert", overlayVertexSrc, "overlay.frag", overlayFragmentSrc);
+    const char* particleVaryings[2] = { "tfPosAge", "tfVelLife" };
+    const GLuint noProgram = 0;
+    const GLuint& particleUpdateProg = gGpuParticles
+                                     ? shaders.loadFeedback("particle_update.vert", particleUpdateVertexSrc,
+                                                            particleVaryings, 2)
+                                     : noProgram;
+    const int programCount = shaders.getProgramCount();
+    glFinish(); // binaries may be linked lazily; count that too
+    double shaderMs = (nowSeconds() - shaderStart) * 1000.0;
+
+    std::cout << "Shader programs ready in " << shaderMs << " ms ("
+              << shaderCache.getHits() << " from cache, "
+              << programCount - shaderCache.getHits() << " compiled";
+    if (shaderCache.getRejected() > 0)
+        std::cout << ", " << shaderCache.getRejected() << " stale binaries dropped";
+    std::cout << ")" << std::endl;
 
     // Create Model, View, Controller
-    DroneModel droneModel;               // holds drone state
+    std::vector<DroneModel> fleet(1 + gEscortCount); // fleet[0] is user controlled
+    DroneModel& droneModel = fleet[0];   // holds drone state
     DroneView  droneView;                // handles geometry & rendering
+    RenderQueue renderQueue;             // sorts & issues the frame's draws
+    GpuTimer    gpuTimer;                // GPU time per render pass
+    FramePacer  framePacer;              // frames-in-flight limit, latency
+    framePacer.setMaxFramesInFlight(gFramesInFlight);
     DroneController droneController(droneModel); // manipulates the model
+    placeEscorts(fleet);
 
     // Initialize geometry once
-    droneView.initDroneGeometry();
+    droneView.initDroneGeometry(renderQueue, gUseBufferStorage);
+    if (gPrintMeshStats)
+        droneView.printMeshStats();
+
+    TrailRenderer trails;
+    if (gTrails)
+        trails.init((int)fleet.size());
+    float simTime = 0.f; // what trail points are stamped with
+
+    CityView city;
+    OcclusionCuller occlusion;
+    if (!gCityPath.empty() && city.load(gCityPath, renderQueue, gImportThreads) && gOcclusion)
+        occlusion.setOccluders(city.getOccluders());
+
+    // Rotor downwash; falls back to the CPU if the feedback program failed
+    ParticleSystem particles;
+    if (gParticleCount > 0)
+        particles.init(gParticleCount, (int)fleet.size(), particleUpdateProg);
+
+    TextOverlay statsOverlay;
+    statsOverlay.init();
+
+    FrameRecorder recorder;
+    if (!gRecordDir.empty())
+        recorder.start(gRecordDir, gRecordPNG);
+
+    Terrain terrain;
+    if (gTerrain)
+    {
+        if (terrain.init(gTerrainSize, gTerrainCacheDir, renderQueue, gUseBufferStorage))
+            gFarPlane = std::max(gFarPlane, gTerrainFarPlane);
+        else
+            gTerrain = false;
+    }
 
-    float lastTime = (float)glfwGetTime();
+    // Lights: a sun for everyone, nav lights on every drone and a landing
+    // light under the lead, culled per viewport into clusters
+    if (gLightThreads < 0)
+        gLightThreads = std::min(3, std::max(0, (int)std::thread::hardware_concurrency() - 1));
+    ClusteredLighting clusteredLighting;
+    clusteredLighting.init(gLightThreads, gNearPlane, gFarPlane);
+
+    DeferredRenderer deferredRenderer;
+    if (!deferredRenderer.init(gWindowWidth, gWindowHeight))
+        std::cerr << "Deferred shading unavailable, using forward\n";
+
+    DynamicResolution dynamicResolution;
+    if (gFrameBudgetMs > 0.0)
+    {
+        if (dynamicResolution.init(gWindowWidth, gWindowHeight, gFrameBudgetMs, gMinResScale))
+            gDynamicResolution = &dynamicResolution;
+        else
+            std::cerr << "Dynamic resolution unavailable, rendering at window size\n";
+    }
+    int budgetFrame = 0; // GpuTimer frames the budget has seen
+
+    util::Light sun;
+    sun.setDirection(-0.4f, -1.f, -0.3f);
+    sun.setAmbient(0.35f, 0.35f, 0.4f);
+    sun.setDiffuse(0.7f, 0.7f, 0.65f);
+    sun.setSpecular(0.5f, 0.5f, 0.5f);
+    std::vector<util::Light> lights;
+
+    double startTime = nowSeconds();
+    double lastTime  = startTime;
+    int    frame     = 0;
 
     // Main render loop
-    while(!glfwWindowShouldClose(window))
+    while(gHeadless ? frame < gHeadlessFrames : !glfwWindowShouldClose(window))
     {
-        float currentTime = (float)glfwGetTime();
-        float dt = currentTime - lastTime;
+        double currentTime = nowSeconds();
+        float dt = gHeadless ? gHeadlessStep : (float)(currentTime - lastTime);
         lastTime = currentTime;
+        RenderStats::beginFrame();
 
-        // Process input
-        processInput(window, dt, droneModel, droneController);
+        // Process input, as late as possible before it is used
+        if (window)
+        {
+            glfwPollEvents();
+            processInput(window, dt, droneModel, droneController);
+        }
+        framePacer.inputSampled();
+
+        // Swap in shaders relinked after an edit; uniform locations cached
+        // per program ID are stale
+        if (shaders.update())
+        {
+            renderQueue.forgetPrograms();
+            clusteredLighting.forgetPrograms();
+            particles.setUpdateProgram(particleUpdateProg);
+        }
 
         // Update propeller angle
         droneController.updatePropAngle(dt);
 
         // Update roll
         droneController.updateRoll(dt);
+        simTime += dt;
+
+        // Escorts spin their propellers in step with the lead
+        for(size_t i = 1; i < fleet.size(); i++)
+            fleet[i].setPropAngle(droneModel.getPropAngle());
+
+        // Append this frame's positions to the trails
+        if (gTrails)
+            trails.update(fleet, simTime);
+
+        // Scene resolution for this frame, from the GPU time of the last
+        // one that has been read back. Only a newly read-back frame counts,
+        // and only passes whose cost follows the resolution: the overlay and
+        // the recorder's readback work at window size whatever the scale.
+        int renderWidth  = gWindowWidth;
+        int renderHeight = gWindowHeight;
+        if (gDynamicResolution)
+        {
+            if (gpuTimer.getCollectedFrames() != budgetFrame)
+            {
+                budgetFrame = gpuTimer.getCollectedFrames();
+                gDynamicResolution->update(gpuTimer.getFrameMsExcluding({ "overlay", "record" }));
+            }
+            gDynamicResolution->beginFrame();
+            renderWidth  = gDynamicResolution->getRenderWidth();
+            renderHeight = gDynamicResolution->getRenderHeight();
+        }
+
+        gpuTimer.beginFrame();
+
+        // Step the particles once for every viewport
+        gpuTimer.beginPass("particles");
+        particles.update(fleet, droneController.getPropSpeed(), dt);
+        gpuTimer.endPass();
 
         // Clear
+        gpuTimer.beginPass("clear");
         glClearColor(0.12f, 0.12f, 0.2f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gpuTimer.endPass();
+
+        // Cameras
+        updateCameras(dt);
+
+        // Draw the fleet once per viewport, each drone at an LOD that fits
+        // its size on screen there. Transforms are computed once and shared.
+        gpuTimer.beginPass("drones");
+        int viewportCount = gSplitScreen ? 4 : 1;
+        renderQueue.setFarPlane(gFarPlane);
+        droneView.beginFrame(fleet, viewportCount);
+
+        lights.clear();
+        lights.push_back(sun);
+        {
+            float yaw = glm::radians(droneModel.getYaw());
+            glm::vec3 pos = droneModel.getPosition();
+            util::Light landing;
+            landing.setPosition(pos.x, pos.y - 0.2f, pos.z);
+            landing.setSpotDirection(std::sin(yaw), -1.2f, std::cos(yaw));
+            landing.setSpotAngle(25.f);
+            landing.setDiffuse(1.f, 0.95f, 0.8f);
+            landing.setSpecular(1.f, 1.f, 1.f);
+            landing.setRange(30.f);
+            lights.push_back(landing);
+        }
+        droneView.appendNavLights(lights, std::min(gMaxNavLights, ClusteredLighting::kMaxLights) + 2);
 
-        // Use shader
-        glUseProgram(shaderProg);
+        // Deferred: every viewport fills its part of the G-buffer, then
+        // each is lit in a second pass. The G-buffer stays window sized;
+        // a lower resolution only uses its lower-left corner.
+        bool deferred = gDeferred && deferredRenderer.isReady();
+        glm::mat4 viewports[DroneView::kMaxViewports][2]; // view, projection
+        if (deferred)
+        {
+            deferredRenderer.resize(gWindowWidth, gWindowHeight);
+            deferredRenderer.beginFrame();
+        }
+        GLuint drawProg          = deferred ? gbufferProg : shaderProg;
+        GLuint drawInstancedProg = deferred ? gbufferInstancedProg : instancedProg;
+        GLuint drawTerrainProg   = deferred ? gbufferTerrainProg : terrainProg;
+        if (gTerrain)
+            terrain.beginFrame(viewportCount);
 
-        // Camera
-        glm::mat4 view = getViewMatrix(dt, droneModel);
-        GLint viewLoc = glGetUniformLocation(shaderProg, "view");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        for(int v = 0; v < viewportCount; v++)
+        {
+            // Split screen: camera v in a quarter of the window, 0 at top-left
+            int camera = gSplitScreen ? v : gCurrentCamera;
+            int vpWidth  = gSplitScreen ? renderWidth / 2  : renderWidth;
+            int vpHeight = gSplitScreen ? renderHeight / 2 : renderHeight;
+            int vpX = gSplitScreen ? (v % 2) * vpWidth : 0;
+            int vpY = gSplitScreen ? (v < 2 ? vpHeight : 0) : 0;
+            glViewport(vpX, vpY, vpWidth, vpHeight);
 
-        // Projection
-        glm::mat4 projection = glm::perspective(
-            glm::radians(45.f),
-            (float)gWindowWidth / (float)gWindowHeight,
-            0.1f, 100.f
-        );
-        GLint projLoc = glGetUniformLocation(shaderProg, "projection");
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+            // Camera
+            glm::mat4 view = getViewMatrix(camera, droneModel);
 
-        // Draw the drone
-        droneView.drawDrone(droneModel, shaderProg);
+            // Projection
+            glm::mat4 projection = glm::perspective(
+                glm::radians(45.f),
+                (float)vpWidth / (float)std::max(vpHeight, 1),
+                gNearPlane, gFarPlane
+            );
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            viewports[v][0] = view;
+            viewports[v][1] = projection;
+
+            // All programs share the camera and, forward, this viewport's
+            // clusters
+            GLuint programs[3] = { drawProg, drawInstancedProg, drawTerrainProg };
+            int usedPrograms = gTerrain ? 3 : 2;
+            if (!deferred)
+                clusteredLighting.update(lights, view, projection, vpX, vpY, vpWidth, vpHeight);
+            for(int p = 0; p < usedPrograms; p++)
+            {
+                if (!deferred)
+                    clusteredLighting.bind(programs[p]);
+                setCamera(programs[p], view, projection);
+            }
+
+            // Occluders are rasterized for this viewport before the drones
+            // are culled against them
+            bool occlude = occlusion.hasOccluders();
+            if (occlude)
+                occlusion.render(view, projection, (float)vpWidth / (float)std::max(vpHeight, 1));
+
+            city.submit(view, projection, drawProg, renderQueue);
+            droneView.submitFleet(fleet, view, projection, vpHeight, v,
+                                  drawProg, drawInstancedProg, renderQueue,
+                                  occlude ? &occlusion : nullptr);
+            if (gTerrain)
+                terrain.submit(view, projection, drawTerrainProg, renderQueue);
+            renderQueue.flush();
+
+            // Deferred draws them once the viewport is lit
+            if (gTrails && !deferred)
+            {
+                setCamera(trailProg, view, projection);
+                trails.draw(trailProg, simTime);
+            }
+            if (!deferred)
+            {
+                setCamera(particleProg, view, projection);
+                particles.draw(particleProg, projection, vpHeight);
+            }
+        }
+
+        if (deferred)
+        {
+            gpuTimer.beginPass("lighting");
+            for(int v = 0; v < viewportCount; v++)
+            {
+                int vpWidth  = gSplitScreen ? renderWidth / 2  : renderWidth;
+                int vpHeight = gSplitScreen ? renderHeight / 2 : renderHeight;
+                int vpX = gSplitScreen ? (v % 2) * vpWidth : 0;
+                int vpY = gSplitScreen ? (v < 2 ? vpHeight : 0) : 0;
+
+                clusteredLighting.update(lights, viewports[v][0], viewports[v][1],
+                                         vpX, vpY, vpWidth, vpHeight);
+                clusteredLighting.bind(lightingProg);
+                deferredRenderer.lightViewport(lightingProg, viewports[v][1],
+                                               vpX, vpY, vpWidth, vpHeight);
+                if (gTrails)
+                {
+                    setCamera(trailProg, viewports[v][0], viewports[v][1]);
+                    trails.draw(trailProg, simTime);
+                }
+                setCamera(particleProg, viewports[v][0], viewports[v][1]);
+                particles.draw(particleProg, viewports[v][1], vpHeight);
+            }
+            deferredRenderer.endFrame();
+        }
+
+        glViewport(0, 0, gWindowWidth, gWindowHeight);
+        droneView.endFrame();
+        if (gTerrain)
+            terrain.endFrame();
+        gpuTimer.endPass();
+
+        if (gDynamicResolution)
+        {
+            gpuTimer.beginPass("upscale");
+            gDynamicResolution->endFrame();
+            gpuTimer.endPass();
+        }
+
+        // Last frame's numbers, over the final image at full resolution
+        if (gStatsOverlay)
+        {
+            gpuTimer.beginPass("overlay");
+            statsOverlay.clear();
+            addStatsText(statsOverlay, RenderStats::getLastFrame());
+            statsOverlay.draw(overlayProg, gWindowWidth, gWindowHeight);
+            gpuTimer.endPass();
+        }
+
+        // Start reading this frame back; it is written out frames later
+        if (recorder.isRecording())
+        {
+            gpuTimer.beginPass("record");
+            recorder.capture(gWindowWidth, gWindowHeight);
+            gpuTimer.endPass();
+        }
+
+        gpuTimer.endFrame();
+
+        if (gPrintQueueStats && (gQueueStatsTimer += dt) >= 2.f)
+        {
+            const RenderQueueStats& st = renderQueue.getStats();
+            std::cout << "RenderQueue: " << st.items << " draws, "
+                      << st.programChanges  << " program / " << st.vaoChanges << " VAO / "
+                      << st.materialChanges << " material changes (avoided "
+                      << st.programChangesAvoided << " / " << st.vaoChangesAvoided << " / "
+                      << st.materialChangesAvoided << ")" << std::endl;
+
+            const StreamingBuffer& sb = droneView.getInstanceBuffer();
+            std::cout << "Instance stream: " << (sb.isPersistent() ? "persistent" : "orphaning")
+                      << ", " << sb.getOrphanCount() << " orphans" << std::endl;
+            if (gTrails)
+                std::cout << "Trails: " << fleet.size() << " x " << TrailRenderer::kTrailPoints
+                          << " points, " << trails.getBytesPerFrame() << " bytes uploaded per frame"
+                          << std::endl;
+            if (particles.getCount() > 0)
+            {
+                std::cout << "Particles: " << particles.getCount() << " stepped on the "
+                          << (particles.isGpu() ? "GPU (transform feedback)" : "CPU");
+                if (!particles.isGpu())
+                    std::cout << " in " << particles.getCpuMs() << " ms";
+                std::cout << std::endl;
+            }
+            gQueueStatsTimer = 0.f;
+        }
+
+        if (gPrintLightStats && (gLightStatsTimer += dt) >= 2.f)
+        {
+            std::cout << "Lights: " << clusteredLighting.getLightCount() << " clustered, "
+                      << clusteredLighting.getIndexCount() << " cluster entries, culled in "
+                      << clusteredLighting.getCullMs() << " ms on "
+                      << clusteredLighting.getThreadCount() << " threads" << std::endl;
+            gLightStatsTimer = 0.f;
+        }
+
+        if (gPrintOcclusionStats && city.isLoaded() && (gOcclusionStatsTimer += dt) >= 2.f)
+        {
+            std::cout << "Occlusion: " << droneView.getOccludedCount() << " drones hidden, "
+                      << droneView.getCulledCount() << " outside the frustum; "
+                      << occlusion.getTriangleCount() << " of " << city.getTriangleCount()
+                      << " city triangles rasterized in " << occlusion.getRasterMs() << " ms" << std::endl;
+            gOcclusionStatsTimer = 0.f;
+        }
+
+        if (gPrintTerrainStats && gTerrain && (gTerrainStatsTimer += dt) >= 2.f)
+        {
+            const TerrainTiles& tiles = terrain.getTiles();
+            std::cout << "Terrain: " << terrain.getSize() << " m, " << terrain.getLevelCount()
+                      << " levels, " << terrain.getNodeCount() << " nodes drawn, "
+                      << terrain.getResidentCount() << " tiles resident, "
+                      << terrain.getPendingCount() << " loading (" << tiles.getReadCount()
+                      << " read, " << tiles.getGeneratedCount() << " generated)" << std::endl;
+            gTerrainStatsTimer = 0.f;
+        }
+
+        if (gPrintGpuStats && (gGpuStatsTimer += dt) >= 2.f)
+        {
+            const std::vector<GpuPassTime>& passes = gpuTimer.getPasses();
+            std::cout << "GPU:";
+            for(size_t i = 0; i < passes.size(); i++)
+                std::cout << " " << passes[i].name << " " << passes[i].avgMs << " ms";
+            std::cout << " (dropped " << gpuTimer.getDroppedFrames() << " frames)";
+            if (gDynamicResolution)
+                std::cout << ", rendering at " << gDynamicResolution->getRenderWidth() << "x"
+                          << gDynamicResolution->getRenderHeight() << " ("
+                          << (int)(gDynamicResolution->getScale() * 100.f + 0.5f)
+                          << "%, budget " << gFrameBudgetMs << " ms)";
+            std::cout << std::endl;
+            gGpuStatsTimer = 0.f;
+        }
+
+        RenderStats::endFrame((nowSeconds() - currentTime) * 1000.0, gpuTimer.getFrameMs());
+        if (gPrintRenderStats && (gRenderStatsTimer += dt) >= 2.f)
+        {
+            const FrameStats& st = RenderStats::getLastFrame();
+            std::cout << "Frame: " << st.drawCalls << " draws, " << st.primitives << " primitives, "
+                      << st.uniformCalls << " uniform uploads, " << st.uploadBytes << " bytes uploaded, "
+                      << st.stateChanges << " state changes, " << st.cpuMs << " ms CPU, ";
+            if (st.gpuMs >= 0.0)
+                std::cout << st.gpuMs << " ms GPU" << std::endl;
+            else
+                std::cout << "GPU time dropped" << std::endl;
+            gRenderStatsTimer = 0.f;
+        }
+
+        if (window)
+            glfwSwapBuffers(window);
+        framePacer.frameSubmitted();
+
+        if (gPrintLatencyStats && (gLatencyStatsTimer += dt) >= 2.f)
+        {
+            std::cout << "Latency: input to swap " << framePacer.getSwapLatencyMs()
+                      << " ms, to GPU done " << framePacer.getCompletionLatencyMs()
+                      << " ms, pacing wait " << framePacer.getWaitMs() << " ms ("
+                      << framePacer.getMaxFramesInFlight() << " frames in flight, vsync "
+                      << (gVsync ? "on" : "off") << ")" << std::endl;
+            gLatencyStatsTimer = 0.f;
+        }
+        frame++;
+    }
+
+    if (gHeadless)
+    {
+        // Nothing paces a headless run, so this is the benchmark figure
+        glFinish();
+        double totalMs = (nowSeconds() - startTime) * 1000.0;
+        std::cout << "Rendered " << frame << " frames in " << totalMs << " ms ("
+                  << totalMs / frame << " ms/frame)" << std::endl;
+
+        if (!gCapturePath.empty() && headless.savePPM(gCapturePath))
+            std::cout << "Saved last frame to " << gCapturePath << std::endl;
+    }
+
+    if (recorder.isRecording())
+    {
+        recorder.stop();
+        std::cout << "Recorded " << recorder.getWrittenCount() << " frames to " << gRecordDir
+                  << " (" << recorder.getDroppedCount() << " dropped)" << std::endl;
     }
 
     droneView.cleanupDrone();
+    clusteredLighting.cleanup();
+    deferredRenderer.cleanup();
+    gDynamicResolution = nullptr;
+    dynamicResolution.cleanup();
+    trails.cleanup();
+    particles.cleanup();
+    statsOverlay.cleanup();
+    shaders.cleanup();
+    city.cleanup();
+    terrain.cleanup();
+    gpuTimer.cleanup();
+    framePacer.cleanup();
     glDeleteProgram(shaderProg);
+    glDeleteProgram(instancedProg);
+    glDeleteProgram(gbufferProg);
+    glDeleteProgram(gbufferInstancedProg);
+    glDeleteProgram(lightingProg);
+    glDeleteProgram(terrainProg);
+    glDeleteProgram(gbufferTerrainProg);
+    glDeleteProgram(trailProg);
+    glDeleteProgram(particleProg);
+    glDeleteProgram(overlayProg);
+    if (particleUpdateProg)
+        glDeleteProgram(particleUpdateProg);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (window)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    else
+        headless.destroy();
     return 0;
 }
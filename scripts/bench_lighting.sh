@@ -0,0 +1,19 @@
+#!/bin/sh
+# Compare the forward and deferred lighting backends headless, over a range
+# of drone and nav-light counts. Run from the repository root after "make".
+#   scripts/bench_lighting.sh [frames]
+FRAMES=${1:-200}
+DRONE=./drone
+
+printf "%-9s %6s %7s %12s %s\n" backend drones lights "ms/frame" "GPU passes"
+for fleet in 100 500 2000; do
+    for lights in 0 256 4096; do
+        for backend in forward deferred; do
+            out=$($DRONE --headless --frames "$FRAMES" --fleet "$fleet" --nav-lights "$lights" \
+                         --lighting "$backend" --gpu-stats --vsync 0 2>&1)
+            ms=$(echo "$out" | sed -n 's/.*(\(.*\) ms\/frame).*/\1/p')
+            gpu=$(echo "$out" | grep '^GPU:' | tail -n 1 | sed 's/^GPU: //; s/ (dropped.*//')
+            printf "%-9s %6s %7s %12s %s\n" "$backend" "$((fleet + 1))" "$lights" "$ms" "$gpu"
+        done
+    done
+done
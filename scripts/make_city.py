@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Write a grid of box buildings as an OBJ file, for "./drone --city".
+
+    scripts/make_city.py [out.obj] [blocks] [seed]
+
+Buildings are blocks x blocks boxes, 16 m square with 10 m streets,
+centred on the origin and standing on y = -1 (just under the drones'
+flight height), 8-60 m tall. Blocks near the origin are left empty as a
+square for the lead drone and the startup camera. Every face has its own
+four vertices and normals, written in the same order so vertex i uses
+normal i.
+"""
+import random
+import sys
+
+out = sys.argv[1] if len(sys.argv) > 1 else "city.obj"
+blocks = int(sys.argv[2]) if len(sys.argv) > 2 else 12
+rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 4300)
+
+SIZE, STREET, GROUND = 16.0, 10.0, -1.0
+PLAZA = 8.0  # half width of the empty square
+
+# Walls and roof of a unit box: normal, then the corners counter-clockwise
+# seen from outside
+FACES = [
+    ((0, 0, 1),  [(0, 0, 1), (1, 0, 1), (1, 1, 1), (0, 1, 1)]),
+    ((0, 0, -1), [(1, 0, 0), (0, 0, 0), (0, 1, 0), (1, 1, 0)]),
+    ((1, 0, 0),  [(1, 0, 1), (1, 0, 0), (1, 1, 0), (1, 1, 1)]),
+    ((-1, 0, 0), [(0, 0, 0), (0, 0, 1), (0, 1, 1), (0, 1, 0)]),
+    ((0, 1, 0),  [(0, 1, 1), (1, 1, 1), (1, 1, 0), (0, 1, 0)]),
+]
+
+pitch = SIZE + STREET
+origin = -0.5 * (blocks * pitch - STREET)
+lines = ["# %dx%d city blocks" % (blocks, blocks)]
+faces = []
+count = 0
+buildings = 0
+for bz in range(blocks):
+    for bx in range(blocks):
+        x0, z0 = origin + bx * pitch, origin + bz * pitch
+        if x0 < PLAZA and x0 + SIZE > -PLAZA and z0 < PLAZA and z0 + SIZE > -PLAZA:
+            continue
+        height = rng.uniform(8.0, 60.0)
+        for normal, corners in FACES:
+            for cx, cy, cz in corners:
+                lines.append("v %g %g %g" % (x0 + cx * SIZE, GROUND + cy * height, z0 + cz * SIZE))
+                lines.append("vn %g %g %g" % normal)
+            faces.append("f " + " ".join("%d//%d" % (count + k, count + k) for k in range(1, 5)))
+            count += 4
+        buildings += 1
+
+with open(out, "w") as f:
+    f.write("\n".join(lines + faces) + "\n")
+print("Wrote %d buildings (%d vertices) to %s" % (buildings, count, out))